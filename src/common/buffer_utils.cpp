@@ -32,17 +32,17 @@ void EBO::load(const std::vector<glm::ivec3> &data, GLenum usage) {
     load(data.data(), data.size() * sizeof(glm::ivec3), usage);
 }
 
-void VAO::linkAttribute(VBO vbo, const Attribute &attr, const void *offset) {
+void VAO::linkAttribute(VBO &vbo, const Attribute &attr, const void *offset) {
     bind();
     vbo.bind();
     glVertexAttribPointer(attr.inputNumber, lengthOfGLSLType(attr.type), primitiveGLSLType(attr.type), GL_FALSE, sizeOfGLSLType(attr.type), offset);
     glEnableVertexAttribArray(attr.inputNumber);
     vbo.unbind();
 }
-void VAO::linkAttribute(VBO vbo, int layout, int len, GLenum type, int blockSize, const void *offset) {
+void VAO::linkAttribute(VBO &vbo, int layout, int len, GLenum type, int blockSize, const void *offset, GLboolean normalized) {
     bind();
     vbo.bind();
-    glVertexAttribPointer(layout, len, type, GL_FALSE, blockSize, offset);
+    glVertexAttribPointer(layout, len, type, normalized, blockSize, offset);
     glEnableVertexAttribArray(layout);
     vbo.unbind();
 }
@@ -50,17 +50,36 @@ VAORenderingObject::VAORenderingObject(Shader *shader, WeakSuperMesh *mesh) {
     this->shader = shader;
     this->mesh = mesh;
     vao = VAO();
-    stdVBO = VBO();
     matVBO = VBO();
     ex0VBO = VBO();
     exVBO = VBO();
     ebo = EBO();
 }
 
+// the first standard attribute stored in the same stream as type, whose VBO holds that stream
+int VAORenderingObject::streamOwner(CommonBufferType type) const {
+    for (int i = POSITION; i < type; i++)
+        if (mesh->getBufferStream(static_cast<CommonBufferType>(i)) == mesh->getBufferStream(type))
+            return i;
+    return type;
+}
+
+// every stream of the mesh's layout is uploaded once: four VBOs for SoA, two for hybrid, one for AoS; packed uvs and colours
+// go as stored, octahedral normals are decoded into a temporary copy since shaders read them as vec3
 void VAORenderingObject::loadStdVBO(GLenum usage) {
     vao.bind();
-    stdVBO.bind();
-    stdVBO.load(mesh->getBufferLocation(POSITION), mesh->getBufferLength(POSITION)*sizeof(Stds), usage);
+    for (int i = POSITION; i <= COLOR; i++) {
+        auto type = static_cast<CommonBufferType>(i);
+        if (streamOwner(type) != i)
+            continue;
+        if (mesh->getBufferBoss().attributeEncoding(type) == OCTAHEDRAL_SNORM16) {
+            vector<char> decoded = vector<char>(mesh->getBufferLength(type)*bufferElementSize(type));
+            mesh->getBufferBoss().gatherAttribute(type, decoded.data());
+            stdVBOs[i].load(decoded.data(), decoded.size(), usage);
+        }
+        else
+            stdVBOs[i].load(mesh->getBufferStream(type), mesh->getBufferLength(type)*mesh->getBufferStride(type), usage);
+    }
 }
 void VAORenderingObject::loadMatVBO(GLenum usage) {
     matVBO.load(mesh->getBufferLocation(MATERIAL1), mesh->getBufferLength(MATERIAL1)*sizeof(vec4x4), usage);
@@ -96,11 +115,16 @@ void VAORenderingObject::setUniforms(float t) {
 }
 
 void VAORenderingObject::linkStdVBO() {
-
-    vao.linkAttribute(stdVBO, 0, 3, GL_FLOAT, sizeof(Stds), (void*)0);
-    vao.linkAttribute(stdVBO, 1, 3, GL_FLOAT, sizeof(Stds), (void*)(sizeof(vec3)));
-    vao.linkAttribute(stdVBO, 2, 2, GL_FLOAT, sizeof(Stds), (void*)(2*sizeof(vec3)));
-    vao.linkAttribute(stdVBO, 3, 4, GL_FLOAT, sizeof(Stds), (void*)(2*sizeof(vec3)+sizeof(vec2)));
+    for (int i = POSITION; i <= COLOR; i++) {
+        auto type = static_cast<CommonBufferType>(i);
+        VBO &vbo = stdVBOs[streamOwner(type)];
+        switch (mesh->getBufferBoss().attributeEncoding(type)) {
+            case OCTAHEDRAL_SNORM16: vao.linkAttribute(vbo, i, 3, GL_FLOAT, bufferElementSize(type), (void*)0); break;
+            case HALF_FLOAT2: vao.linkAttribute(vbo, i, 2, GL_HALF_FLOAT, mesh->getBufferStride(type), (void*)mesh->getBufferOffset(type)); break;
+            case UNORM8x4: vao.linkAttribute(vbo, i, 4, GL_UNSIGNED_BYTE, mesh->getBufferStride(type), (void*)mesh->getBufferOffset(type), GL_TRUE); break;
+            default: vao.linkAttribute(vbo, i, bufferElementLength(type), GL_FLOAT, mesh->getBufferStride(type), (void*)mesh->getBufferOffset(type));
+        }
+    }
 }
 void VAORenderingObject::linkMatVBO() {
     vao.linkAttribute(matVBO, 4, 4, GL_FLOAT, sizeof(vec4x4), (void *)mesh->offset(MATERIAL1));
@@ -121,7 +145,6 @@ void VAORenderingObject::linkExVBO() {
 void VAORenderingObject::render(float t) {
 
     vao.bind();
-    stdVBO.bind();
     ebo.bind();
 
     glDrawElements(GL_TRIANGLES, mesh->bufferIndexLength()*3, GL_UNSIGNED_INT, 0);
@@ -130,36 +153,19 @@ void VAORenderingObject::render(float t) {
 
 void VAORenderingObject::init() {
     shader->use();
-    vao.bind();
-    stdVBO.bind();
-    glBufferData(GL_ARRAY_BUFFER, mesh->getBufferLength(POSITION)*sizeof(vec3), mesh->getBufferLocation(POSITION), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Stds), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glBufferData(GL_ARRAY_BUFFER, mesh->getBufferLength(POSITION)*sizeof(vec3), mesh->getBufferLocation(NORMAL), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Stds), (void*)sizeof(vec3));
-    glEnableVertexAttribArray(1);
-
-    glBufferData(GL_ARRAY_BUFFER, mesh->getBufferLength(POSITION)*sizeof(vec2), mesh->getBufferLocation(UV), GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Stds), (void*)(2*sizeof(vec3)));
-    glEnableVertexAttribArray(2);
-
-    glBufferData(GL_ARRAY_BUFFER, mesh->getBufferLength(POSITION)*sizeof(vec4), mesh->getBufferLocation(COLOR), GL_STATIC_DRAW);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Stds), (void*)(2*sizeof(vec3) + sizeof(vec2)));
-    glEnableVertexAttribArray(3);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    loadStdVBO(GL_STATIC_DRAW);
+    linkStdVBO();
 
+    vao.bind();
     ebo.bind();
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->bufferIndexSize()*sizeof(GLuint)*3, mesh->bufferIndexLocation(), GL_STATIC_DRAW);
 
     vao.unbind();
     ebo.unbind();
-    stdVBO.unbind();
+    VBO::unbind();
 
 
     // loadActiveAttrs(GL_STATIC_DRAW);
-    // linkStdVBO();
 
 }
 
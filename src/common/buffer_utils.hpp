@@ -12,6 +12,7 @@
 
 #include "glsl_utils.hpp"
 
+#include <array>
 #include <map>
 #include <string>
 #include <memory>
@@ -52,8 +53,8 @@ public:
   ~VAO() { destroy(); }
   void bind() { glBindVertexArray(id); }
   static void unbind() { glBindVertexArray(0); }
-  void linkAttribute(VBO vbo, const Attribute &attr, const void* offset);
-  void linkAttribute(VBO vbo, int layout, int len, GLenum type, int blockSize, const void* offset);
+  void linkAttribute(VBO &vbo, const Attribute &attr, const void* offset);
+  void linkAttribute(VBO &vbo, int layout, int len, GLenum type, int blockSize, const void* offset, GLboolean normalized=GL_FALSE);
 
 };
 
@@ -111,10 +112,13 @@ class VAORenderingObject {
   Shader *shader;
   VAO vao;
   WeakSuperMesh *mesh;
-  VBO stdVBO, matVBO, ex0VBO, exVBO;
+  std::array<VBO, 4> stdVBOs; // one per stream of the mesh's vertex layout, unused ones stay empty
+  VBO matVBO, ex0VBO, exVBO;
   EBO ebo;
   std::vector<std::function<void(float, Shader&)>> setters = {};
 
+  int streamOwner(CommonBufferType type) const;
+
 public:
   mutable LOGGING logger = NOPE;
   VAORenderingObject(Shader *shader, WeakSuperMesh *mesh);
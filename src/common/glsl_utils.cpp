@@ -790,6 +790,13 @@ mat4 Camera::mvp(float t, const mat4 &modelTransform)
     return projectionMatrix * viewMatrix(t) * modelTransform;	
 }
 
+// world space size of pixelError pixels at distance of p from the camera, to be used as adaptive meshing tolerance
+Foo31 Camera::screenSpaceTolerance(float t, float pixelError, int screenWidth) {
+	vec3 eye = position(t);
+	float k = 2*std::tan(fov_x/2)*pixelError/screenWidth;
+	return [eye, k, near=clippingRangeMin](vec3 p) { return k*max(norm(p - eye), near); };
+}
+
 
 Attribute::Attribute(std::string name, GLSLType type, int inputNumber)
 {
@@ -824,9 +831,9 @@ void Attribute::initBuffer()
 void Attribute::enable()
 {
 	glEnableVertexAttribArray(this->inputNumber);
-	glBindBuffer(GL_ARRAY_BUFFER, this->bufferAddress);
+	glBindBuffer(GL_ARRAY_BUFFER, bufferOwner != nullptr ? bufferOwner->bufferAddress : this->bufferAddress);
 	this->enabled = true;
-	glVertexAttribPointer(this->inputNumber, lengthOfGLSLType(this->type), GL_FLOAT, GL_FALSE, 0, (void *)0);
+	glVertexAttribPointer(this->inputNumber, components > 0 ? components : lengthOfGLSLType(this->type), componentType, normalized, this->stride, (void *)this->offset);
 }
 
 void Attribute::disable()
@@ -837,20 +844,69 @@ void Attribute::disable()
 
 void Attribute::load(const void *firstElementAdress, int bufferLength)
 {
+	this->stride = 0;
+	this->offset = 0;
 	if (!bufferInitialized) {
 	    initBuffer();
 	    glBindBuffer(GL_ARRAY_BUFFER, this->bufferAddress);
 	    glBufferData(GL_ARRAY_BUFFER, bufferLength * this->size, firstElementAdress, GL_STATIC_DRAW);
+	    this->uploadedBytes = bufferLength * this->size;
 	    return;
 	}
 	glBindBuffer(GL_ARRAY_BUFFER, this->bufferAddress);
      glBufferData(GL_ARRAY_BUFFER, bufferLength * this->size, firstElementAdress, GL_STATIC_DRAW);
+	this->uploadedBytes = bufferLength * this->size;
     // void *ptr = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
     // memcpy(ptr, firstElementAdress, bufferLength * this->size);
     // glUnmapBuffer(GL_ARRAY_BUFFER);
 
 }
 
+void Attribute::load(const void *streamAddress, int bufferLength, int stride, size_t offset) {
+	if (!bufferInitialized)
+		initBuffer();
+	this->bufferOwner = nullptr;
+	this->stride = static_cast<size_t>(stride) == this->size ? 0 : stride;
+	this->offset = offset;
+	glBindBuffer(GL_ARRAY_BUFFER, this->bufferAddress);
+	glBufferData(GL_ARRAY_BUFFER, bufferLength * stride, streamAddress, GL_DYNAMIC_DRAW);
+	this->uploadedBytes = bufferLength * stride;
+}
+
+void Attribute::update(const void *streamAddress, int bufferLength, int stride, size_t offset, const DirtyRanges &ranges) {
+	if (!bufferInitialized || uploadedBytes != static_cast<size_t>(bufferLength) * stride) {
+		load(streamAddress, bufferLength, stride, offset);
+		return;
+	}
+	this->bufferOwner = nullptr;
+	this->stride = static_cast<size_t>(stride) == this->size ? 0 : stride;
+	this->offset = offset;
+	for (auto [begin, end]: ranges.ranges())
+		updateRange(static_cast<const char*>(streamAddress) + static_cast<size_t>(begin) * stride, begin, end, stride);
+}
+
+void Attribute::updateRange(const void *records, int begin, int end, int stride) {
+	glBindBuffer(GL_ARRAY_BUFFER, this->bufferAddress);
+	glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(begin) * stride, static_cast<GLsizeiptr>(end - begin) * stride, records);
+}
+
+void Attribute::setFormat(int components, GLenum componentType, bool normalized) {
+	this->components = components;
+	this->componentType = componentType;
+	this->normalized = normalized ? GL_TRUE : GL_FALSE;
+}
+
+void Attribute::shareBuffer(const Attribute &owner, int stride, size_t offset) {
+	this->bufferOwner = &owner;
+	this->stride = static_cast<size_t>(stride) == this->size ? 0 : stride;
+	this->offset = offset;
+	if (bufferInitialized && uploadedBytes > 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, this->bufferAddress);
+		glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
+	}
+	this->uploadedBytes = 0;
+}
+
 void Attribute::freeBuffer() {
     glDeleteBuffers(1, &this->bufferAddress);
     this->bufferAddress = -1;
@@ -880,6 +936,8 @@ RenderingStep::RenderingStep(const RenderingStep& other)
 
 RenderingStep::~RenderingStep()
 {
+	if (weak_super != nullptr && dirtyConsumer >= 0)
+		weak_super->getBufferBoss().removeDirtyConsumer(dirtyConsumer);
 	for (auto attribute : attributes)
 	{
 		attribute.reset();
@@ -900,6 +958,9 @@ void RenderingStep::setSuperMesh(const std::shared_ptr<SuperMesh> &super) {
 }
 
 void RenderingStep::setWeakSuperMesh(const std::shared_ptr<WeakSuperMesh> &super) {
+    if (weak_super != nullptr && dirtyConsumer >= 0)
+        weak_super->getBufferBoss().removeDirtyConsumer(dirtyConsumer);
+    this->dirtyConsumer = -1;
     this->super = nullptr;
     this-> model = nullptr;
     this-> weak_super = super;
@@ -927,11 +988,32 @@ void RenderingStep::initElementBuffer() {
 
 }
 
+// the ranges written since this step last uploaded; other steps drawing the same mesh keep theirs
+int RenderingStep::meshDirtyConsumer() {
+    if (dirtyConsumer < 0)
+        dirtyConsumer = weak_super->getBufferBoss().addDirtyConsumer();
+    return dirtyConsumer;
+}
+
+// faces are re-sent only when some were written since the last upload, and only the written ranges if the count is unchanged
 void RenderingStep::loadElementBuffer() {
     if (!weakSuperLoaded())
         throw std::invalid_argument("Element buffer can only be loaded for weak super mesh");
+    BufferManager &boss = weak_super->getBufferBoss();
+    int consumer = meshDirtyConsumer();
+    if (!boss.isDirty(INDEX, consumer) && elementBufferSize == weak_super->bufferIndexSize())
+        return;
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferLoc);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, weak_super->bufferIndexSize(), weak_super->bufferIndexLocation(), GL_STATIC_DRAW);
+    if (elementBufferSize != weak_super->bufferIndexSize()) {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, weak_super->bufferIndexSize(), weak_super->bufferIndexLocation(), GL_STATIC_DRAW);
+        elementBufferSize = weak_super->bufferIndexSize();
+    }
+    else {
+        size_t element = bufferElementSize(INDEX);
+        for (auto [begin, end]: boss.dirtyRanges(INDEX, consumer).ranges())
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, begin*element, (end - begin)*element, static_cast<const char*>(weak_super->bufferIndexLocation()) + begin*element);
+    }
+    boss.clearDirty(INDEX, consumer);
 }
 
 void RenderingStep::initStdAttributes()
@@ -969,11 +1051,75 @@ void RenderingStep::initUnusualAttributes(const std::vector<std::shared_ptr<Attr
 
 
 
+namespace {
+	// half float uvs and RGBA8 colours are read by the vertex fetch as they are stored
+	void setStreamFormat(Attribute &attribute, AttributeEncoding encoding) {
+		switch (encoding) {
+			case HALF_FLOAT2: attribute.setFormat(2, GL_HALF_FLOAT, false); break;
+			case UNORM8x4: attribute.setFormat(4, GL_UNSIGNED_BYTE, true); break;
+			default: attribute.setFormat(0, GL_FLOAT, false);
+		}
+	}
+
+	// Shaders read normals as vec3, so octahedral ones are decoded on the way to the GPU: the whole buffer when its size
+	// changed, otherwise only the written ranges, each through a temporary copy released right after the upload.
+	void uploadDecoded(Attribute &attribute, const BufferManager &boss, CommonBufferType type, const DirtyRanges &written) {
+		int n = boss.bufferLength(type);
+		size_t element = bufferElementSize(type);
+		attribute.setFormat(0, GL_FLOAT, false);
+		if (!attribute.bufferInitialized || attribute.bufferOwner != nullptr || attribute.uploadedBytes != n*element) {
+			vector<char> decoded = vector<char>(n*element);
+			boss.gatherAttribute(type, decoded.data());
+			attribute.load(decoded.data(), n, element, 0);
+			return;
+		}
+		for (auto [begin, end]: written.ranges()) {
+			vector<char> decoded = vector<char>((end - begin)*element);
+			boss.gatherAttribute(type, decoded.data(), begin, end);
+			attribute.updateRange(decoded.data(), begin, end, element);
+		}
+	}
+}
+
 void RenderingStep::loadStandardAttributes() {
+    // Only the element ranges written since the previous upload are sent. Attributes interleaved in one stream share the
+    // buffer of the first of them, which receives the ranges written in any of them. Packed attributes of the quantized
+    // layout are uploaded packed, except octahedral normals. Only this step's own dirty ranges are cleared, so other
+    // steps drawing the same mesh still see the writes.
     if (weakSuperLoaded())
     {
+        BufferManager &boss = weak_super->getBufferBoss();
+        int consumer = meshDirtyConsumer();
+        for (auto i = 0; i < 4; i++)
+        {
+            auto type = static_cast<CommonBufferType>(i);
+            const void *stream = weak_super->getBufferStream(type);
+            int owner = i;
+            for (int j = 0; j < i && owner == i; j++)
+                if (weak_super->getBufferStream(static_cast<CommonBufferType>(j)) == stream)
+                    owner = j;
+            if (owner != i) {
+                attributes[i]->shareBuffer(*attributes[owner], weak_super->getBufferStride(type), weak_super->getBufferOffset(type));
+                continue;
+            }
+            DirtyRanges written = boss.dirtyRanges(type, consumer);
+            for (int j = i + 1; j < 4; j++)
+                if (weak_super->getBufferStream(static_cast<CommonBufferType>(j)) == stream)
+                    for (auto [begin, end]: boss.dirtyRanges(static_cast<CommonBufferType>(j), consumer).ranges())
+                        written.mark(begin, end);
+            AttributeEncoding encoding = boss.attributeEncoding(type);
+            if (encoding == OCTAHEDRAL_SNORM16) {
+                uploadDecoded(*attributes[i], boss, type, written);
+                continue;
+            }
+            setStreamFormat(*attributes[i], encoding);
+            size_t bytes = weak_super->getBufferLength(type) * weak_super->getBufferStride(type);
+            if (written.empty() && attributes[i]->bufferInitialized && attributes[i]->bufferOwner == nullptr && attributes[i]->uploadedBytes == bytes)
+                continue;
+            attributes[i]->update(stream, weak_super->getBufferLength(type), weak_super->getBufferStride(type), weak_super->getBufferOffset(type), written);
+        }
         for (auto i = 0; i < 4; i++)
-            attributes[i]->load(weak_super->getBufferLocation(static_cast<CommonBufferType>(i)), weak_super->getBufferLength(CommonBufferType(i)));
+            boss.clearDirty(static_cast<CommonBufferType>(i), consumer);
         return;
     }
 
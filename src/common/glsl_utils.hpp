@@ -142,6 +142,7 @@ public:
 	mat4 mvp(float t, const mat4 &modelTransform);
 	mat4 viewMatrix(float t);
 	mat4 vp(float t);
+	Foo31 screenSpaceTolerance(float t, float pixelError, int screenWidth);
 };
 
 class Attribute {
@@ -153,6 +154,15 @@ public:
 	int inputNumber;
 	bool enabled;
 	bool bufferInitialized;
+	int stride = 0;
+	size_t offset = 0;
+	size_t uploadedBytes = 0;
+	// set when the attribute is read from the buffer of another one, e.g. as a field of an interleaved stream
+	const Attribute *bufferOwner = nullptr;
+	// vertex format of the buffer; components = 0 stands for the floats of the GLSL type
+	int components = 0;
+	GLenum componentType = GL_FLOAT;
+	GLboolean normalized = GL_FALSE;
 
 	Attribute(std::string name, GLSLType type, int inputNumber);
 	virtual ~Attribute();
@@ -161,6 +171,15 @@ public:
 	virtual void enable();
 	virtual void disable();
 	virtual void load(const void* firstElementAdress, int bufferLength);
+	// uploads bufferLength elements of a stream in which the attribute sits at offset inside stride-byte records
+	void load(const void* streamAddress, int bufferLength, int stride, size_t offset);
+	// uploads only the given element ranges, or the whole stream if the size of the buffer changed
+	void update(const void* streamAddress, int bufferLength, int stride, size_t offset, const DirtyRanges &ranges);
+	// reads the attribute at offset inside stride-byte records of the buffer of owner; the own buffer is emptied
+	void shareBuffer(const Attribute &owner, int stride, size_t offset);
+	// writes records [begin, end) of an already loaded buffer from a copy holding just these records
+	void updateRange(const void* records, int begin, int end, int stride);
+	void setFormat(int components, GLenum componentType, bool normalized);
 	virtual void freeBuffer();
 };
 
@@ -175,6 +194,8 @@ public:
 	std::shared_ptr<SuperMesh> super = nullptr;
     std::shared_ptr<WeakSuperMesh> weak_super = nullptr;
     GLuint elementBufferLoc = 0;
+    size_t elementBufferSize = 0;
+    int dirtyConsumer = -1; // own dirty ranges in the buffers of weak_super, registered on first upload
 
 	std::map<std::string, GLSLType> uniforms;
 	std::map<std::string, std::shared_ptr<std::function<void(float, std::shared_ptr<Shader>)>>> uniformSetters;
@@ -192,6 +213,7 @@ public:
     void initElementBuffer();
 	void resetAttributeBuffers();
 	void initUnusualAttributes(const std::vector<std::shared_ptr<Attribute>>& attributes);
+	int meshDirtyConsumer();
 	void loadStandardAttributes(); // 0:position, 1:normal, 2:color, 3:uv
     void loadElementBuffer();
 	void enableAttributes();
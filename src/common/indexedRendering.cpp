@@ -4,13 +4,17 @@
 #include <vector>
 #include<fstream>
 #include<sstream>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <iostream>
 
 using namespace glm;
 using std::vector, std::string, std::shared_ptr, std::unique_ptr, std::pair, std::make_unique, std::make_shared, std::array, std::weak_ptr;
 
 BufferManager::BufferManager(const std::set<CommonBufferType> &activeBuffers) {
-    stds = make_unique<Stds>();
-
     extra0 = activeBuffers.contains(EXTRA0) ? make_unique<BUFF4>() : nullptr;
     extra = nullptr;
     if (activeBuffers.contains(EXTRA1) || activeBuffers.contains(EXTRA2) || activeBuffers.contains(EXTRA3) || activeBuffers.contains(EXTRA4))
@@ -47,7 +51,7 @@ int BufferManager::bufferLength(CommonBufferType type) const {
         case EXTRA2:
         case EXTRA3:
         case EXTRA4:
-            return stds->positions.size();
+            return visitLayout([](const auto &s) { return static_cast<int>(s.size()); });
         case INDEX:
             return indices->size();
     }
@@ -57,13 +61,10 @@ int BufferManager::bufferLength(CommonBufferType type) const {
 void *BufferManager::firstElementAddress(CommonBufferType type) const {
     switch (type) {
     case POSITION:
-        return &stds->positions[0];
     case NORMAL:
-        return &stds->normals[0];
     case UV:
-        return &stds->uvs[0];
     case COLOR:
-        return &stds->colors[0];
+        return const_cast<char*>(static_cast<const char*>(streamAddress(type))) + attributeOffset(type);
     case EXTRA0:
         return extra0->data();
     case EXTRA1:
@@ -82,18 +83,172 @@ void *BufferManager::firstElementAddress(CommonBufferType type) const {
     throw UnknownVariantError("Buffer not recognised among common types. ");
 }
 
+const void * BufferManager::streamAddress(CommonBufferType type) const {
+    if (type > COLOR)
+        return firstElementAddress(type);
+    return visitLayout([type](const auto &s) { return s.stream(type); });
+}
+
+size_t BufferManager::attributeStride(CommonBufferType type) const {
+    if (type <= COLOR)
+        return visitLayout([type](const auto &s) { return s.stride(type); });
+    return bufferElementSize(type);
+}
+
+size_t BufferManager::attributeOffset(CommonBufferType type) const {
+    if (type <= COLOR)
+        return visitLayout([type](const auto &s) { return s.offset(type); });
+    return 0;
+}
+
+AttributeEncoding BufferManager::attributeEncoding(CommonBufferType type) const {
+    if (!isPacked(type))
+        return FLOAT_COMPONENTS;
+    return type == NORMAL ? OCTAHEDRAL_SNORM16 : type == UV ? HALF_FLOAT2 : UNORM8x4;
+}
+
+void BufferManager::gatherAttribute(CommonBufferType type, void *out, int begin, int end) const {
+    if (end < 0)
+        end = bufferLength(type);
+    size_t element = bufferElementSize(type);
+    char *target = static_cast<char*>(out);
+    if (type > COLOR) {
+        std::memcpy(target, static_cast<const char*>(firstElementAddress(type)) + begin*element, (end - begin)*element);
+        return;
+    }
+    visitLayout([&](const auto &s) {
+        for (int i = begin; i < end; i++)
+            switch (type) {
+                case POSITION: { vec3 v = s.position(i); std::memcpy(target + (i - begin)*element, &v, sizeof(vec3)); break; }
+                case NORMAL: { vec3 v = s.normal(i); std::memcpy(target + (i - begin)*element, &v, sizeof(vec3)); break; }
+                case UV: { vec2 v = s.uv(i); std::memcpy(target + (i - begin)*element, &v, sizeof(vec2)); break; }
+                default: { vec4 v = s.color(i); std::memcpy(target + (i - begin)*element, &v, sizeof(vec4)); }
+            }
+    });
+}
+
+// the standard attributes are copied into storage of the new layout, through the encoding of the quantized one if it
+// is involved; extras and indices are not affected
+void BufferManager::setLayout(VertexLayout layout, VertexQuantization quantization) {
+    if (layout == getLayout() && (layout != QUANTIZED_LAYOUT || quantization == getQuantization()))
+        return;
+    VertexStorage converted;
+    switch (layout) {
+        case AOS_LAYOUT: converted = AoSVertices(); break;
+        case HYBRID_LAYOUT: converted = HybridVertices(); break;
+        case QUANTIZED_LAYOUT: converted = QuantizedVertices{quantization}; break;
+        default: converted = SoAVertices();
+    }
+    std::visit([](auto &target, const auto &source) {
+        target.reserve(source.size());
+        for (int i = 0; i < source.size(); i++)
+            target.push_back(source.position(i), source.normal(i), source.uv(i), source.color(i));
+    }, converted, stds);
+    stds = std::move(converted);
+    markAllDirty();
+}
+
+
+void DirtyRanges::mark(int begin, int end) {
+    if (begin >= end)
+        return;
+    if (intervals.empty() || begin > intervals.back().second) {
+        intervals.emplace_back(begin, end);
+        return;
+    }
+    if (begin >= intervals.back().first) {
+        intervals.back().second = std::max(intervals.back().second, end);
+        return;
+    }
+    // every interval overlapping or touching [begin, end) is merged into the first of them
+    auto first = std::lower_bound(intervals.begin(), intervals.end(), begin, [](const pair<int, int> &r, int b) { return r.second < b; });
+    auto last = first;
+    while (last != intervals.end() && last->first <= end) {
+        begin = std::min(begin, last->first);
+        end = std::max(end, last->second);
+        ++last;
+    }
+    if (first == last) {
+        intervals.insert(first, {begin, end});
+        return;
+    }
+    *first = {begin, end};
+    intervals.erase(first + 1, last);
+}
+
+bool DirtyRanges::contains(int index) const {
+    auto after = std::upper_bound(intervals.begin(), intervals.end(), index, [](int i, const pair<int, int> &r) { return i < r.first; });
+    return after != intervals.begin() && index < std::prev(after)->second;
+}
+
+int DirtyRanges::elementCount() const {
+    int count = 0;
+    for (auto [begin, end]: intervals)
+        count += end - begin;
+    return count;
+}
+
+void BufferManager::markDirty(CommonBufferType type, int begin, int end) {
+    for (int c = 0; c < dirty.size(); c++)
+        if (dirtyConsumers[c])
+            dirty[c][type].mark(begin, end);
+}
+
+void BufferManager::markDirty(const BufferRanges &ranges) {
+    for (int type = POSITION; type <= EXTRA4; type++)
+        for (auto [begin, end]: ranges[type].ranges())
+            markDirty(static_cast<CommonBufferType>(type), begin, end);
+}
+
+void BufferManager::markAllDirty() {
+    for (CommonBufferType type: activeBuffers)
+        if (bufferLength(type) > 0)
+            markDirty(type, 0, bufferLength(type));
+}
+
+int BufferManager::addDirtyConsumer() {
+    auto free = std::find(dirtyConsumers.begin(), dirtyConsumers.end(), 0);
+    int consumer = free - dirtyConsumers.begin();
+    if (free == dirtyConsumers.end()) {
+        dirty.emplace_back();
+        dirtyConsumers.push_back(1);
+    }
+    else
+        *free = 1;
+    clearDirty(consumer);
+    for (CommonBufferType type: activeBuffers)
+        if (bufferLength(type) > 0)
+            dirty[consumer][type].mark(0, bufferLength(type));
+    return consumer;
+}
+
+void BufferManager::removeDirtyConsumer(int consumer) {
+    if (consumer < 0 || consumer >= dirtyConsumers.size())
+        return;
+    dirtyConsumers[consumer] = 0;
+    clearDirty(consumer);
+}
+
 
 int BufferManager::addTriangleVertexIndices(glm::ivec3 ind, int shift) {
     indices->push_back(ind+ivec3(shift));
+    markDirty(INDEX, bufferLength(INDEX) - 1);
     return bufferLength(INDEX) - 1;
 }
 
 int BufferManager::addStdAttributesFromVertex(vec3 pos, vec3 norm, vec2 uv, vec4 col) {
-    stds->positions.push_back(pos);
-    stds->normals.push_back(norm);
-    stds->uvs.push_back(uv);
-    stds->colors.push_back(col);
-    return stds->positions.size() - 1;
+    int index = visitLayout([&](auto &s) { s.push_back(pos, norm, uv, col); return static_cast<int>(s.size()) - 1; });
+    // extra slots stay aligned with positions so that setExtra can address any vertex
+    if (isActive(EXTRA0))
+        extra0->emplace_back(0);
+    if (isActive(EXTRA1)) extra->a.emplace_back(0);
+    if (isActive(EXTRA2)) extra->b.emplace_back(0);
+    if (isActive(EXTRA3)) extra->c.emplace_back(0);
+    if (isActive(EXTRA4)) extra->d.emplace_back(0);
+    for (CommonBufferType type: activeBuffers)
+        if (type != INDEX)
+            markDirty(type, index);
+    return index;
 }
 
 int BufferManager::addFullVertexData(vec3 pos, vec3 norm, vec2 uv, vec4 col) {
@@ -180,7 +335,8 @@ std::array<glm::vec3, 3> IndexedTriangle::borderTriangle(float width) const {
 WeakSuperMesh::WeakSuperMesh(WeakSuperMesh &&other) noexcept: boss(std::move(other.boss)),
                                                               vertices(std::move(other.vertices)),
                                                               triangles(std::move(other.triangles)),
-                                                              material(std::move(other.material)) {}
+                                                              material(std::move(other.material)),
+                                                              topologyCache(std::move(other.topologyCache)) {}
 
 WeakSuperMesh & WeakSuperMesh::operator=(WeakSuperMesh &&other) noexcept {
     if (this == &other)
@@ -189,6 +345,7 @@ WeakSuperMesh & WeakSuperMesh::operator=(WeakSuperMesh &&other) noexcept {
     vertices = std::move(other.vertices);
     triangles = std::move(other.triangles);
     material = std::move(other.material);
+    topologyCache = std::move(other.topologyCache);
     return *this;
 }
 
@@ -203,89 +360,30 @@ WeakSuperMesh::WeakSuperMesh(const char *filename, const std::variant<int, std::
 }
 
 void WeakSuperMesh::addNewPolygroup(const char *filename, const std::variant<int, std::string> &id) {
-	int shift = boss->bufferLength(POSITION);
-    vertices[id] = vector<BufferedVertex>();
-    triangles[id] = vector<IndexedTriangle>();
-    vector<vec3> norms = {};
-    vector<vec2> uvs = {};
-    vector<vec3> pos = {};
-
-    // auto estimatedSizes = countEstimatedBufferSizesInOBJFile(filename);
-    // vertices[id].reserve(estimatedSizes["positions"]);
-    // triangles[id].reserve(estimatedSizes["faces"]);
-    // norms.reserve(estimatedSizes["normals"]);
-    // uvs.reserve(estimatedSizes["uvs"]);
-
-
-
-    std::ifstream in(filename, std::ios::in);
-    if (!in)
-    {
-        std::cerr << "Cannot open " << filename << std::endl;
-        exit(1);
-    }
-
-    string line;
-    while (getline(in, line))
-    {
-        if (line.substr(0,2) == "v ")
-        {
-            std::istringstream s(line.substr(2));
-            glm::vec3 vert;
-            s >> vert.x; s >> vert.y; s >> vert.z;
-            std::cout << vert.x << " " << vert.y << " " << vert.z << std::endl;
-            vertices[id].emplace_back(*boss, Vertex(vert, vec2(2137, 0), vec3(0, 0, 0), BLACK));
-            pos.push_back(vert);
-        }
-        if (line.substr(0,3) == "vt ")
-        {
-            std::istringstream s(line.substr(3));
-            glm::vec2 uv;
-            s >> uv.x; s >> uv.y;
-            uvs.push_back(uv);
-        }
-
-        if (line.substr(0,3) == "vn ")
-        {
-            std::istringstream s(line.substr(3));
-            glm::vec3 norm;
-            s >> norm.x; s >> norm.y; s >> norm.z;
-            norms.push_back(norm);
-        }
-
-        else if (line.substr(0,2) == "f ")
-        {
-            ivec3 vertexIndex, uvIndex, normalIndex;
-            sscanf(line.c_str(),"f %d/%d/%d %d/%d/%d %d/%d/%d", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-
-            vertexIndex -= ivec3(1, 1, 1);
-            uvIndex -= ivec3(1, 1, 1);
-            normalIndex -= ivec3(1, 1, 1);
-
+	addLoadedMesh(loadMesh(filename), id);
+}
 
-            vector uvsVec = { uvs.at(uvIndex[0]), uvs.at(uvIndex[1]), uvs.at(uvIndex[2]) };
-            vector normsVec = { norms.at(normalIndex[0]), norms.at(normalIndex[1]), norms.at(normalIndex[2]) };
+// vertex tuples are already deduplicated by the loader, so attributes go straight into the buffers. The LoadedMesh
+// in between is kept on purpose: the loaders also feed TriangularMesh, and missing normals are only known after all
+// faces are read, so the layout buffers would be written twice anyway.
+void WeakSuperMesh::addLoadedMesh(const LoadedMesh &mesh, const PolyGroupID &id) {
+	if (vertices.contains(id) || triangles.contains(id))
+		throw IllegalVariantError("Polygroup ID already exists in mesh. ");
 
-            for (int i = 0; i < 3; i++) {
-                if (vertices[id][vertexIndex[i]].getNormal() == vec3(0, 0, 0)) {
-                    vertices[id][vertexIndex[i]].setNormal(normsVec[i]);
-                }
-                if (vertices[id][vertexIndex[i]].getUV() == vec2(2137, 0)) {
-                    vertices[id][vertexIndex[i]].setUV(uvsVec[i]);
-                }
-            }
-            ivec3 face = ivec3(0);
-            for (int i = 0; i < 3; i++) {
-                if (vertices[id][vertexIndex[i]].getNormal() == normsVec[i] && vertices[id][vertexIndex[i]].getUV() == uvsVec[i])
-                    face[i] = vertexIndex[i];
-                else {
-                    vertices[id].emplace_back(*boss, Vertex(vertices[id][vertexIndex[i]].getPosition(), uvsVec[i], normsVec[i], BLACK));
-                    face[i] = vertices[id].size() - 1;
-                }
-            }
-            triangles[id].emplace_back(*boss, face, shift);
-        }
-    }
+	int shift = boss->bufferLength(POSITION);
+	vertices[id] = vector<BufferedVertex>();
+	triangles[id] = vector<IndexedTriangle>();
+	vertices[id].reserve(mesh.positions.size());
+	triangles[id].reserve(mesh.faces.size());
+	boss->reserveAdditionalSpace(mesh.positions.size());
+	boss->reserveAdditionalSpaceForIndex(mesh.faces.size());
+
+	for (int i = 0; i < mesh.positions.size(); i++) {
+		int index = boss->addFullVertexData(mesh.positions[i], mesh.normals[i], mesh.uvs[i], mesh.colors[i]);
+		vertices[id].emplace_back(*boss, index);
+	}
+	for (ivec3 face: mesh.faces)
+		triangles[id].emplace_back(*boss, face, shift);
 }
 
 
@@ -296,6 +394,7 @@ WeakSuperMesh & WeakSuperMesh::operator=(const WeakSuperMesh &other) {
     vertices = other.vertices;
     triangles = other.triangles;
     material = other.material;
+    topologyCache = other.topologyCache;
     return *this;
 }
 
@@ -325,7 +424,8 @@ void WeakSuperMesh::addNewPolygroup(const vector<Vertex> &hardVertices, const ve
 WeakSuperMesh::WeakSuperMesh(const WeakSuperMesh &other): boss(&*other.boss),
                                                           vertices(other.vertices),
                                                           triangles(other.triangles),
-                                                          material(other.material) {}
+                                                          material(other.material),
+                                                          topologyCache(other.topologyCache) {}
 
 
 void WeakSuperMesh::addUniformSurface(const SmoothParametricSurface &surf, int tRes, int uRes, const PolyGroupID &id) {
@@ -356,6 +456,441 @@ void WeakSuperMesh::addUniformSurface(const SmoothParametricSurface &surf, int t
     addNewPolygroup(hardVertices, faceIndices, id);
 }
 
+namespace {
+	struct AdaptiveCell {
+		int level, i, j;
+		float error;
+		bool operator<(const AdaptiveCell &other) const { return error < other.error; }
+	};
+
+	uint64_t adaptiveCellKey(int level, int i, int j) { return (uint64_t(level) << 56) | (uint64_t(i) << 28) | uint64_t(j); }
+	uint64_t adaptiveGridKey(int I, int J) { return (uint64_t(I) << 32) | uint64_t(J); }
+}
+
+// Restricted quadtree over the parameter domain: cells are split in order of decreasing error (chord distance relative
+// to the local tolerance or normal deviation relative to angleTolerance) until all are below 1 or the budget is spent.
+// Neighbouring leaves differ by at most one level, so every leaf is closed either by two triangles or by a fan around
+// its center through the midpoints shared with finer neighbours, which keeps the mesh free of T-junctions. The budget
+// counts the triangles emitted, fans included; a split whose cascade would exceed it is undone and ends the refinement
+// (the first two levels, 32 triangles, are always made). On periodic surfaces the refinement sees across the seam, so
+// both sides get the same midpoints, but as in addUniformSurface the seam vertices are duplicated (their uvs differ)
+// and not welded.
+void WeakSuperMesh::addAdaptiveSurface(const SmoothParametricSurface &surf, const Foo31 &tolerance, float angleTolerance, int triangleBudget, const PolyGroupID &id, int maxDepth) {
+	maxDepth = std::clamp(maxDepth, 2, 20);
+	int res = 1 << maxDepth;
+
+	std::unordered_map<uint64_t, pair<vec3, vec3>> samples = {};
+	auto param = [&](int I, int J) { return vec2(lerp(surf.tMin(), surf.tMax(), 1.f*I/res), lerp(surf.uMin(), surf.uMax(), 1.f*J/res)); };
+	auto sample = [&](int I, int J) -> const pair<vec3, vec3>& {
+		auto it = samples.find(adaptiveGridKey(I, J));
+		if (it == samples.end()) {
+			vec2 tu = param(I, J);
+			it = samples.emplace(adaptiveGridKey(I, J), pair(surf(tu), surf.normal(tu))).first;
+		}
+		return it->second;
+	};
+
+	auto cellError = [&](int l, int i, int j) {
+		int s = res >> l, h = s/2, I = i*s, J = j*s;
+		if (h == 0)
+			return 0.f;
+		auto [p00, n00] = sample(I, J);
+		auto [p10, n10] = sample(I+s, J);
+		auto [p01, n01] = sample(I, J+s);
+		auto [p11, n11] = sample(I+s, J+s);
+		auto [pc, nc] = sample(I+h, J+h);
+		float chord = max(norm(pc - (p00 + p10 + p01 + p11)/4.f),
+					  max(max(norm(sample(I+h, J).first - (p00 + p10)/2.f), norm(sample(I+h, J+s).first - (p01 + p11)/2.f)),
+						  max(norm(sample(I, J+h).first - (p00 + p01)/2.f), norm(sample(I+s, J+h).first - (p10 + p11)/2.f))));
+		float bend = 0;
+		for (vec3 n: {n00, n10, n01, n11})
+			bend = max(bend, std::acos(std::clamp(dot(nc, n), -1.f, 1.f)));
+		return max(chord/tolerance(pc), bend/angleTolerance);
+	};
+
+	std::unordered_map<uint64_t, bool> isLeaf = {};
+	std::priority_queue<AdaptiveCell> queue = {};
+	int leaves = 1;
+	int triangles = 2;
+	// previous state of every key touched since the last refinement step, -1 if it was absent
+	vector<pair<uint64_t, int>> journal = {};
+	auto setLeaf = [&](uint64_t key, bool leaf) {
+		auto it = isLeaf.find(key);
+		journal.emplace_back(key, it == isLeaf.end() ? -1 : it->second);
+		isLeaf[key] = leaf;
+	};
+
+	auto wrap = [&](int l, int &i, int &j) {
+		int n = 1 << l;
+		if (surf.isPeriodicT()) i = (i + n) % n;
+		if (surf.isPeriodicU()) j = (j + n) % n;
+		return i >= 0 && i < n && j >= 0 && j < n;
+	};
+	auto coarserNeighbour = [&](int l, int i, int j, ivec2 d) {
+		int ni = i + d.x, nj = j + d.y;
+		if (!wrap(l, ni, nj))
+			return ivec3(-1);
+		for (int k = l; k >= 0; k--) {
+			auto it = isLeaf.find(adaptiveCellKey(k, ni >> (l-k), nj >> (l-k)));
+			if (it != isLeaf.end() && it->second)
+				return ivec3(k, ni >> (l-k), nj >> (l-k));
+		}
+		return ivec3(-1);
+	};
+	auto finerNeighbour = [&](int l, int i, int j, ivec2 d) {
+		int ni = i + d.x, nj = j + d.y;
+		if (!wrap(l, ni, nj))
+			return false;
+		auto it = isLeaf.find(adaptiveCellKey(l, ni, nj));
+		return it != isLeaf.end() && !it->second;
+	};
+
+	const array<ivec2, 4> sides = {ivec2(0, -1), ivec2(1, 0), ivec2(0, 1), ivec2(-1, 0)};
+	// two triangles, or a fan over the corners and the midpoints of the sides with a finer neighbour
+	auto leafTriangles = [&](int l, int i, int j) {
+		int finer = 0;
+		for (ivec2 d: sides)
+			finer += finerNeighbour(l, i, j, d);
+		return finer == 0 ? 2 : 4 + finer;
+	};
+	std::function<void(int, int, int)> split = [&](int l, int i, int j) {
+		// the only leaves whose triangles change are the cell and its leaf neighbours of the same level
+		vector<ivec2> neighbours = {};
+		for (ivec2 d: sides) {
+			int ni = i + d.x, nj = j + d.y;
+			auto it = wrap(l, ni, nj) ? isLeaf.find(adaptiveCellKey(l, ni, nj)) : isLeaf.end();
+			if (it != isLeaf.end() && it->second && ivec2(ni, nj) != ivec2(i, j)
+				&& std::find(neighbours.begin(), neighbours.end(), ivec2(ni, nj)) == neighbours.end())
+				neighbours.emplace_back(ni, nj);
+		}
+		triangles -= leafTriangles(l, i, j);
+		for (ivec2 nb: neighbours)
+			triangles -= leafTriangles(l, nb.x, nb.y);
+
+		setLeaf(adaptiveCellKey(l, i, j), false);
+		leaves += 3;
+		for (int a = 0; a < 2; a++)
+			for (int b = 0; b < 2; b++) {
+				setLeaf(adaptiveCellKey(l+1, 2*i+a, 2*j+b), true);
+				queue.push({l+1, 2*i+a, 2*j+b, cellError(l+1, 2*i+a, 2*j+b)});
+			}
+		for (ivec2 nb: neighbours)
+			triangles += leafTriangles(l, nb.x, nb.y);
+		for (int a = 0; a < 2; a++)
+			for (int b = 0; b < 2; b++)
+				triangles += leafTriangles(l+1, 2*i+a, 2*j+b);
+		for (ivec2 d: sides)
+			for (ivec3 nb = coarserNeighbour(l, i, j, d); nb.x >= 0 && nb.x < l; nb = coarserNeighbour(l, i, j, d))
+				split(nb.x, nb.y, nb.z);
+	};
+
+	isLeaf[adaptiveCellKey(0, 0, 0)] = true;
+	split(0, 0, 0);
+	for (int a = 0; a < 2; a++)
+		for (int b = 0; b < 2; b++)
+			split(1, a, b);
+
+	while (!queue.empty() && triangles < triangleBudget) {
+		AdaptiveCell c = queue.top();
+		queue.pop();
+		if (c.error <= 1)
+			break;
+		if (c.level >= maxDepth || !isLeaf.at(adaptiveCellKey(c.level, c.i, c.j)))
+			continue;
+		journal.clear();
+		int trianglesBefore = triangles, leavesBefore = leaves;
+		split(c.level, c.i, c.j);
+		if (triangles <= triangleBudget)
+			continue;
+		for (auto it = journal.rbegin(); it != journal.rend(); ++it)
+			if (it->second < 0)
+				isLeaf.erase(it->first);
+			else
+				isLeaf[it->first] = it->second;
+		triangles = trianglesBefore;
+		leaves = leavesBefore;
+		break;
+	}
+
+	vector<Vertex> hardVertices = {};
+	vector<ivec3> faceIndices = {};
+	std::unordered_map<uint64_t, int> vertexIndex = {};
+	hardVertices.reserve(2*leaves);
+	faceIndices.reserve(triangles);
+	auto vertex = [&](ivec2 I) {
+		auto it = vertexIndex.find(adaptiveGridKey(I.x, I.y));
+		if (it != vertexIndex.end())
+			return it->second;
+		auto [p, n] = sample(I.x, I.y);
+		vec2 tu = param(I.x, I.y);
+		hardVertices.emplace_back(p, vec2(1.f*I.x/res, 1.f*I.y/res), n, vec4(tu.x, tu.y, 0, 1));
+		vertexIndex[adaptiveGridKey(I.x, I.y)] = hardVertices.size() - 1;
+		return static_cast<int>(hardVertices.size() - 1);
+	};
+
+	vector<uint64_t> leafKeys = {};
+	leafKeys.reserve(leaves);
+	for (const auto &[key, leaf]: isLeaf)
+		if (leaf)
+			leafKeys.push_back(key);
+	std::sort(leafKeys.begin(), leafKeys.end());
+
+	for (uint64_t key: leafKeys) {
+		int l = key >> 56, i = (key >> 28) & ((1 << 28) - 1), j = key & ((1 << 28) - 1);
+		int s = res >> l, h = s/2;
+		ivec2 c00 = ivec2(i*s, j*s);
+		array<ivec2, 4> corners = {c00, c00 + ivec2(s, 0), c00 + ivec2(s, s), c00 + ivec2(0, s)};
+		array<ivec2, 4> midpoints = {c00 + ivec2(h, 0), c00 + ivec2(s, h), c00 + ivec2(h, s), c00 + ivec2(0, h)};
+
+		vector<int> loop = {};
+		for (int k = 0; k < 4; k++) {
+			loop.push_back(vertex(corners[k]));
+			if (finerNeighbour(l, i, j, sides[k]))
+				loop.push_back(vertex(midpoints[k]));
+		}
+		if (loop.size() == 4) {
+			if (norm(sample(corners[0].x, corners[0].y).first - sample(corners[2].x, corners[2].y).first) <=
+				norm(sample(corners[1].x, corners[1].y).first - sample(corners[3].x, corners[3].y).first)) {
+				faceIndices.emplace_back(loop[0], loop[1], loop[2]);
+				faceIndices.emplace_back(loop[0], loop[2], loop[3]);
+			} else {
+				faceIndices.emplace_back(loop[0], loop[1], loop[3]);
+				faceIndices.emplace_back(loop[1], loop[2], loop[3]);
+			}
+			continue;
+		}
+		int center = vertex(c00 + ivec2(h, h));
+		for (int k = 0; k < loop.size(); k++)
+			faceIndices.emplace_back(center, loop[k], loop[(k+1) % loop.size()]);
+	}
+
+	addNewPolygroup(hardVertices, faceIndices, id);
+}
+
+// rings of radialSegments+1 vertices (seam duplicated for uvs) along rotation minimising frames, all curves in one polygroup;
+// color encodes (t, angle, curve index) analogously to addUniformSurface
+void WeakSuperMesh::addTubes(const vector<SmoothParametricCurve> &curves, const std::function<float(int, float)> &radius, int nSegments, int radialSegments, const PolyGroupID &id) {
+	if (vertices.contains(id) || triangles.contains(id))
+		throw IllegalVariantError("Polygroup ID already exists in mesh. ");
+
+	int shift = boss->bufferLength(POSITION);
+	int ringSize = radialSegments + 1;
+	int verticesPerCurve = (nSegments + 1)*ringSize;
+	int trianglesPerCurve = 2*nSegments*radialSegments;
+	vertices[id] = vector<BufferedVertex>();
+	triangles[id] = vector<IndexedTriangle>();
+	vertices[id].reserve(curves.size()*verticesPerCurve);
+	triangles[id].reserve(curves.size()*trianglesPerCurve);
+	boss->reserveAdditionalSpace(curves.size()*verticesPerCurve);
+	boss->reserveAdditionalSpaceForIndex(curves.size()*trianglesPerCurve);
+
+	vector<float> cosines = {}, sines = {};
+	for (int j = 0; j <= radialSegments; j++) {
+		cosines.push_back(cos(TAU*j/radialSegments));
+		sines.push_back(sin(TAU*j/radialSegments));
+	}
+
+	for (int c = 0; c < curves.size(); c++) {
+		const SmoothParametricCurve &curve = curves[c];
+		vector<float> params = linspace(curve.getT0(), curve.getT1(), nSegments + 1);
+		vector<mat3> frames = curve.rotationMinimisingFrames(params);
+		vector<vec3> points = {};
+		vector<float> radii = {};
+		points.reserve(nSegments + 1);
+		radii.reserve(nSegments + 1);
+		for (float t: params) {
+			points.push_back(curve(t));
+			radii.push_back(radius(c, t));
+		}
+
+		for (int i = 0; i <= nSegments; i++) {
+			int prev = std::max(i - 1, 0), next = std::min(i + 1, nSegments);
+			float ds = norm(points[next] - points[i]) + norm(points[i] - points[prev]);
+			float dr = ds > 1e-9f ? (radii[next] - radii[prev])/ds : 0;
+			for (int j = 0; j <= radialSegments; j++) {
+				vec3 dir = frames[i][1]*cosines[j] + frames[i][2]*sines[j];
+				int index = boss->addFullVertexData(points[i] + dir*radii[i], normalise(dir - frames[i][0]*dr),
+													vec2(1.f*i/nSegments, 1.f*j/radialSegments), vec4(params[i], TAU*j/radialSegments, c, 1));
+				vertices[id].emplace_back(*boss, index);
+			}
+		}
+
+		int base = c*verticesPerCurve;
+		for (int i = 0; i < nSegments; i++)
+			for (int j = 0; j < radialSegments; j++) {
+				int i00 = base + i*ringSize + j;
+				int i10 = i00 + ringSize;
+				triangles[id].emplace_back(*boss, ivec3(i00, i10, i10 + 1), shift);
+				triangles[id].emplace_back(*boss, ivec3(i00, i10 + 1, i00 + 1), shift);
+			}
+	}
+}
+
+void WeakSuperMesh::addIsosurface(const IsosurfaceMesh &mesh, const PolyGroupID &id) {
+	if (vertices.contains(id) || triangles.contains(id))
+		throw IllegalVariantError("Polygroup ID already exists in mesh. ");
+
+	int shift = boss->bufferLength(POSITION);
+	vertices[id] = vector<BufferedVertex>();
+	triangles[id] = vector<IndexedTriangle>();
+	vertices[id].reserve(mesh.positions.size());
+	triangles[id].reserve(mesh.faces.size());
+	boss->reserveAdditionalSpace(mesh.positions.size());
+	boss->reserveAdditionalSpaceForIndex(mesh.faces.size());
+
+	for (int i = 0; i < mesh.positions.size(); i++) {
+		int index = boss->addFullVertexData(mesh.positions[i], mesh.normals[i], vec2(0), BLACK);
+		vertices[id].emplace_back(*boss, index);
+	}
+	for (ivec3 face: mesh.faces)
+		triangles[id].emplace_back(*boss, face, shift);
+}
+
+namespace {
+	enum MeshCacheTag : uint32_t { CACHE_LAYOUT = 100, CACHE_POLYGROUPS = 101, CACHE_NAMES = 102 };
+
+	struct PolygroupRecord {
+		int32_t named;
+		int32_t number;
+		uint32_t nameOffset, nameLength;
+		int32_t vertexBegin, vertexCount;
+		int32_t faceBegin, faceCount;
+	};
+
+	constexpr CommonBufferType cachedBuffers[] = {POSITION, NORMAL, UV, COLOR, EXTRA0, EXTRA1, EXTRA2, EXTRA3, EXTRA4, INDEX};
+
+	template<typename T>
+	void restoreBuffer(const SectionFileView &view, BufferManager &boss, CommonBufferType type) {
+		std::span<const T> data = view.section<T>(type);
+		if (!data.empty())
+			boss.assignBuffer(type, data.data(), data.size());
+	}
+}
+
+// Buffers and polygroup ranges only, the global material is not stored. Polygroups must occupy contiguous ranges of
+// the buffers, which holds for every mesh built through addNewPolygroup and its relatives.
+void WeakSuperMesh::saveCache(const char *filename, uint64_t key) const {
+	vector<PolygroupRecord> records = {};
+	string names = {};
+	for (const auto &[id, verts]: vertices) {
+		const vector<IndexedTriangle> &trs = triangles.at(id);
+		PolygroupRecord r = {};
+		if (std::holds_alternative<string>(id)) {
+			r.named = 1;
+			r.nameOffset = names.size();
+			r.nameLength = std::get<string>(id).size();
+			names += std::get<string>(id);
+		}
+		else
+			r.number = std::get<int>(id);
+		r.vertexBegin = verts.empty() ? 0 : verts.front().getIndex();
+		r.vertexCount = verts.size();
+		r.faceBegin = trs.empty() ? 0 : trs.front().getIndex();
+		r.faceCount = trs.size();
+		for (int i = 0; i < verts.size(); i++)
+			if (verts[i].getIndex() != r.vertexBegin + i)
+				throw IllegalVariantError("Polygroup vertices are not contiguous in the buffer. ");
+		for (int i = 0; i < trs.size(); i++)
+			if (trs[i].getIndex() != r.faceBegin + i)
+				throw IllegalVariantError("Polygroup faces are not contiguous in the buffer. ");
+		records.push_back(r);
+	}
+
+	uint32_t layout = 0;
+	for (CommonBufferType type: boss->getActiveBuffers())
+		layout |= 1u << type;
+	vector<BinarySection> sections = {{CACHE_LAYOUT, sizeof(uint32_t), &layout, 1},
+									  {CACHE_POLYGROUPS, sizeof(PolygroupRecord), records.data(), records.size()},
+									  {CACHE_NAMES, 1, names.data(), names.size()}};
+	// standard attributes of any layout but SoA are gathered into contiguous float arrays, so the file does not depend on the layout
+	vector<vector<char>> gathered = {};
+	gathered.reserve(std::size(cachedBuffers));
+	for (CommonBufferType type: cachedBuffers)
+		if (boss->isActive(type) && boss->bufferLength(type) > 0) {
+			size_t element = bufferElementSize(type);
+			const void *data;
+			if (type <= COLOR && boss->getLayout() != SOA_LAYOUT) {
+				vector<char> &copy = gathered.emplace_back(boss->bufferLength(type)*element);
+				boss->gatherAttribute(type, copy.data());
+				data = copy.data();
+			}
+			else
+				data = boss->firstElementAddress(type);
+			sections.push_back({static_cast<uint32_t>(type), static_cast<uint32_t>(element), data, static_cast<uint64_t>(boss->bufferLength(type))});
+		}
+	writeSectionFile(filename, key, sections);
+}
+
+// the file is validated and mapped, each buffer is then filled by a single copy out of the mapping
+WeakSuperMesh WeakSuperMesh::loadCache(const char *filename, uint64_t key) {
+	SectionFileView view = SectionFileView(filename);
+	if (view.key() != key)
+		throw std::runtime_error(string("Cache key mismatch in ") + filename);
+	std::span<const uint32_t> layout = view.section<uint32_t>(CACHE_LAYOUT);
+	if (layout.size() != 1)
+		throw std::runtime_error(string("Cache without buffer layout: ") + filename);
+
+	std::set<CommonBufferType> active = {};
+	for (int t = POSITION; t <= EXTRA4; t++)
+		if (layout[0] & (1u << t))
+			active.insert(static_cast<CommonBufferType>(t));
+	WeakSuperMesh mesh = WeakSuperMesh();
+	mesh.boss = make_unique<BufferManager>(active);
+	for (CommonBufferType type: cachedBuffers) {
+		if (type == INDEX)
+			restoreBuffer<ivec3>(view, *mesh.boss, type);
+		else if (bufferElementLength(type) == 2)
+			restoreBuffer<vec2>(view, *mesh.boss, type);
+		else if (bufferElementLength(type) == 3)
+			restoreBuffer<vec3>(view, *mesh.boss, type);
+		else
+			restoreBuffer<vec4>(view, *mesh.boss, type);
+	}
+
+	int vertexCount = view.section<vec3>(POSITION).size();
+	int faceCount = view.section<ivec3>(INDEX).size();
+	for (CommonBufferType type: cachedBuffers)
+		if (type != INDEX && view.has(type) && mesh.boss->bufferLength(type) != vertexCount)
+			throw std::runtime_error(string("Cache buffers of different lengths in ") + filename);
+	for (ivec3 f: view.section<ivec3>(INDEX))
+		if (min(f.x, min(f.y, f.z)) < 0 || max(f.x, max(f.y, f.z)) >= vertexCount)
+			throw std::runtime_error(string("Cache face refers to a missing vertex in ") + filename);
+
+	std::span<const char> names = view.section<char>(CACHE_NAMES);
+	for (const PolygroupRecord &r: view.section<PolygroupRecord>(CACHE_POLYGROUPS)) {
+		if (r.vertexBegin < 0 || r.vertexCount < 0 || r.vertexBegin + r.vertexCount > vertexCount
+			|| r.faceBegin < 0 || r.faceCount < 0 || r.faceBegin + r.faceCount > faceCount
+			|| (r.named && uint64_t(r.nameOffset) + r.nameLength > names.size()))
+			throw std::runtime_error(string("Cache polygroup out of range in ") + filename);
+		PolyGroupID id = r.named ? PolyGroupID(string(names.data() + r.nameOffset, r.nameLength)) : PolyGroupID(r.number);
+		vector<BufferedVertex> &verts = mesh.vertices[id];
+		vector<IndexedTriangle> &trs = mesh.triangles[id];
+		verts.reserve(r.vertexCount);
+		trs.reserve(r.faceCount);
+		for (int i = 0; i < r.vertexCount; i++)
+			verts.emplace_back(*mesh.boss, r.vertexBegin + i);
+		for (int i = 0; i < r.faceCount; i++)
+			trs.emplace_back(*mesh.boss, r.faceBegin + i);
+	}
+	return mesh;
+}
+
+// generate runs when the file is missing, corrupted or was written for another key; failing to write is not fatal
+WeakSuperMesh WeakSuperMesh::cached(const char *filename, uint64_t key, const std::function<WeakSuperMesh()> &generate) {
+	try {
+		return loadCache(filename, key);
+	}
+	catch (const std::exception &) {}
+	WeakSuperMesh mesh = generate();
+	try {
+		mesh.saveCache(filename, key);
+	}
+	catch (const std::exception &e) {
+		std::cerr << "Mesh cache not written: " << e.what() << std::endl;
+	}
+	return mesh;
+}
+
 void WeakSuperMesh::merge(const WeakSuperMesh &other) {
 	for (const auto& id: other.getPolyGroupIDs())
 		addNewPolygroup(other.getVertices(id), other.getIndices(id), make_unique_id(id));
@@ -373,9 +908,79 @@ std::vector<PolyGroupID> WeakSuperMesh::getPolyGroupIDs() const {
     return ids;
 }
 
-void WeakSuperMesh::deformPerVertex(const std::variant<int, std::string> &id, const std::function<void(int, BufferedVertex &)> &deformation) {
-	for (int i=0; i<vertices.at(id).size(); i++)
-		deformation(i, vertices.at(id)[i]);
+void WeakSuperMesh::forVertexRanges(const vector<PolyGroupID> &ids, ExecutionMode mode, const std::function<void(const PolyGroupID &, int, int)> &body, const vector<CommonBufferType> &written) {
+	auto run = [&](const PolyGroupID &id, int begin, int end) {
+		auto markWritten = [&]() {
+			const vector<BufferedVertex> &verts = vertices.at(id);
+			for (CommonBufferType type: written)
+				for (int k = begin; k < end; k++)
+					boss->trackWrite(type, verts[k].getIndex(), verts[k].getIndex() + 1);
+		};
+		try {
+			body(id, begin, end);
+		}
+		catch (...) {
+			markWritten();
+			throw;
+		}
+		markWritten();
+	};
+	if (mode == SEQUENTIAL) {
+		for (const PolyGroupID &id: ids)
+			run(id, 0, vertices.at(id).size());
+		return;
+	}
+
+	// chunks record their writes on their own thread and merge them as they finish
+	std::mutex merging;
+	auto runChunk = [&](const PolyGroupID &id, int begin, int end) {
+		BufferManager::ThreadWrites chunkWrites(*boss);
+		auto merge = [&]() {
+			std::lock_guard lock(merging);
+			boss->markDirty(chunkWrites.ranges);
+		};
+		try {
+			run(id, begin, end);
+		}
+		catch (...) {
+			merge();
+			throw;
+		}
+		merge();
+	};
+	if (mode == DETERMINISTIC_PARALLEL) {
+		for (const PolyGroupID &id: ids)
+			parallelForFixed(vertices.at(id).size(), [&](int begin, int end) { runChunk(id, begin, end); });
+		return;
+	}
+	// one task per chunk of every polygroup, so that small polygroups run next to each other
+	vector<std::tuple<const PolyGroupID*, int, int>> ranges = {};
+	for (const PolyGroupID &id: ids) {
+		int n = vertices.at(id).size();
+		int chunks = chunkCount(n, 256);
+		for (int c = 0; c < chunks; c++)
+			ranges.emplace_back(&id, static_cast<long>(n)*c/chunks, static_cast<long>(n)*(c+1)/chunks);
+	}
+	parallelForChunks(ranges.size(), [&](int r) {
+		auto [id, begin, end] = ranges[r];
+		runChunk(*id, begin, end);
+	});
+}
+
+void WeakSuperMesh::deformPerVertex(const vector<PolyGroupID> &ids, const std::function<void(BufferedVertex &)> &deformation, ExecutionMode mode) {
+	forVertexRanges(ids, mode, [&](const PolyGroupID &id, int begin, int end) {
+		vector<BufferedVertex> &verts = vertices.at(id);
+		for (int i = begin; i < end; i++)
+			deformation(verts[i]);
+	}, {});
+}
+
+void WeakSuperMesh::deformPerVertex(const std::variant<int, std::string> &id, const std::function<void(int, BufferedVertex &)> &deformation, ExecutionMode mode) {
+	forVertexRanges({id}, mode, [&](const PolyGroupID &group, int begin, int end) {
+		vector<BufferedVertex> &verts = vertices.at(group);
+		for (int i = begin; i < end; i++)
+			deformation(i, verts[i]);
+	}, {});
 }
 
 vec2 WeakSuperMesh::getSurfaceParameters(const BufferedVertex &v) const { return vec2(v.getColor().x, v.getColor().y); }
@@ -389,21 +994,93 @@ void WeakSuperMesh::encodeSurfacePoint(BufferedVertex &v, const SmoothParametric
 	v.setColor(tu.y, 1);
 }
 
-void WeakSuperMesh::adjustToNewSurface(const SmoothParametricSurface &surf, const std::variant<int, std::string> &id) {
-	deformPerVertex(id, [&](BufferedVertex &v) {
-	encodeSurfacePoint(v, surf, getSurfaceParameters(v));
-}); }
+void WeakSuperMesh::adjustToNewSurface(const SmoothParametricSurface &surf, const vector<PolyGroupID> &ids, ExecutionMode mode) {
+	forVertexRanges(ids, mode, [&](const PolyGroupID &id, int begin, int end) {
+		vector<BufferedVertex> &verts = vertices.at(id);
+		for (int i = begin; i < end; i++)
+			encodeSurfacePoint(verts[i], surf, getSurfaceParameters(verts[i]));
+	}, {});
+}
+
+void WeakSuperMesh::moveAlongVectorField(const vector<PolyGroupID> &ids, const VectorFieldR3 &X, float delta, ExecutionMode mode) {
+	forVertexRanges(ids, mode, [&](const PolyGroupID &id, int begin, int end) {
+		const vector<BufferedVertex> &verts = vertices.at(id);
+		boss->visitLayout([&](auto &s) {
+			for (int k = begin; k < end; k++) {
+				int i = verts[k].getIndex();
+				s.setPosition(i, X.moveAlong(s.position(i), delta));
+			}
+		});
+	}, {POSITION});
+}
 
-void WeakSuperMesh::adjustToNewSurface(const SmoothParametricSurface &surf) { for (auto id: getPolyGroupIDs()) adjustToNewSurface(surf, id); }
+void WeakSuperMesh::deformWithAmbientMap(const vector<PolyGroupID> &ids, const SpaceEndomorphism &f, ExecutionMode mode) {
+	forVertexRanges(ids, mode, [&](const PolyGroupID &id, int begin, int end) {
+		const vector<BufferedVertex> &verts = vertices.at(id);
+		boss->visitLayout([&](auto &s) {
+			for (int k = begin; k < end; k++) {
+				int i = verts[k].getIndex();
+				vec3 p = s.position(i);
+				s.setPosition(i, f(p));
+				s.setNormal(i, normalise(f.df(p)*s.normal(i)));
+			}
+		});
+	}, {POSITION, NORMAL});
+}
 
-void WeakSuperMesh::moveAlongVectorField(const std::variant<int, std::string> &id, VectorFieldR3 X, float delta) {
-    for (BufferedVertex &v: vertices.at(id))
-        v.setPosition(X.moveAlong(v.getPosition(), delta));
+// area weighted face normals; each face is oriented by the current normal at the corner it is added to, since faces
+// need not be consistently oriented. Vertices without faces keep their normal.
+void WeakSuperMesh::recomputeNormals(const PolyGroupID &id) {
+    const vector<BufferedVertex> &verts = vertices.at(id);
+    const vector<IndexedTriangle> &tris = triangles.at(id);
+    if (verts.empty())
+        return;
+    int first = verts.front().getIndex();
+    vector<vec3> sum(verts.size(), vec3(0));
+    boss->visitLayout([&](auto &s) {
+        for (const IndexedTriangle &t: tris) {
+            ivec3 f = boss->getFaceIndices(t.getIndex());
+            vec3 fn = cross(s.position(f.y) - s.position(f.x), s.position(f.z) - s.position(f.x));
+            for (int k = 0; k < 3; k++)
+                sum[f[k] - first] += dot(fn, s.normal(f[k])) < 0 ? -fn : fn;
+        }
+        for (int i = 0; i < verts.size(); i++)
+            if (dot(sum[i], sum[i]) > 0)
+                s.setNormal(first + i, normalize(sum[i]));
+    });
+    for (const BufferedVertex &v: verts)
+        boss->markDirty(NORMAL, v.getIndex());
 }
 
-void WeakSuperMesh::deformWithAmbientMap(const std::variant<int, std::string> &id, SpaceEndomorphism f) {
-    for (BufferedVertex &v: vertices.at(id))
-        v.applyFunction(f);
+// positions are gathered, projected in parallel batches and written back; normals follow the gradient of the surface
+ProjectionStats WeakSuperMesh::projectOnSurface(const SmoothImplicitSurface &surf, const PolyGroupID &id, float level, int maxSteps, float eps, bool updateNormals) {
+	vector<BufferedVertex> &verts = vertices.at(id);
+	vector<vec3> positions = {};
+	positions.reserve(verts.size());
+	boss->visitLayout([&](const auto &s) {
+		for (const BufferedVertex &v: verts)
+			positions.push_back(s.position(v.getIndex()));
+	});
+
+	ProjectionStats stats = surf.project(positions, level, maxSteps, eps);
+	vector<vec3> normals = {};
+	if (updateNormals) {
+		normals.resize(positions.size());
+		parallelFor(positions.size(), [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				normals[i] = surf.normal(positions[i]);
+		});
+	}
+	forVertexRanges({id}, SEQUENTIAL, [&](const PolyGroupID &, int begin, int end) {
+		boss->visitLayout([&](auto &s) {
+			for (int i = begin; i < end; i++) {
+				s.setPosition(verts[i].getIndex(), positions[i]);
+				if (updateNormals)
+					s.setNormal(verts[i].getIndex(), normals[i]);
+			}
+		});
+	}, updateNormals ? vector{POSITION, NORMAL} : vector{POSITION});
+	return stats;
 }
 
 vector<Vertex> WeakSuperMesh::getVertices(const std::variant<int, std::string> &id) const {
@@ -425,12 +1102,383 @@ vector<ivec3> WeakSuperMesh::getIndices(const std::variant<int, std::string> &id
 
 
 
+MeshTopology::MeshTopology(const vector<ivec3> &faces, int vertexCount) : faces(faces), halfEdges(3*faces.size()),
+	vertexFaceStart(vertexCount + 1, 0), vertexNeighbourStart(vertexCount + 1, 0), boundary(vertexCount, 0), manifold(vertexCount, 1) {
+	auto repeated = [](ivec3 f, int k) { return (k > 0 && f[k] == f[0]) || (k == 2 && f[2] == f[1]); };
+
+	for (const ivec3 &f: faces)
+		for (int k = 0; k < 3; k++)
+			if (!repeated(f, k))
+				vertexFaceStart[f[k] + 1]++;
+	for (int v = 0; v < vertexCount; v++)
+		vertexFaceStart[v + 1] += vertexFaceStart[v];
+	vertexFaces.resize(vertexFaceStart[vertexCount]);
+	vector<int> cursor(vertexFaceStart.begin(), vertexFaceStart.end() - 1);
+	for (int f = 0; f < faces.size(); f++)
+		for (int k = 0; k < 3; k++)
+			if (!repeated(faces[f], k))
+				vertexFaces[cursor[faces[f][k]]++] = f;
+
+	// twins are paired on first match, a third face on the same edge opens it again
+	std::unordered_map<uint64_t, int> open = {};
+	open.reserve(halfEdges.size());
+	for (int h = 0; h < halfEdges.size(); h++) {
+		int a = faces[h/3][h%3], b = faces[h/3][(h+1)%3];
+		halfEdges[h] = {b, -1};
+		if (a == b)
+			continue;
+		uint64_t key = (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b));
+		auto [it, inserted] = open.try_emplace(key, h);
+		if (inserted)
+			continue;
+		halfEdges[h].twin = it->second;
+		halfEdges[it->second].twin = h;
+		open.erase(it);
+	}
+	for (int h = 0; h < halfEdges.size(); h++)
+		if (halfEdges[h].twin < 0 && source(h) != halfEdges[h].vertex)
+			boundary[source(h)] = boundary[halfEdges[h].vertex] = 1;
+
+	// fan walks give the ring in order, the others fall back to the sorted set of face corners
+	auto looseRing = [&](int v) {
+		vector<int> ring = {};
+		for (int f: facesAround(v))
+			for (int k = 0; k < 3; k++)
+				if (this->faces[f][k] != v)
+					ring.push_back(this->faces[f][k]);
+		std::sort(ring.begin(), ring.end());
+		ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+		return ring;
+	};
+	parallelFor(vertexCount, [&](int begin, int end) {
+		for (int v = begin; v < end; v++) {
+			int n = walkOneRing(v, nullptr);
+			if (n < 0) {
+				manifold[v] = 0;
+				n = looseRing(v).size();
+			}
+			vertexNeighbourStart[v + 1] = n;
+		}
+	});
+	for (int v = 0; v < vertexCount; v++)
+		vertexNeighbourStart[v + 1] += vertexNeighbourStart[v];
+	vertexNeighbours.resize(vertexNeighbourStart[vertexCount]);
+	parallelFor(vertexCount, [&](int begin, int end) {
+		for (int v = begin; v < end; v++) {
+			if (manifold[v]) {
+				walkOneRing(v, vertexNeighbours.data() + vertexNeighbourStart[v]);
+				continue;
+			}
+			vector<int> ring = looseRing(v);
+			std::copy(ring.begin(), ring.end(), vertexNeighbours.begin() + vertexNeighbourStart[v]);
+		}
+	});
+}
+
+int MeshTopology::halfEdgeBetween(int f, int a, int b) const {
+	for (int k = 0; k < 3; k++) {
+		int u = faces[f][k], w = faces[f][(k+1)%3];
+		if ((u == a && w == b) || (u == b && w == a))
+			return 3*f + k;
+	}
+	return -1;
+}
+
+// crosses from face to face over the edges at v, starting on a boundary edge if there is one;
+// returns -1 if the faces around v do not form a single disk or half-disk
+int MeshTopology::walkOneRing(int v, int *out) const {
+	std::span<const int> around = facesAround(v);
+	if (around.empty())
+		return 0;
+	auto other = [&](int f, int a) {
+		for (int k = 0; k < 3; k++)
+			if (faces[f][k] != v && faces[f][k] != a)
+				return faces[f][k];
+		return -1;
+	};
+	int start = around[0];
+	int w = other(start, -1);
+	for (int i = 0; boundary[v] && i < around.size(); i++) {
+		int h = halfEdgeBetween(around[i], v, other(around[i], -1));
+		if (h < 0 || halfEdges[h].twin >= 0)
+			h = halfEdgeBetween(around[i], v, other(around[i], other(around[i], -1)));
+		if (h >= 0 && halfEdges[h].twin < 0) {
+			start = around[i];
+			w = source(h) == v ? halfEdges[h].vertex : source(h);
+			break;
+		}
+	}
+	int count = 0, visited = 0, f = start;
+	while (true) {
+		if (out) out[count] = w;
+		count++;
+		visited++;
+		int x = other(f, w);
+		int h = x < 0 ? -1 : halfEdgeBetween(f, v, x);
+		if (h < 0 || visited > around.size())
+			return -1;
+		int t = halfEdges[h].twin;
+		if (t < 0) {
+			if (out) out[count] = x;
+			count++;
+			break;
+		}
+		f = t/3;
+		if (f == start)
+			break;
+		w = x;
+	}
+	return visited == around.size() ? count : -1;
+}
+
+
+// local indices are the buffer indices shifted by the first vertex of the polygroup; the returned pointer keeps the topology
+// alive after a concurrent invalidateTopology drops it from the cache
+std::shared_ptr<const MeshTopology> WeakSuperMesh::topology(const PolyGroupID &id) const {
+	std::lock_guard lock(topologyMutex);
+	auto it = topologyCache.find(id);
+	if (it == topologyCache.end()) {
+		const vector<BufferedVertex> &verts = vertices.at(id);
+		int base = verts.empty() ? 0 : verts.front().getIndex();
+		vector<ivec3> faces = getIndices(id);
+		for (ivec3 &f: faces)
+			f -= ivec3(base);
+		it = topologyCache.emplace(id, make_shared<const MeshTopology>(faces, verts.size())).first;
+	}
+	return it->second;
+}
+
+void WeakSuperMesh::invalidateTopology(const PolyGroupID &id) const {
+	std::lock_guard lock(topologyMutex);
+	topologyCache.erase(id);
+}
+
+vector<int> WeakSuperMesh::findNeighbours(int i, const PolyGroupID &id) const {
+	std::span<const int> ring = topology(id)->neighbours(i);
+	return vector<int>(ring.begin(), ring.end());
+}
+
+vector<int> WeakSuperMesh::findNeighboursSorted(int i, const PolyGroupID &id) const {
+	if (!topology(id)->isManifold(i))
+		throw IllegalVariantError("Neighbourhood of the vertex is not a disk, its one-ring has no cyclic order. ");
+	return findNeighbours(i, id);
+}
+
+bool WeakSuperMesh::checkIfHasCompleteNeighbourhood(int i, const PolyGroupID &id) const {
+	std::shared_ptr<const MeshTopology> top = topology(id);
+	return top->isManifold(i) && !top->isBoundary(i) && top->valence(i) > 0;
+}
+
+// cotangent discretisation with barycentric area, signed against the vertex normal; zero away from closed one-rings
+float WeakSuperMesh::meanCurvature(int i, const PolyGroupID &id) const {
+	if (!checkIfHasCompleteNeighbourhood(i, id))
+		return 0;
+	std::shared_ptr<const MeshTopology> top = topology(id);
+	const vector<BufferedVertex> &verts = vertices.at(id);
+	vec3 p = verts[i].getPosition();
+	vec3 laplace = vec3(0);
+	float area = 0;
+	for (int f: top->facesAround(i)) {
+		ivec3 tr = top->face(f);
+		int k = tr.x == i ? 0 : tr.y == i ? 1 : 2;
+		vec3 a = verts[tr[(k+1)%3]].getPosition();
+		vec3 b = verts[tr[(k+2)%3]].getPosition();
+		float doubleArea = length(cross(a - p, b - p));
+		if (doubleArea < 1e-12f)
+			continue;
+		laplace += (dot(p - b, a - b)*(a - p) + dot(p - a, b - a)*(b - p))/doubleArea;
+		area += doubleArea/6;
+	}
+	if (area < 1e-12f)
+		return 0;
+	vec3 n = verts[i].getNormal();
+	if (dot(n, n) < 1e-12f)
+		return .25f*length(laplace)/area;
+	return -.25f*dot(laplace, normalize(n))/area;
+}
+
+// backward Euler step (M + dt K) x' = M x with K the cotangent stiffness and M the lumped barycentric mass, both taken at
+// the current positions; boundary and non-manifold vertices stay fixed and are moved to the right hand side to keep the
+// system symmetric. Face normals are oriented by the old vertex normals since faces need not be consistently oriented.
+void WeakSuperMesh::meanCurvatureFlowDeform(float dt, const PolyGroupID &id) {
+	std::shared_ptr<const MeshTopology> top = topology(id);
+	vector<BufferedVertex> &verts = vertices.at(id);
+	int n = verts.size();
+	vector<vec3> x(n), b(n);
+	vector<char> fixed(n);
+	vector<int> rowStart(n + 1, 0);
+	boss->visitLayout([&](const auto &s) {
+		for (int i = 0; i < n; i++)
+			x[i] = s.position(verts[i].getIndex());
+	});
+	for (int i = 0; i < n; i++) {
+		fixed[i] = !top->isManifold(i) || top->isBoundary(i) || top->valence(i) == 0;
+		rowStart[i + 1] = rowStart[i] + 1 + top->valence(i);
+	}
+	vector<int> columns(rowStart[n]);
+	vector<float> values(rowStart[n], 0);
+
+	parallelFor(n, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			std::span<const int> ring = top->neighbours(i);
+			int row = rowStart[i];
+			columns[row] = i;
+			std::copy(ring.begin(), ring.end(), columns.begin() + row + 1);
+			if (fixed[i]) {
+				values[row] = 1;
+				b[i] = x[i];
+				continue;
+			}
+			auto entry = [&](int j) -> float& { return values[row + 1 + (std::find(ring.begin(), ring.end(), j) - ring.begin())]; };
+			float mass = 0;
+			for (int f: top->facesAround(i)) {
+				ivec3 tr = top->face(f);
+				int k = tr.x == i ? 0 : tr.y == i ? 1 : 2;
+				int a = tr[(k+1)%3], c = tr[(k+2)%3];
+				float doubleArea = length(cross(x[a] - x[i], x[c] - x[i]));
+				if (doubleArea < 1e-12f)
+					continue;
+				mass += doubleArea/6;
+				float wa = .5f*dt*std::clamp(dot(x[i] - x[c], x[a] - x[c])/doubleArea, -1e4f, 1e4f);
+				float wc = .5f*dt*std::clamp(dot(x[i] - x[a], x[c] - x[a])/doubleArea, -1e4f, 1e4f);
+				entry(a) -= wa;
+				entry(c) -= wc;
+				values[row] += wa + wc;
+			}
+			values[row] += mass;
+			b[i] = mass*x[i];
+			if (values[row] < 1e-20f) {
+				std::fill(values.begin() + row, values.begin() + rowStart[i + 1], 0.f);
+				values[row] = 1;
+				b[i] = x[i];
+				continue;
+			}
+			for (int e = row + 1; e < rowStart[i + 1]; e++)
+				if (fixed[columns[e]]) {
+					b[i] -= values[e]*x[columns[e]];
+					values[e] = 0;
+				}
+		}
+	});
+
+	conjugateGradient(CSRMatrix(std::move(rowStart), std::move(columns), std::move(values)), b, x, 200, 1e-6f);
+
+	forVertexRanges({id}, PARALLEL, [&](const PolyGroupID &, int begin, int end) {
+		boss->visitLayout([&](auto &s) {
+			for (int i = begin; i < end; i++) {
+				int v = verts[i].getIndex();
+				vec3 old = s.normal(v);
+				vec3 normal = vec3(0);
+				for (int f: top->facesAround(i)) {
+					ivec3 tr = top->face(f);
+					vec3 fn = cross(x[tr.y] - x[tr.x], x[tr.z] - x[tr.x]);
+					normal += dot(fn, old) < 0 ? -fn : fn;
+				}
+				s.setPosition(v, x[i]);
+				if (dot(normal, normal) > 1e-24f)
+					s.setNormal(v, normalize(normal));
+			}
+		});
+	}, {POSITION, NORMAL});
+}
+
 
 void WeakSuperMesh::pointNormalsInDirection(vec3 dir, const std::variant<int, std::string> &id) { deformPerVertex(id, [dir](BufferedVertex &v) {
 	vec3 n = v.getNormal();
 	v.setNormal(n*1.f*sgn(dot(n, dir)));
 }); }
 
+// A vertex merges into the first earlier kept vertex within positionTolerance whose normal, uv, colour and extras
+// agree up to attributeTolerance (max norm). Candidates come from a spatial hash of kept vertices, so the pass is linear
+// for bounded density. The buffer is compacted in place, later polygroups shift down, and faces of this polygroup that
+// collapse are dropped. Returns the number of removed vertices.
+int WeakSuperMesh::weld(const PolyGroupID &id, float positionTolerance, float attributeTolerance) {
+	const vector<BufferedVertex> &verts = vertices.at(id);
+	int n = verts.size();
+	if (n == 0)
+		return 0;
+	int base = verts.front().getIndex();
+	vector<int> slots = {};
+	for (int s = 0; s < 5; s++)
+		if (boss->isActive(static_cast<CommonBufferType>(EXTRA0 + s)))
+			slots.push_back(s);
+
+	auto close = [attributeTolerance](auto u, auto v) {
+		auto d = abs(u - v);
+		for (int k = 0; k < d.length(); k++)
+			if (d[k] > attributeTolerance)
+				return false;
+		return true;
+	};
+	vector<int> target(n);
+	SpatialHash hash = SpatialHash(std::max(positionTolerance, 1e-7f));
+	hash.reserve(n);
+	int removed = 0;
+	boss->visitLayout([&](const auto &s) {
+		auto compatible = [&](int i, int j) {
+			int u = base + i, v = base + j;
+			if (distance(s.position(u), s.position(v)) > positionTolerance || !close(s.normal(u), s.normal(v))
+				|| !close(s.uv(u), s.uv(v)) || !close(s.color(u), s.color(v)))
+				return false;
+			for (int slot: slots)
+				if (!close(boss->getExtra(u, slot), boss->getExtra(v, slot)))
+					return false;
+			return true;
+		};
+		for (int i = 0; i < n; i++) {
+			target[i] = i;
+			hash.forEachNear(s.position(base + i), positionTolerance, [&](int j) {
+				if (target[i] == i && compatible(i, j))
+					target[i] = j;
+			});
+			if (target[i] == i)
+				hash.insert(i, s.position(base + i));
+			else
+				removed++;
+		}
+	});
+	if (removed == 0)
+		return 0;
+
+	int N = boss->bufferLength(POSITION);
+	vector<int> vertexMap(N);
+	vector<char> keepVertex(N, 1);
+	for (int g = 0, next = 0; g < N; g++) {
+		bool merged = g >= base && g < base + n && target[g - base] != g - base;
+		keepVertex[g] = !merged;
+		vertexMap[g] = merged ? vertexMap[base + target[g - base]] : next++;
+	}
+	vector<char> keepFace(boss->bufferLength(INDEX), 1);
+	for (const IndexedTriangle &t: triangles.at(id)) {
+		ivec3 f = t.getVertexIndices();
+		ivec3 m = ivec3(vertexMap[f.x], vertexMap[f.y], vertexMap[f.z]);
+		keepFace[t.getIndex()] = m.x != m.y && m.y != m.z && m.z != m.x;
+	}
+	boss->compact(vertexMap, keepVertex, keepFace);
+
+	vector<int> faceMap(keepFace.size());
+	for (int i = 0, next = 0; i < keepFace.size(); i++)
+		faceMap[i] = keepFace[i] ? next++ : -1;
+	for (auto &[name, group]: vertices) {
+		vector<BufferedVertex> moved = {};
+		moved.reserve(group.size());
+		for (const BufferedVertex &v: group)
+			if (keepVertex[v.getIndex()])
+				moved.emplace_back(*boss, vertexMap[v.getIndex()]);
+		group = std::move(moved);
+	}
+	for (auto &[name, group]: triangles) {
+		vector<IndexedTriangle> moved = {};
+		moved.reserve(group.size());
+		for (const IndexedTriangle &t: group)
+			if (keepFace[t.getIndex()])
+				moved.emplace_back(*boss, faceMap[t.getIndex()]);
+		group = std::move(moved);
+	}
+	invalidateTopology(id);
+	return removed;
+}
+
 WeakSuperMesh WeakSuperMesh::subdivideBarycentric(const std::variant<int, std::string> &id) const {
     vector<ivec3> trInds = getIndices(id);
     vector<Vertex> verts = getVertices(id);
@@ -449,25 +1497,184 @@ WeakSuperMesh WeakSuperMesh::subdivideBarycentric(const std::variant<int, std::s
 }
 
 
-WeakSuperMesh WeakSuperMesh::subdivideEdgecentric(const std::variant<int, std::string> &id) const {
-    vector<ivec3> trInds = getIndices(id);
-    vector<Vertex> verts = getVertices(id);
-    verts.reserve(verts.size() + 3 * trInds.size());
-    vector<ivec3> newInds = {};
-    newInds.reserve(4 * trInds.size());
-    for (ivec3 tr: trInds) {
-        verts.push_back(center(verts[tr.x], verts[tr.y]));
-        int center1 = verts.size() - 1;
-        verts.push_back(center(verts[tr.x], verts[tr.z]));
-        int center2 = verts.size() - 1;
-        verts.push_back(center(verts[tr.y], verts[tr.z]));
-        int center3 = verts.size() - 1;
-        newInds.push_back(ivec3(tr.x, center1, center2));
-        newInds.push_back(ivec3(tr.y, center1, center3));
-        newInds.push_back(ivec3(tr.z, center2, center3));
-        newInds.push_back(ivec3(center1, center2, center3));
-    }
-    return WeakSuperMesh(verts, newInds, id);
+namespace {
+	struct SubdivisionData {
+		vector<vec3> positions, normals;
+		vector<vec2> uvs;
+		vector<vec4> colors;
+		vector<vector<vec4>> extras;
+		vector<ivec3> faces;
+
+		void resize(int n) {
+			positions.resize(n);
+			normals.resize(n);
+			uvs.resize(n);
+			colors.resize(n);
+			for (auto &e: extras)
+				e.resize(n);
+		}
+	};
+
+	// one level of midpoint or Loop subdivision; edges are numbered once through the twin table, so both faces at an
+	// edge refer to the same new vertex. Attributes other than positions are interpolated linearly in both schemes.
+	SubdivisionData subdivisionStep(const SubdivisionData &in, bool loop) {
+		const MeshTopology top = MeshTopology(in.faces, in.positions.size());
+		int V = in.positions.size();
+		vector<int> edgeOf(3*in.faces.size(), -1);
+		vector<int> edgeHalf = {};
+		edgeHalf.reserve(edgeOf.size()/2 + 1);
+		for (int h = 0; h < edgeOf.size(); h++)
+			if (edgeOf[h] < 0) {
+				edgeOf[h] = edgeHalf.size();
+				if (top.halfEdge(h).twin >= 0)
+					edgeOf[top.halfEdge(h).twin] = edgeHalf.size();
+				edgeHalf.push_back(h);
+			}
+		int E = edgeHalf.size();
+
+		SubdivisionData out = {};
+		out.extras.resize(in.extras.size());
+		out.resize(V + E);
+		out.faces.resize(4*in.faces.size());
+
+		parallelFor(V, [&](int begin, int end) {
+			for (int v = begin; v < end; v++) {
+				out.positions[v] = in.positions[v];
+				out.normals[v] = in.normals[v];
+				out.uvs[v] = in.uvs[v];
+				out.colors[v] = in.colors[v];
+				for (int s = 0; s < in.extras.size(); s++)
+					out.extras[s][v] = in.extras[s][v];
+				if (!loop || !top.isManifold(v) || top.valence(v) == 0)
+					continue;
+				std::span<const int> ring = top.neighbours(v);
+				if (top.isBoundary(v)) {
+					out.positions[v] = .75f*in.positions[v] + .125f*(in.positions[ring.front()] + in.positions[ring.back()]);
+					continue;
+				}
+				int n = ring.size();
+				float beta = n == 3 ? 3.f/16 : 3.f/(8*n);
+				vec3 sum = vec3(0);
+				for (int w: ring)
+					sum += in.positions[w];
+				out.positions[v] = (1 - n*beta)*in.positions[v] + beta*sum;
+			}
+		});
+
+		parallelFor(E, [&](int begin, int end) {
+			for (int e = begin; e < end; e++) {
+				int h = edgeHalf[e], m = V + e;
+				int a = top.source(h), b = top.halfEdge(h).vertex;
+				out.positions[m] = (in.positions[a] + in.positions[b])/2.f;
+				out.normals[m] = normalise(in.normals[a] + in.normals[b]);
+				out.uvs[m] = (in.uvs[a] + in.uvs[b])/2.f;
+				out.colors[m] = (in.colors[a] + in.colors[b])/2.f;
+				for (int s = 0; s < in.extras.size(); s++)
+					out.extras[s][m] = (in.extras[s][a] + in.extras[s][b])/2.f;
+				int t = top.halfEdge(h).twin;
+				if (loop && t >= 0) {
+					int c = top.halfEdge(top.next(h)).vertex;
+					int d = top.halfEdge(top.next(t)).vertex;
+					out.positions[m] = .375f*(in.positions[a] + in.positions[b]) + .125f*(in.positions[c] + in.positions[d]);
+				}
+			}
+		});
+
+		parallelFor(in.faces.size(), [&](int begin, int end) {
+			for (int f = begin; f < end; f++) {
+				ivec3 tr = in.faces[f];
+				int m01 = V + edgeOf[3*f], m12 = V + edgeOf[3*f + 1], m20 = V + edgeOf[3*f + 2];
+				out.faces[4*f] = ivec3(tr.x, m01, m20);
+				out.faces[4*f + 1] = ivec3(tr.y, m12, m01);
+				out.faces[4*f + 2] = ivec3(tr.z, m20, m12);
+				out.faces[4*f + 3] = ivec3(m01, m12, m20);
+			}
+		});
+		return out;
+	}
+
+	// area weighted face normals, each oriented by the interpolated normal at the corner it is added to
+	void recomputeSubdivisionNormals(SubdivisionData &data) {
+		vector<vec3> sum(data.positions.size(), vec3(0));
+		for (ivec3 tr: data.faces) {
+			vec3 fn = cross(data.positions[tr.y] - data.positions[tr.x], data.positions[tr.z] - data.positions[tr.x]);
+			for (int k = 0; k < 3; k++)
+				sum[tr[k]] += dot(fn, data.normals[tr[k]]) < 0 ? -fn : fn;
+		}
+		parallelFor(sum.size(), [&](int begin, int end) {
+			for (int v = begin; v < end; v++)
+				if (dot(sum[v], sum[v]) > 1e-24f)
+					data.normals[v] = normalize(sum[v]);
+		});
+	}
+}
+
+// every polygroup in ids is subdivided on its own and the result keeps their IDs, material and extra buffers;
+// output buffers are reserved to their exact sizes before any vertex is added
+WeakSuperMesh WeakSuperMesh::subdivided(const vector<PolyGroupID> &ids, int levels, bool loop) const {
+	vector<int> slots = {};
+	for (int s = 0; s < 5; s++)
+		if (boss->isActive(static_cast<CommonBufferType>(EXTRA0 + s)))
+			slots.push_back(s);
+
+	vector<SubdivisionData> parts = {};
+	parts.reserve(ids.size());
+	for (const PolyGroupID &id: ids) {
+		const vector<BufferedVertex> &verts = vertices.at(id);
+		SubdivisionData data = {};
+		data.extras.resize(slots.size());
+		data.resize(verts.size());
+		boss->visitLayout([&](const auto &s) {
+			for (int i = 0; i < verts.size(); i++) {
+				int v = verts[i].getIndex();
+				data.positions[i] = s.position(v);
+				data.normals[i] = s.normal(v);
+				data.uvs[i] = s.uv(v);
+				data.colors[i] = s.color(v);
+			}
+		});
+		for (int i = 0; i < verts.size(); i++)
+			for (int s = 0; s < slots.size(); s++)
+				data.extras[s][i] = verts[i].getExtra(slots[s]);
+		int base = verts.empty() ? 0 : verts.front().getIndex();
+		data.faces = getIndices(id);
+		for (ivec3 &f: data.faces)
+			f -= ivec3(base);
+		for (int l = 0; l < levels; l++)
+			data = subdivisionStep(data, loop);
+		if (loop && levels > 0)
+			recomputeSubdivisionNormals(data);
+		parts.push_back(std::move(data));
+	}
+
+	WeakSuperMesh result = WeakSuperMesh();
+	result.boss = make_unique<BufferManager>(boss->getActiveBuffers());
+	result.material = material;
+	int vertexCount = 0, faceCount = 0;
+	for (const SubdivisionData &data: parts) {
+		vertexCount += data.positions.size();
+		faceCount += data.faces.size();
+	}
+	result.boss->reserveSpace(vertexCount);
+	result.boss->reserveSpaceForIndex(faceCount);
+
+	for (int k = 0; k < ids.size(); k++) {
+		const SubdivisionData &data = parts[k];
+		int shift = result.boss->bufferLength(POSITION);
+		vector<BufferedVertex> &verts = result.vertices[ids[k]];
+		vector<IndexedTriangle> &trs = result.triangles[ids[k]];
+		verts.reserve(data.positions.size());
+		trs.reserve(data.faces.size());
+		for (int i = 0; i < data.positions.size(); i++) {
+			int index = result.boss->addFullVertexData(data.positions[i], data.normals[i], data.uvs[i], data.colors[i]);
+			for (int s = 0; s < slots.size(); s++)
+				result.boss->setExtra(index, data.extras[s][i], slots[s]);
+			verts.emplace_back(*result.boss, index);
+		}
+		for (ivec3 f: data.faces)
+			trs.emplace_back(*result.boss, f, shift);
+	}
+	return result;
 }
 
 WeakSuperMesh WeakSuperMesh::wireframe(PolyGroupID id, PolyGroupID targetId, float width, float heightCenter, float heightSide) const {
@@ -564,7 +1771,7 @@ void BufferManager::insertDefaultValueToSingleBuffer(CommonBufferType type) {
 }
 
 BufferManager::BufferManager(const BufferManager &other) :
-    stds(std::make_unique<Stds>(*other.stds)),
+    stds(other.stds),
     extra0(std::make_unique<BUFF4>(*other.extra0)),
     extra(std::make_unique<buff4x4>(*other.extra)),
     indices(std::make_unique<IBUFF3>(*other.indices)),
@@ -578,6 +1785,9 @@ BufferManager & BufferManager::operator=(BufferManager &&other) noexcept {
     extra = std::move(other.extra);
     indices = std::move(other.indices);
     activeBuffers = std::move(other.activeBuffers);
+    for (int c = 0; c < dirty.size(); c++)
+        clearDirty(c);
+    markAllDirty();
     return *this;
 }
 
@@ -586,16 +1796,21 @@ BufferManager::BufferManager(BufferManager &&other) noexcept: stds(std::move(oth
                                                               extra0(std::move(other.extra0)),
                                                               extra(std::move(other.extra)),
                                                               indices(std::move(other.indices)),
-                                                              activeBuffers(std::move(other.activeBuffers)) {}
+                                                              activeBuffers(std::move(other.activeBuffers)),
+                                                              dirty(std::move(other.dirty)),
+                                                              dirtyConsumers(std::move(other.dirtyConsumers)) {}
 
 BufferManager & BufferManager::operator=(const BufferManager &other) {
     if (this == &other)
         return *this;
-    stds = std::make_unique<Stds>(*other.stds);
+    stds = other.stds;
     extra0 = std::make_unique<BUFF4>(*other.extra0);
     extra = std::make_unique<buff4x4>(*other.extra);
     indices = std::make_unique<IBUFF3>(*other.indices);
     activeBuffers = other.activeBuffers;
+    for (int c = 0; c < dirty.size(); c++)
+        clearDirty(c);
+    markAllDirty();
     return *this;
 }
 
@@ -647,6 +1862,8 @@ glm::vec4 BufferManager::getExtra(int index, int slot) const {
 
 
 void BufferManager::setExtra(int index, glm::vec4 value, int slot) {
+    if (slot >= 0 && slot <= 4)
+        track(static_cast<CommonBufferType>(EXTRA0 + slot), index);
     switch (slot) {
         case 0:
             (*extra0)[index] = value;
@@ -672,6 +1889,8 @@ void BufferManager::setExtra(int index, glm::vec3 value, int slot) {
     setExtra(index, value.z, slot, 2);
 }
 void BufferManager::setExtra(int index, float value, int slot, int component) {
+    if (slot >= 0 && slot <= 4)
+        track(static_cast<CommonBufferType>(EXTRA0 + slot), index);
     switch (slot) {
         case 0:
             (*extra0)[index][component] = value;
@@ -694,11 +1913,95 @@ void BufferManager::setExtra(int index, float value, int slot, int component) {
     }
 }
 
+// vertices marked in keepVertex move to vertexMap[i] (which must not exceed i), the others are dropped; faces are
+// remapped through vertexMap and the kept ones are packed in order
+void BufferManager::compact(const vector<int> &vertexMap, const vector<char> &keepVertex, const vector<char> &keepFace) {
+    int kept = std::count(keepVertex.begin(), keepVertex.end(), 1);
+    auto pack = [&](auto &buffer) {
+        if (buffer.size() != vertexMap.size())
+            return;
+        for (int i = 0; i < vertexMap.size(); i++)
+            if (keepVertex[i])
+                buffer[vertexMap[i]] = buffer[i];
+        buffer.resize(kept);
+    };
+    visitLayout([&](auto &s) {
+        if (s.size() != vertexMap.size())
+            return;
+        for (int i = 0; i < vertexMap.size(); i++)
+            if (keepVertex[i])
+                s.copy(i, vertexMap[i]);
+        s.resize(kept);
+    });
+    if (extra0 != nullptr)
+        pack(*extra0);
+    if (extra != nullptr) {
+        pack(extra->a);
+        pack(extra->b);
+        pack(extra->c);
+        pack(extra->d);
+    }
+
+    int f = 0;
+    for (int i = 0; i < indices->size(); i++)
+        if (keepFace[i]) {
+            ivec3 t = (*indices)[i];
+            (*indices)[f++] = ivec3(vertexMap[t.x], vertexMap[t.y], vertexMap[t.z]);
+        }
+    indices->resize(f);
+    markAllDirty();
+}
+
+// replaces the whole buffer of the given type by count elements read from data
+void BufferManager::assignBuffer(CommonBufferType type, const void *data, int count) {
+    auto fill = [&](auto &buffer) {
+        buffer.resize(count);
+        if (count > 0)
+            std::memcpy(buffer.data(), data, count*bufferElementSize(type));
+    };
+    // standard attributes are scattered into their slots, the other attributes of new vertices are zero
+    auto scatter = [&](auto &s) {
+        if (s.size() < count)
+            s.resize(count);
+        for (int i = 0; i < count; i++)
+            switch (type) {
+                case POSITION: s.setPosition(i, static_cast<const vec3*>(data)[i]); break;
+                case NORMAL: s.setNormal(i, static_cast<const vec3*>(data)[i]); break;
+                case UV: s.setUV(i, static_cast<const vec2*>(data)[i]); break;
+                default: s.setColor(i, static_cast<const vec4*>(data)[i]);
+            }
+    };
+    if (type >= EXTRA1 && type <= EXTRA4 && extra == nullptr)
+        extra = make_unique<buff4x4>();
+    markDirty(type, 0, count);
+    switch (type) {
+        case POSITION:
+        case NORMAL:
+        case UV:
+        case COLOR:
+            visitLayout(scatter);
+            return;
+        case EXTRA0:
+            if (extra0 == nullptr)
+                extra0 = make_unique<BUFF4>();
+            fill(*extra0);
+            return;
+        case EXTRA1: fill(extra->a); return;
+        case EXTRA2: fill(extra->b); return;
+        case EXTRA3: fill(extra->c); return;
+        case EXTRA4: fill(extra->d); return;
+        case INDEX:
+            if (indices == nullptr)
+                indices = make_unique<IBUFF3>();
+            fill(*indices);
+            return;
+        default:
+            throw UnknownVariantError("Buffer not recognised among common types. ");
+    }
+}
+
 void BufferManager::reserveSpace(int targetSize) {
-    stds->positions.reserve(targetSize);
-    stds->normals.reserve(targetSize);
-    stds->uvs.reserve(targetSize);
-    stds->colors.reserve(targetSize);
+    visitLayout([targetSize](auto &s) { s.reserve(targetSize); });
 
     if (isActive(EXTRA0))
         extra0->reserve(targetSize);
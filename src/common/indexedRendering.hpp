@@ -1,9 +1,15 @@
 #pragma once
 
 #include "renderingUtils.hpp"
+#include "meshIO.hpp"
+#include "src/fundamentals/quadrature.hpp"
 // #include "src/geometry/smoothParametric.hpp"
 
+#include <cstddef>
 #include <set>
+#include <span>
+#include <mutex>
+#include <variant>
 
 
 
@@ -20,13 +26,6 @@ inline mat4 getMat(const buff4x4 &buff, int index) {
 
 
 
-struct Stds {
-    BUFF3 positions;
-    BUFF3 normals;
-    BUFF2 uvs;
-    BUFF4 colors;
-};
-
 enum CommonBufferType {
   POSITION, NORMAL, UV, COLOR, MATERIAL1, MATERIAL2, MATERIAL3, MATERIAL4, INDEX, EXTRA0, EXTRA1, EXTRA2, EXTRA3, EXTRA4
 };
@@ -38,12 +37,275 @@ inline int bufferElementLength(CommonBufferType type) { return bufferTypeLength.
 inline size_t bufferElementSize(CommonBufferType type) { return type != INDEX ? bufferElementLength(type) * sizeof(FLOAT) : bufferElementLength(type) * sizeof(GLuint); }
 
 
+// Storage of the standard attributes (position, normal, uv, colour) of a BufferManager, chosen per mesh. The layouts
+// share one interface, so loops written against it through BufferManager::visitLayout are instantiated for each
+// layout with the accessors inlined. The order matches VertexStorage.
+enum VertexLayout {
+  SOA_LAYOUT = 0,
+  AOS_LAYOUT = 1,
+  HYBRID_LAYOUT = 2,
+  QUANTIZED_LAYOUT = 3
+};
+
+// one array per attribute
+struct SoAVertices {
+    BUFF3 positions;
+    BUFF3 normals;
+    BUFF2 uvs;
+    BUFF4 colors;
+
+    size_t size() const { return positions.size(); }
+    vec3 position(int i) const { return positions[i]; }
+    vec3 normal(int i) const { return normals[i]; }
+    vec2 uv(int i) const { return uvs[i]; }
+    vec4 color(int i) const { return colors[i]; }
+    void setPosition(int i, vec3 v) { positions[i] = v; }
+    void setNormal(int i, vec3 v) { normals[i] = v; }
+    void setUV(int i, vec2 v) { uvs[i] = v; }
+    void setColor(int i, vec4 v) { colors[i] = v; }
+
+    void push_back(vec3 p, vec3 n, vec2 t, vec4 c) { positions.push_back(p); normals.push_back(n); uvs.push_back(t); colors.push_back(c); }
+    void reserve(size_t n) { positions.reserve(n); normals.reserve(n); uvs.reserve(n); colors.reserve(n); }
+    void resize(size_t n) { positions.resize(n); normals.resize(n); uvs.resize(n); colors.resize(n); }
+    void copy(int from, int to) { positions[to] = positions[from]; normals[to] = normals[from]; uvs[to] = uvs[from]; colors[to] = colors[from]; }
+
+    bool packed(CommonBufferType type) const { return false; }
+    const void* stream(CommonBufferType type) const {
+        switch (type) {
+            case NORMAL: return normals.data();
+            case UV: return uvs.data();
+            case COLOR: return colors.data();
+            default: return positions.data();
+        }
+    }
+    size_t stride(CommonBufferType type) const { return type == UV ? sizeof(vec2) : type == COLOR ? sizeof(vec4) : sizeof(vec3); }
+    size_t offset(CommonBufferType type) const { return 0; }
+};
+
+struct InterleavedVertex {
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+    vec4 color;
+};
+
+// fully interleaved, one 48-byte record per vertex
+struct AoSVertices {
+    std::vector<InterleavedVertex> records;
+
+    size_t size() const { return records.size(); }
+    vec3 position(int i) const { return records[i].position; }
+    vec3 normal(int i) const { return records[i].normal; }
+    vec2 uv(int i) const { return records[i].uv; }
+    vec4 color(int i) const { return records[i].color; }
+    void setPosition(int i, vec3 v) { records[i].position = v; }
+    void setNormal(int i, vec3 v) { records[i].normal = v; }
+    void setUV(int i, vec2 v) { records[i].uv = v; }
+    void setColor(int i, vec4 v) { records[i].color = v; }
+
+    void push_back(vec3 p, vec3 n, vec2 t, vec4 c) { records.push_back({p, n, t, c}); }
+    void reserve(size_t n) { records.reserve(n); }
+    void resize(size_t n) { records.resize(n); }
+    void copy(int from, int to) { records[to] = records[from]; }
+
+    bool packed(CommonBufferType type) const { return false; }
+    const void* stream(CommonBufferType type) const { return records.data(); }
+    size_t stride(CommonBufferType type) const { return sizeof(InterleavedVertex); }
+    size_t offset(CommonBufferType type) const {
+        switch (type) {
+            case NORMAL: return offsetof(InterleavedVertex, normal);
+            case UV: return offsetof(InterleavedVertex, uv);
+            case COLOR: return offsetof(InterleavedVertex, color);
+            default: return offsetof(InterleavedVertex, position);
+        }
+    }
+};
+
+struct HotVertex {
+    vec3 position;
+    vec3 normal;
+};
+
+struct ColdVertex {
+    vec2 uv;
+    vec4 color;
+};
+
+// positions and normals, which deformations and shading touch every frame, interleaved apart from uvs and colours
+struct HybridVertices {
+    std::vector<HotVertex> hot;
+    std::vector<ColdVertex> cold;
+
+    size_t size() const { return hot.size(); }
+    vec3 position(int i) const { return hot[i].position; }
+    vec3 normal(int i) const { return hot[i].normal; }
+    vec2 uv(int i) const { return cold[i].uv; }
+    vec4 color(int i) const { return cold[i].color; }
+    void setPosition(int i, vec3 v) { hot[i].position = v; }
+    void setNormal(int i, vec3 v) { hot[i].normal = v; }
+    void setUV(int i, vec2 v) { cold[i].uv = v; }
+    void setColor(int i, vec4 v) { cold[i].color = v; }
+
+    void push_back(vec3 p, vec3 n, vec2 t, vec4 c) { hot.push_back({p, n}); cold.push_back({t, c}); }
+    void reserve(size_t n) { hot.reserve(n); cold.reserve(n); }
+    void resize(size_t n) { hot.resize(n); cold.resize(n); }
+    void copy(int from, int to) { hot[to] = hot[from]; cold[to] = cold[from]; }
+
+    bool packed(CommonBufferType type) const { return false; }
+    const void* stream(CommonBufferType type) const { return type == UV || type == COLOR ? static_cast<const void*>(cold.data()) : static_cast<const void*>(hot.data()); }
+    size_t stride(CommonBufferType type) const { return type == UV || type == COLOR ? sizeof(ColdVertex) : sizeof(HotVertex); }
+    size_t offset(CommonBufferType type) const {
+        switch (type) {
+            case NORMAL: return offsetof(HotVertex, normal);
+            case UV: return offsetof(ColdVertex, uv);
+            case COLOR: return offsetof(ColdVertex, color);
+            default: return offsetof(HotVertex, position);
+        }
+    }
+};
+
+// Octahedral unit vector in two snorm16 components: the direction is projected on the octahedron |x|+|y|+|z| = 1
+// and its lower half folded over the diagonals. The error is below 1e-4 rad; the zero vector decodes to +z.
+inline uint32_t encodeOctahedral(vec3 n) {
+    float l1 = abs(n.x) + abs(n.y) + abs(n.z);
+    if (l1 == 0)
+        return packSnorm2x16(vec2(0));
+    vec2 p = vec2(n.x, n.y) / l1;
+    if (n.z < 0)
+        p = (1.f - abs(vec2(p.y, p.x))) * vec2(p.x >= 0 ? 1 : -1, p.y >= 0 ? 1 : -1);
+    return packSnorm2x16(p);
+}
+
+inline vec3 decodeOctahedral(uint32_t bits) {
+    vec2 p = unpackSnorm2x16(bits);
+    vec3 n = vec3(p.x, p.y, 1 - abs(p.x) - abs(p.y));
+    float t = std::max(-n.z, 0.f);
+    n.x += n.x >= 0 ? -t : t;
+    n.y += n.y >= 0 ? -t : t;
+    return normalize(n);
+}
+
+inline uint32_t encodeHalfUV(vec2 uv) { return packHalf2x16(uv); }
+inline vec2 decodeHalfUV(uint32_t bits) { return unpackHalf2x16(bits); }
+// colours are clamped to [0, 1]
+inline uint32_t encodeRGBA8(vec4 color) { return packUnorm4x8(color); }
+inline vec4 decodeRGBA8(uint32_t bits) { return unpackUnorm4x8(bits); }
+
+// which attributes QuantizedVertices keeps packed; the others are stored as floats. Colours stay floats unless asked
+// for: many meshes carry float payloads in them, e.g. surface parameters in .xy for adjustToNewSurface, which RGBA8 would
+// clamp to [0, 1] at 8 bits. Pack them only for meshes whose colours are colours.
+struct VertexQuantization {
+    bool normals = true;
+    bool uvs = true;
+    bool colors = false;
+
+    bool operator==(const VertexQuantization &other) const = default;
+};
+
+// Full precision positions and, per attribute, octahedral 2x16-bit normals, half float uvs and RGBA8 colours, each
+// 4 bytes per vertex. Values are encoded on write and decoded on read, so reading back a written value is lossy. The
+// standard attributes take 36 bytes per vertex with the default packing and 24 with colours packed, against 48 in
+// float; extra slots are not affected.
+struct QuantizedVertices {
+    VertexQuantization packing = {};
+    BUFF3 positions;
+    BUFF3 normals;
+    BUFF2 uvs;
+    BUFF4 colors;
+    std::vector<uint32_t> packedNormals;
+    std::vector<uint32_t> packedUVs;
+    std::vector<uint32_t> packedColors;
+
+    size_t size() const { return positions.size(); }
+    vec3 position(int i) const { return positions[i]; }
+    vec3 normal(int i) const { return packing.normals ? decodeOctahedral(packedNormals[i]) : normals[i]; }
+    vec2 uv(int i) const { return packing.uvs ? decodeHalfUV(packedUVs[i]) : uvs[i]; }
+    vec4 color(int i) const { return packing.colors ? decodeRGBA8(packedColors[i]) : colors[i]; }
+    void setPosition(int i, vec3 v) { positions[i] = v; }
+    void setNormal(int i, vec3 v) { if (packing.normals) packedNormals[i] = encodeOctahedral(v); else normals[i] = v; }
+    void setUV(int i, vec2 v) { if (packing.uvs) packedUVs[i] = encodeHalfUV(v); else uvs[i] = v; }
+    void setColor(int i, vec4 v) { if (packing.colors) packedColors[i] = encodeRGBA8(v); else colors[i] = v; }
+
+    void push_back(vec3 p, vec3 n, vec2 t, vec4 c) {
+        positions.push_back(p);
+        if (packing.normals) packedNormals.push_back(encodeOctahedral(n)); else normals.push_back(n);
+        if (packing.uvs) packedUVs.push_back(encodeHalfUV(t)); else uvs.push_back(t);
+        if (packing.colors) packedColors.push_back(encodeRGBA8(c)); else colors.push_back(c);
+    }
+    void reserve(size_t n) {
+        positions.reserve(n);
+        if (packing.normals) packedNormals.reserve(n); else normals.reserve(n);
+        if (packing.uvs) packedUVs.reserve(n); else uvs.reserve(n);
+        if (packing.colors) packedColors.reserve(n); else colors.reserve(n);
+    }
+    void resize(size_t n) {
+        positions.resize(n);
+        if (packing.normals) packedNormals.resize(n, encodeOctahedral(vec3(0))); else normals.resize(n);
+        if (packing.uvs) packedUVs.resize(n, encodeHalfUV(vec2(0))); else uvs.resize(n);
+        if (packing.colors) packedColors.resize(n, encodeRGBA8(vec4(0))); else colors.resize(n);
+    }
+    void copy(int from, int to) {
+        positions[to] = positions[from];
+        if (packing.normals) packedNormals[to] = packedNormals[from]; else normals[to] = normals[from];
+        if (packing.uvs) packedUVs[to] = packedUVs[from]; else uvs[to] = uvs[from];
+        if (packing.colors) packedColors[to] = packedColors[from]; else colors[to] = colors[from];
+    }
+
+    // packed attributes are streamed as stored, in the format given by BufferManager::attributeEncoding
+    bool packed(CommonBufferType type) const { return type == NORMAL ? packing.normals : type == UV ? packing.uvs : type == COLOR && packing.colors; }
+    const void* stream(CommonBufferType type) const {
+        switch (type) {
+            case NORMAL: return packing.normals ? static_cast<const void*>(packedNormals.data()) : static_cast<const void*>(normals.data());
+            case UV: return packing.uvs ? static_cast<const void*>(packedUVs.data()) : static_cast<const void*>(uvs.data());
+            case COLOR: return packing.colors ? static_cast<const void*>(packedColors.data()) : static_cast<const void*>(colors.data());
+            default: return positions.data();
+        }
+    }
+    size_t stride(CommonBufferType type) const { return packed(type) ? sizeof(uint32_t) : type == UV ? sizeof(vec2) : type == COLOR ? sizeof(vec4) : sizeof(vec3); }
+    size_t offset(CommonBufferType type) const { return 0; }
+};
+
+using VertexStorage = std::variant<SoAVertices, AoSVertices, HybridVertices, QuantizedVertices>;
+
+// how the elements of a standard attribute stream are stored, so that the renderer can choose the vertex format
+enum AttributeEncoding {
+    FLOAT_COMPONENTS,   // bufferElementLength(type) floats
+    OCTAHEDRAL_SNORM16, // two snorm16 components, see decodeOctahedral
+    HALF_FLOAT2,        // two half floats
+    UNORM8x4            // four normalised bytes
+};
+
+
+// Half-open element ranges [begin, end) kept sorted, disjoint and not touching, i.e. the minimal set of intervals
+// covering everything marked since the last clear. Marking in increasing order, as per-vertex loops do, is O(1).
+class DirtyRanges {
+    std::vector<std::pair<int, int>> intervals = {};
+
+public:
+    void mark(int index) { mark(index, index + 1); }
+    void mark(int begin, int end);
+    void clear() { intervals.clear(); }
+    bool empty() const { return intervals.empty(); }
+    bool contains(int index) const;
+    int elementCount() const;
+    const std::vector<std::pair<int, int>>& ranges() const { return intervals; }
+};
+
+using BufferRanges = std::array<DirtyRanges, EXTRA4 + 1>;
+
 class BufferManager {
-    std::unique_ptr<Stds> stds;
+    VertexStorage stds;
     std::unique_ptr<BUFF4> extra0;
     std::unique_ptr<buff4x4> extra;
     std::unique_ptr<IBUFF3> indices;
     std::set<CommonBufferType> activeBuffers;
+    // ranges per consumer and buffer; released consumers keep their slot, flagged off in dirtyConsumers, for reuse
+    std::vector<BufferRanges> dirty = {};
+    std::vector<char> dirtyConsumers = {};
+    bool trackingWrites = true;
+    // the manager and ranges of the ThreadWrites alive on the current thread, if any
+    static inline thread_local std::pair<const BufferManager*, BufferRanges*> threadWrites = {nullptr, nullptr};
+    void track(CommonBufferType type, int index) { trackWrite(type, index, index + 1); }
     void insertValueToSingleBuffer(CommonBufferType type, void *valueAddress);
     void insertDefaultValueToSingleBuffer(CommonBufferType type);
 
@@ -61,7 +323,69 @@ public:
     int bufferLength(CommonBufferType type) const;
     size_t bufferSize(CommonBufferType type) const { return bufferLength(type) * bufferElementSize(type); }
     void *firstElementAddress(CommonBufferType type) const;
+    // the block of memory holding the attribute, the distance between its consecutive elements and its offset inside
+    // an element; for the SoA layout these are firstElementAddress, bufferElementSize and 0. Packed attributes of the
+    // quantized layout are given as stored, 4 bytes per element in the format reported by attributeEncoding.
+    const void* streamAddress(CommonBufferType type) const;
+    size_t attributeStride(CommonBufferType type) const;
+    size_t attributeOffset(CommonBufferType type) const;
+    size_t streamSize(CommonBufferType type) const { return bufferLength(type) * attributeStride(type); }
+    AttributeEncoding attributeEncoding(CommonBufferType type) const;
+    // elements [begin, end) as floats, bufferElementSize(type) bytes each, written to out whatever the layout; end < 0
+    // stands for bufferLength(type)
+    void gatherAttribute(CommonBufferType type, void *out, int begin=0, int end=-1) const;
+
+    VertexLayout getLayout() const { return static_cast<VertexLayout>(stds.index()); }
+    void setLayout(VertexLayout layout, VertexQuantization quantization = {});
+    VertexQuantization getQuantization() const { return getLayout() == QUANTIZED_LAYOUT ? std::get<QuantizedVertices>(stds).packing : VertexQuantization{false, false, false}; }
+    bool isPacked(CommonBufferType type) const { return type <= COLOR && visitLayout([type](const auto &s) { return s.packed(type); }); }
+
+    // Elements written since a consumer last cleared them, per buffer. Setters and appends mark what they touch;
+    // operations that move or rewrite whole buffers mark every active buffer entirely. Every write is recorded for each
+    // consumer, e.g. each rendering step keeping its own GPU copy, so clearing what one of them uploaded does not hide
+    // the write from the others. Nothing is recorded while no consumer is registered. A copy starts without consumers,
+    // an assignment keeps those of the target and marks them entirely dirty.
+    int addDirtyConsumer(); // starts with every active buffer dirty
+    void removeDirtyConsumer(int consumer);
+    const DirtyRanges& dirtyRanges(CommonBufferType type, int consumer) const { return dirty[consumer][type]; }
+    bool isDirty(CommonBufferType type, int consumer) const { return !dirty[consumer][type].empty(); }
+    void markDirty(CommonBufferType type, int index) { markDirty(type, index, index + 1); }
+    void markDirty(CommonBufferType type, int begin, int end);
+    void markDirty(const BufferRanges &ranges);
+    void markAllDirty();
+    // what setters do: marks the elements for every consumer, or records them in the ThreadWrites of the calling thread
+    void trackWrite(CommonBufferType type, int begin, int end) {
+        if (!trackingWrites)
+            return;
+        if (threadWrites.first == this)
+            (*threadWrites.second)[type].mark(begin, end);
+        else
+            markDirty(type, begin, end);
+    }
+    void clearDirty(CommonBufferType type, int consumer) { dirty[consumer][type].clear(); }
+    void clearDirty(int consumer) { for (auto &ranges: dirty[consumer]) ranges.clear(); }
+    // setters do not mark while tracking is off. Appends and whole-buffer operations always mark.
+    void trackWrites(bool on) { trackingWrites = on; }
+    bool tracksWrites() const { return trackingWrites; }
+
+    // While alive, the writes the constructing thread makes to the manager are collected in ranges instead of being
+    // marked for the consumers, whose ranges are not safe to mark from several threads at once. The owner merges them
+    // with markDirty afterwards; forVertexRanges gives one to each parallel chunk.
+    class ThreadWrites {
+        std::pair<const BufferManager*, BufferRanges*> previous;
+    public:
+        BufferRanges ranges = {};
+        explicit ThreadWrites(const BufferManager &boss) : previous(threadWrites) { threadWrites = {&boss, &ranges}; }
+        ~ThreadWrites() { threadWrites = previous; }
+        ThreadWrites(const ThreadWrites &) = delete;
+        ThreadWrites & operator=(const ThreadWrites &) = delete;
+    };
+    template<typename F>
+    decltype(auto) visitLayout(F &&f) { return std::visit(std::forward<F>(f), stds); }
+    template<typename F>
+    decltype(auto) visitLayout(F &&f) const { return std::visit(std::forward<F>(f), stds); }
     bool isActive(CommonBufferType type) const { return activeBuffers.contains(type); }
+    const std::set<CommonBufferType>& getActiveBuffers() const { return activeBuffers; }
     bool hasMaterial() const { return isActive(MATERIAL1); }
 
     int addTriangleVertexIndices(glm::ivec3 ind, int shift = 0);
@@ -73,24 +397,26 @@ public:
 
     void reserveSpace(int targetSize);
     void reserveSpaceForIndex(int targetSize) { indices->reserve(targetSize); }
+    void compact(const std::vector<int> &vertexMap, const std::vector<char> &keepVertex, const std::vector<char> &keepFace);
+    void assignBuffer(CommonBufferType type, const void *data, int count);
     void reserveAdditionalSpace(int extraStorage) { reserveSpace(bufferLength(POSITION) + extraStorage); }
     void reserveAdditionalSpaceForIndex(int extraStorage) { reserveSpaceForIndex(bufferLength(INDEX) + extraStorage); }
     void initialiseExtraBufferSlot(int slot);
 
-    vec3 getPosition(int index) const { return stds->positions[index]; }
-    vec3 getNormal(int index) const { return stds->normals[index]; }
-    vec2 getUV(int index) const { return stds->uvs[index]; }
-    vec4 getColor(int index) const { return stds->colors[index]; }
+    vec3 getPosition(int index) const { return visitLayout([index](const auto &s) { return s.position(index); }); }
+    vec3 getNormal(int index) const { return visitLayout([index](const auto &s) { return s.normal(index); }); }
+    vec2 getUV(int index) const { return visitLayout([index](const auto &s) { return s.uv(index); }); }
+    vec4 getColor(int index) const { return visitLayout([index](const auto &s) { return s.color(index); }); }
     vec4 getExtra(int index, int slot = 1) const;
     float getExtraSlot(int index, int slot = 1, int component = 3) const { return getExtra(index, slot)[component]; }
     glm::ivec3 getFaceIndices(int index) const { return (*indices)[index]; }
     Vertex getVertex(int index) const { return Vertex(getPosition(index), getUV(index), getNormal(index), getColor(index)); }
 
-    void setPosition(int index, vec3 value) { stds->positions[index] = value; }
-    void setNormal(int index, vec3 value) { stds->normals[index] = value; }
-    void setUV(int index, vec2 value) { stds->uvs[index] = value; }
-    void setColor(int index, vec4 value) { stds->colors[index] = value; }
-    void setColor(int index, float value, int component) { stds->colors[index][component] = value; }
+    void setPosition(int index, vec3 value) { visitLayout([index, value](auto &s) { s.setPosition(index, value); }); track(POSITION, index); }
+    void setNormal(int index, vec3 value) { visitLayout([index, value](auto &s) { s.setNormal(index, value); }); track(NORMAL, index); }
+    void setUV(int index, vec2 value) { visitLayout([index, value](auto &s) { s.setUV(index, value); }); track(UV, index); }
+    void setColor(int index, vec4 value) { visitLayout([index, value](auto &s) { s.setColor(index, value); }); track(COLOR, index); }
+    void setColor(int index, float value, int component) { visitLayout([index, value, component](auto &s) { vec4 c = s.color(index); c[component] = value; s.setColor(index, c); }); track(COLOR, index); }
     void setMaterial(int index, mat4 value);
 
     void setExtra(int index, vec4 value, int slot = 1);
@@ -170,11 +496,12 @@ class IndexedTriangle {
     BufferManager &bufferBoss;
 
 public:
-//    IndexedTriangle(BufferManager &bufferBoss, int index) : index(index), bufferBoss(bufferBoss) {}
+    IndexedTriangle(BufferManager &bufferBoss, int index) : index(index), bufferBoss(bufferBoss) {}
     IndexedTriangle(const IndexedTriangle &other) : index(other.index), bufferBoss(other.bufferBoss) {}
     IndexedTriangle(IndexedTriangle &&other) noexcept : index(other.index), bufferBoss(other.bufferBoss) {}
     IndexedTriangle(BufferManager &bufferBoss, glm::ivec3 index, int shift) : index(bufferBoss.addTriangleVertexIndices(index, shift)), bufferBoss(bufferBoss) {}
 
+    int getIndex() const { return index; }
     glm::ivec3 getVertexIndices() const { return bufferBoss.getFaceIndices(index); }
     Vertex getVertex(int i) const { return bufferBoss.getVertex(getVertexIndices()[i]); }
     mat2 barMatrix() const;
@@ -191,6 +518,46 @@ public:
 
 
 
+struct HalfEdge {
+	int vertex; // target of the edge, source is the vertex of prev
+	int twin;	// -1 on the boundary
+};
+
+// Connectivity of a single polygroup in local vertex indices. Half-edge 3f+k joins corners k and k+1 of face f.
+// Twins are matched on unordered edges, since meshes here are not guaranteed to be consistently oriented.
+// One-rings are stored in fan order whenever the neighbourhood of a vertex is a disk or a half-disk.
+class MeshTopology {
+	std::vector<glm::ivec3> faces;
+	std::vector<HalfEdge> halfEdges;
+	std::vector<int> vertexFaceStart, vertexFaces;
+	std::vector<int> vertexNeighbourStart, vertexNeighbours;
+	std::vector<char> boundary, manifold;
+
+	int halfEdgeBetween(int f, int a, int b) const;
+	int walkOneRing(int v, int *out) const;
+
+public:
+	MeshTopology(const std::vector<glm::ivec3> &faces, int vertexCount);
+
+	int vertexCount() const { return boundary.size(); }
+	int faceCount() const { return faces.size(); }
+	glm::ivec3 face(int f) const { return faces[f]; }
+	const HalfEdge& halfEdge(int h) const { return halfEdges[h]; }
+	int next(int h) const { return h - h%3 + (h+1)%3; }
+	int prev(int h) const { return h - h%3 + (h+2)%3; }
+	int source(int h) const { return halfEdges[prev(h)].vertex; }
+	int faceOf(int h) const { return h/3; }
+
+	std::span<const int> facesAround(int v) const { return {vertexFaces.data() + vertexFaceStart[v], vertexFaces.data() + vertexFaceStart[v+1]}; }
+	std::span<const int> neighbours(int v) const { return {vertexNeighbours.data() + vertexNeighbourStart[v], vertexNeighbours.data() + vertexNeighbourStart[v+1]}; }
+	int valence(int v) const { return vertexNeighbourStart[v+1] - vertexNeighbourStart[v]; }
+	bool isBoundary(int v) const { return boundary[v]; }
+	bool isManifold(int v) const { return manifold[v]; }
+	bool isBoundaryEdge(int h) const { return halfEdges[h].twin < 0; }
+};
+
+
+
 class SmoothParametricSurface;
 
 class WeakSuperMesh {
@@ -199,6 +566,16 @@ protected:
   std::map<PolyGroupID, std::vector<BufferedVertex>> vertices = {};
   std::map<PolyGroupID, std::vector<IndexedTriangle>> triangles = {};
   std::shared_ptr<MaterialPhong> material = nullptr;
+  // copies share the cached entries, which is fine since a MeshTopology is never modified after construction
+  mutable std::map<PolyGroupID, std::shared_ptr<const MeshTopology>> topologyCache = {};
+  mutable std::mutex topologyMutex;
+
+  WeakSuperMesh subdivided(const std::vector<PolyGroupID> &ids, int levels, bool loop) const;
+  // Runs body(id, begin, end) over ranges of positions in vertices.at(id) for each of the polygroups, scheduled as mode
+  // says; the ranges are disjoint, so concurrent bodies never touch the same vertex. Setters mark what they write as
+  // usual, through a ThreadWrites per chunk in the parallel modes. Buffers the body writes past the setters, through
+  // visitLayout, are listed in written and marked over the vertices of each range.
+  void forVertexRanges(const std::vector<PolyGroupID> &ids, ExecutionMode mode, const std::function<void(const PolyGroupID&, int, int)> &body, const std::vector<CommonBufferType> &written);
 
 public:
 
@@ -221,6 +598,20 @@ public:
 	WeakSuperMesh(const SmoothParametricSurface &surf, int tRes, int uRes) : WeakSuperMesh(surf, tRes, uRes, randomID()	) {}
   void addUniformSurface(const SmoothParametricSurface &surf, int tRes, int uRes, const PolyGroupID &id);
 	void addUniformSurface(const SmoothParametricSurface &surf, int tRes, int uRes) {return addUniformSurface(surf, tRes, uRes, randomID());}
+  void addAdaptiveSurface(const SmoothParametricSurface &surf, const Foo31 &tolerance, float angleTolerance, int triangleBudget, const PolyGroupID &id, int maxDepth=10);
+  void addAdaptiveSurface(const SmoothParametricSurface &surf, float tolerance, float angleTolerance, int triangleBudget, const PolyGroupID &id, int maxDepth=10) { addAdaptiveSurface(surf, [tolerance](vec3) { return tolerance; }, angleTolerance, triangleBudget, id, maxDepth); }
+	void addAdaptiveSurface(const SmoothParametricSurface &surf, float tolerance, float angleTolerance=.2f, int triangleBudget=100000) { addAdaptiveSurface(surf, tolerance, angleTolerance, triangleBudget, randomID()); }
+  void addTubes(const std::vector<SmoothParametricCurve> &curves, const std::function<float(int, float)> &radius, int nSegments, int radialSegments, const PolyGroupID &id);
+  void addTubes(const std::vector<SmoothParametricCurve> &curves, float radius, int nSegments, int radialSegments, const PolyGroupID &id) { addTubes(curves, [radius](int, float) { return radius; }, nSegments, radialSegments, id); }
+  void addTube(const SmoothParametricCurve &curve, const Fooo &radius, int nSegments, int radialSegments, const PolyGroupID &id) { addTubes({curve}, [radius](int, float t) { return radius(t); }, nSegments, radialSegments, id); }
+  void addTube(const SmoothParametricCurve &curve, float radius, int nSegments, int radialSegments, const PolyGroupID &id) { addTubes({curve}, radius, nSegments, radialSegments, id); }
+  void addIsosurface(const IsosurfaceMesh &mesh, const PolyGroupID &id);
+  void addLoadedMesh(const LoadedMesh &mesh, const PolyGroupID &id);
+  void addImplicitSurface(const SmoothImplicitSurface &surf, vec3 boxMin, vec3 boxMax, ivec3 resolution, const PolyGroupID &id, bool dualContour=false) {
+	  addIsosurface(dualContour ? dualContouring(surf, boxMin, boxMax, resolution) : marchingCubes(surf, boxMin, boxMax, resolution), id); }
+  void saveCache(const char *filename, uint64_t key) const;
+  static WeakSuperMesh loadCache(const char *filename, uint64_t key);
+  static WeakSuperMesh cached(const char *filename, uint64_t key, const std::function<WeakSuperMesh()> &generate);
   void merge (const WeakSuperMesh &other);
 	void mergeAndKeepID(const WeakSuperMesh &other);
 
@@ -230,25 +621,37 @@ public:
   const void* getBufferLocation(CommonBufferType type) const { return boss->firstElementAddress(type); }
   unsigned int getBufferLength(CommonBufferType type) const { return boss->bufferLength(type); }
   size_t getBufferSize(CommonBufferType type) const { return boss->bufferSize(type); }
+  const void* getBufferStream(CommonBufferType type) const { return boss->streamAddress(type); }
+  size_t getBufferStride(CommonBufferType type) const { return boss->attributeStride(type); }
+  size_t getBufferOffset(CommonBufferType type) const { return boss->attributeOffset(type); }
+  VertexLayout getVertexLayout() const { return boss->getLayout(); }
+  void setVertexLayout(VertexLayout layout, VertexQuantization quantization = {}) { boss->setLayout(layout, quantization); }
+  void quantize(VertexQuantization quantization = {}) { setVertexLayout(QUANTIZED_LAYOUT, quantization); }
   std::vector<PolyGroupID> getPolyGroupIDs() const;
   BufferManager& getBufferBoss() const { return *boss; }
   bool isActive(CommonBufferType type) const { return boss->isActive(type); }
   bool hasGlobalTextures() const { return !isActive(MATERIAL1) && material->textured(); }
   BufferedVertex& getAnyVertexFromPolyGroup(const PolyGroupID &id) { return vertices.at(id).front(); }
 
-  void deformPerVertex(const PolyGroupID &id, const std::function<void(BufferedVertex&)> &deformation) { for (auto &v : vertices.at(id)) deformation(v);  }
-  void deformPerVertex(const std::function<void(BufferedVertex&)> &deformation) { for (auto id: getPolyGroupIDs()) for (auto &v : vertices.at(id)) deformation(v);  }
-  void deformPerVertex(const PolyGroupID &id, const std::function<void(int, BufferedVertex&)> &deformation);
+  // With a parallel ExecutionMode the callbacks run concurrently on disjoint vertices and must not write anything else.
+  void deformPerVertex(const PolyGroupID &id, const std::function<void(BufferedVertex&)> &deformation, ExecutionMode mode=SEQUENTIAL) { deformPerVertex(std::vector{id}, deformation, mode); }
+  void deformPerVertex(const std::function<void(BufferedVertex&)> &deformation, ExecutionMode mode=SEQUENTIAL) { deformPerVertex(getPolyGroupIDs(), deformation, mode); }
+  void deformPerVertex(const std::vector<PolyGroupID> &ids, const std::function<void(BufferedVertex&)> &deformation, ExecutionMode mode=SEQUENTIAL);
+  void deformPerVertex(const PolyGroupID &id, const std::function<void(int, BufferedVertex&)> &deformation, ExecutionMode mode=SEQUENTIAL);
   void deformPerId(const std::function<void(BufferedVertex&, PolyGroupID)> &deformation) { for (auto id: getPolyGroupIDs()) for (auto &v : vertices.at(id)) deformation(v, id);  }
 
   vec2 getSurfaceParameters(const BufferedVertex &v) const;
   void encodeSurfacePoint(BufferedVertex &v, const SmoothParametricSurface &surf, vec2 tu);
-  void adjustToNewSurface(const SmoothParametricSurface &surf, const PolyGroupID &id);
-  void adjustToNewSurface(const SmoothParametricSurface &surf);
-
-  void moveAlongVectorField(const PolyGroupID &id, VectorFieldR3 X, float delta=1);
-  void deformWithAmbientMap(const PolyGroupID &id, SpaceEndomorphism f);
-  void deformWithAmbientMap(const SpaceEndomorphism &f) { for (auto id: getPolyGroupIDs()) deformWithAmbientMap(id, f); }
+  void adjustToNewSurface(const SmoothParametricSurface &surf, const PolyGroupID &id, ExecutionMode mode=SEQUENTIAL) { adjustToNewSurface(surf, std::vector{id}, mode); }
+  void adjustToNewSurface(const SmoothParametricSurface &surf, ExecutionMode mode=SEQUENTIAL) { adjustToNewSurface(surf, getPolyGroupIDs(), mode); }
+  void adjustToNewSurface(const SmoothParametricSurface &surf, const std::vector<PolyGroupID> &ids, ExecutionMode mode=SEQUENTIAL);
+
+  void moveAlongVectorField(const PolyGroupID &id, VectorFieldR3 X, float delta=1, ExecutionMode mode=SEQUENTIAL) { moveAlongVectorField(std::vector{id}, X, delta, mode); }
+  void moveAlongVectorField(const std::vector<PolyGroupID> &ids, const VectorFieldR3 &X, float delta=1, ExecutionMode mode=SEQUENTIAL);
+  void deformWithAmbientMap(const PolyGroupID &id, SpaceEndomorphism f, ExecutionMode mode=SEQUENTIAL) { deformWithAmbientMap(std::vector{id}, f, mode); }
+  void deformWithAmbientMap(const std::vector<PolyGroupID> &ids, const SpaceEndomorphism &f, ExecutionMode mode=SEQUENTIAL);
+  ProjectionStats projectOnSurface(const SmoothImplicitSurface &surf, const PolyGroupID &id, float level=0, int maxSteps=20, float eps=1e-6f, bool updateNormals=true);
+  void deformWithAmbientMap(const SpaceEndomorphism &f, ExecutionMode mode=SEQUENTIAL) { deformWithAmbientMap(getPolyGroupIDs(), f, mode); }
   void initGlobalTextures() {if (hasGlobalTextures()) material->initTextures();}
 
   void affineTransform(const mat3 &M, vec3 v, const PolyGroupID &id) {deformWithAmbientMap(id, SpaceEndomorphism::affine(M, v));}
@@ -263,10 +666,19 @@ public:
   void flipNormals() { for (auto &name: getPolyGroupIDs()) flipNormals(name); }
   void pointNormalsInDirection(vec3 dir, const PolyGroupID &id);
   void pointNormalsInDirection(vec3 dir) { for (auto &name: getPolyGroupIDs()) pointNormalsInDirection(dir, name); }
+  void recomputeNormals(const PolyGroupID &id);
+  void recomputeNormals() { for (auto &name: getPolyGroupIDs()) recomputeNormals(name); }
+
+  int weld(const PolyGroupID &id, float positionTolerance=1e-5f, float attributeTolerance=1e-3f);
+  int weld(float positionTolerance=1e-5f, float attributeTolerance=1e-3f) { int removed = 0; for (auto &name: getPolyGroupIDs()) removed += weld(name, positionTolerance, attributeTolerance); return removed; }
 
 
   WeakSuperMesh subdivideBarycentric(const PolyGroupID &id) const;
-  WeakSuperMesh subdivideEdgecentric(const PolyGroupID &id) const;
+  WeakSuperMesh subdivideEdgecentric(const PolyGroupID &id) const { return subdivideMidpoint(id); }
+  WeakSuperMesh subdivideMidpoint(const PolyGroupID &id, int levels=1) const { return subdivided({id}, levels, false); }
+  WeakSuperMesh subdivideMidpoint(int levels=1) const { return subdivided(getPolyGroupIDs(), levels, false); }
+  WeakSuperMesh subdivideLoop(const PolyGroupID &id, int levels=1) const { return subdivided({id}, levels, true); }
+  WeakSuperMesh subdivideLoop(int levels=1) const { return subdivided(getPolyGroupIDs(), levels, true); }
   WeakSuperMesh wireframe(PolyGroupID id, PolyGroupID targetId, float width, float heightCenter, float heightSide) const;
 
   std::vector<Vertex> getVertices(const PolyGroupID &id) const;
@@ -276,6 +688,8 @@ public:
   vec4 getIntencities() const { return material->compressIntencities(); }
   MaterialPhong getMaterial() const { return *material; }
 
+	std::shared_ptr<const MeshTopology> topology(const PolyGroupID &id) const;
+	void invalidateTopology(const PolyGroupID &id) const;
 	vector<int> findNeighbours(int i, const PolyGroupID &id) const;
 	vector<int> findNeighboursSorted(int i, const PolyGroupID &id) const;
 	bool checkIfHasCompleteNeighbourhood(int i, const PolyGroupID &id) const;
@@ -283,7 +697,9 @@ public:
 	void meanCurvatureFlowDeform(float dt, const PolyGroupID &id);
 
     template<typename T>
-    T integrateOverTriangles(const std::function<T(const IndexedTriangle &)> &f, PolyGroupID id) const;
+    T integrateOverTriangles(const std::function<T(const IndexedTriangle &)> &f, PolyGroupID id, ExecutionMode mode=SEQUENTIAL) const;
+    template<typename T>
+    T integrateOverTriangles(const std::function<T(vec3)> &f, PolyGroupID id, int degree, ExecutionMode mode=SEQUENTIAL) const;
 
     vec3 centerOfMass(PolyGroupID id) const;
 	vec3 centerOfMass() const;
@@ -298,10 +714,35 @@ std::function<void(float, float)> deformationOperator (const std::function<void(
 std::function<void(float)> deformationOperator (const std::function<void(BufferedVertex&, float)> &deformation, WeakSuperMesh &mesh, const PolyGroupID &id);
 std::function<void(float, float)> moveAlongCurve(const SmoothParametricCurve &curve, WeakSuperMesh &mesh, const PolyGroupID &id);
 
+// f is evaluated concurrently on chunks of triangles only with a parallel mode
+template<typename T>
+T WeakSuperMesh::integrateOverTriangles(const std::function<T(const IndexedTriangle &)> &f, PolyGroupID id, ExecutionMode mode) const {
+    const std::vector<IndexedTriangle> &trs = triangles.at(id);
+    std::function<T(int)> term = [&](int i) { return f(trs[i])*trs[i].area(); };
+    if (mode != SEQUENTIAL)
+        return parallelSum<T>(trs.size(), term, T(0));
+    T sum = T(0);
+    for (int i = 0; i < trs.size(); i++)
+        sum += term(i);
+    return sum;
+}
+
+// Dunavant rule of given degree on each triangle
 template<typename T>
-T WeakSuperMesh::integrateOverTriangles(const std::function<T(const IndexedTriangle &)> &f, PolyGroupID id) const {
+T WeakSuperMesh::integrateOverTriangles(const std::function<T(vec3)> &f, PolyGroupID id, int degree, ExecutionMode mode) const {
+    const std::vector<IndexedTriangle> &trs = triangles.at(id);
+    const TriangleQuadratureRule &rule = DunavantRule(degree);
+    std::function<T(int)> term = [&](int i) {
+        mat3 P = mat3(trs[i].getVertex(0).getPosition(), trs[i].getVertex(1).getPosition(), trs[i].getVertex(2).getPosition());
+        T sum = T(0);
+        for (int k = 0; k < rule.size(); k++)
+            sum += f(P*rule.barycentric[k])*rule.weights[k];
+        return sum*trs[i].area();
+    };
+    if (mode != SEQUENTIAL)
+        return parallelSum<T>(trs.size(), term, T(0));
     T sum = T(0);
-    for (const IndexedTriangle &t: triangles.at(id))
-        sum += f(t)*t.area();
+    for (int i = 0; i < trs.size(); i++)
+        sum += term(i);
     return sum;
 }
@@ -0,0 +1,835 @@
+#include "meshIO.hpp"
+#include "src/fundamentals/parallel.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace glm;
+using std::vector, std::string;
+
+
+MappedFile::MappedFile(const char *filename) {
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error(string("Cannot open ") + filename);
+	file = handle;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(handle, &fileSize);
+	length = fileSize.QuadPart;
+	if (length == 0)
+		return;
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr)
+		bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	descriptor = open(filename, O_RDONLY);
+	if (descriptor < 0)
+		throw std::runtime_error(string("Cannot open ") + filename);
+	struct stat info;
+	fstat(descriptor, &info);
+	length = info.st_size;
+	if (length == 0)
+		return;
+	void *view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (view != MAP_FAILED) {
+		madvise(view, length, MADV_SEQUENTIAL);
+		bytes = static_cast<const char*>(view);
+	}
+#endif
+	if (bytes == nullptr) {
+		release();
+		throw std::runtime_error(string("Cannot map ") + filename);
+	}
+}
+
+void MappedFile::release() {
+#ifdef _WIN32
+	if (bytes != nullptr)
+		UnmapViewOfFile(bytes);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+	mapping = file = nullptr;
+#else
+	if (bytes != nullptr)
+		munmap(const_cast<char*>(bytes), length);
+	if (descriptor >= 0)
+		close(descriptor);
+	descriptor = -1;
+#endif
+	bytes = nullptr;
+	length = 0;
+}
+
+
+namespace {
+	bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+	bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+	const char* skipBlanks(const char *p, const char *end) {
+		while (p < end && isBlank(*p))
+			p++;
+		return p;
+	}
+
+	const char* lineEnd(const char *p, const char *end) {
+		const void *eol = std::memchr(p, '\n', end - p);
+		return eol != nullptr ? static_cast<const char*>(eol) : end;
+	}
+
+	double powerOfTen(int e) {
+		static constexpr double exact[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+										   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+		if (e >= 0 && e <= 22)
+			return exact[e];
+		if (e < 0 && e >= -22)
+			return 1/exact[-e];
+		return std::pow(10.0, e);
+	}
+}
+
+// decimal mantissa of up to 19 significant digits scaled once by a power of ten; inf and nan are read too
+const char* parseFloat(const char *p, const char *end, float &out) {
+	const char *begin = p;
+	p = skipBlanks(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	uint64_t mantissa = 0;
+	int exponent = 0, significant = 0;
+	bool anyDigit = false;
+	for (; p < end && isDigit(*p); p++) {
+		anyDigit = true;
+		if (significant < 19) {
+			mantissa = mantissa*10 + (*p - '0');
+			significant += mantissa != 0;
+		}
+		else
+			exponent++;
+	}
+	if (p < end && *p == '.')
+		for (p++; p < end && isDigit(*p); p++) {
+			anyDigit = true;
+			if (significant < 19) {
+				mantissa = mantissa*10 + (*p - '0');
+				significant += mantissa != 0;
+				exponent--;
+			}
+		}
+	if (!anyDigit) {
+		auto word = [&](const char *w) {
+			int n = std::strlen(w);
+			for (int i = 0; i < n; i++)
+				if (p + i >= end || (p[i] | 0x20) != w[i])
+					return false;
+			return true;
+		};
+		if (word("inf")) {
+			out = negative ? -INFINITY : INFINITY;
+			return p + (word("infinity") ? 8 : 3);
+		}
+		if (word("nan")) {
+			out = NAN;
+			return p + 3;
+		}
+		return begin;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+'))
+			negativeExponent = *q++ == '-';
+		if (q < end && isDigit(*q)) {
+			int e = 0;
+			for (; q < end && isDigit(*q); q++)
+				e = std::min(e*10 + (*q - '0'), 100000);
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+	double value = mantissa == 0 ? 0.0 : mantissa*powerOfTen(exponent);
+	out = static_cast<float>(negative ? -value : value);
+	return p;
+}
+
+const char* parseInt(const char *p, const char *end, int &out) {
+	const char *begin = p;
+	p = skipBlanks(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	if (p >= end || !isDigit(*p))
+		return begin;
+	int64_t value = 0;
+	for (; p < end && isDigit(*p); p++)
+		value = std::min<int64_t>(value*10 + (*p - '0'), INT_MAX);
+	out = static_cast<int>(negative ? -value : value);
+	return p;
+}
+
+
+namespace {
+	constexpr int MISSING = INT_MIN;
+
+	// corners hold position, uv and normal indices; relative marks components given by negative indices, which are
+	// stored relative to the start of the chunk until the offsets of earlier chunks are known
+	struct ObjChunk {
+		vector<vec3> positions, normals;
+		vector<vec2> uvs;
+		vector<vec4> colors;
+		vector<ivec3> corners;
+		vector<unsigned char> relative;
+		vector<int> polygonStart;
+		bool hasColors = false;
+	};
+
+	void parseObjChunk(const char *p, const char *end, ObjChunk &chunk) {
+		while (p < end) {
+			const char *line = skipBlanks(p, end);
+			const char *eol = lineEnd(line, end);
+			p = eol < end ? eol + 1 : end;
+			if (eol - line < 2)
+				continue;
+
+			if (line[0] == 'v' && isBlank(line[1])) {
+				vec3 v = vec3(0);
+				const char *q = line + 1;
+				for (int k = 0; k < 3; k++)
+					q = parseFloat(q, eol, v[k]);
+				vec3 c;
+				const char *r = q;
+				bool coloured = true;
+				for (int k = 0; k < 3 && coloured; k++) {
+					const char *s = parseFloat(r, eol, c[k]);
+					coloured = s != r;
+					r = s;
+				}
+				chunk.positions.push_back(v);
+				chunk.colors.push_back(coloured ? vec4(c, 1) : vec4(0, 0, 0, 1));
+				chunk.hasColors |= coloured;
+			}
+			else if (line[0] == 'v' && line[1] == 't' && line + 2 < eol && isBlank(line[2])) {
+				vec2 uv = vec2(0);
+				const char *q = line + 2;
+				for (int k = 0; k < 2; k++)
+					q = parseFloat(q, eol, uv[k]);
+				chunk.uvs.push_back(uv);
+			}
+			else if (line[0] == 'v' && line[1] == 'n' && line + 2 < eol && isBlank(line[2])) {
+				vec3 n = vec3(0);
+				const char *q = line + 2;
+				for (int k = 0; k < 3; k++)
+					q = parseFloat(q, eol, n[k]);
+				chunk.normals.push_back(n);
+			}
+			else if (line[0] == 'f' && isBlank(line[1])) {
+				int start = chunk.corners.size();
+				const char *q = line + 1;
+				while (true) {
+					q = skipBlanks(q, eol);
+					if (q >= eol || *q == '#')
+						break;
+					ivec3 corner = ivec3(MISSING);
+					unsigned char relative = 0;
+					for (int k = 0; k < 3; k++) {
+						if (k > 0) {
+							if (q >= eol || *q != '/')
+								break;
+							q++;
+						}
+						int value;
+						const char *r = parseInt(q, eol, value);
+						if (r == q || isBlank(*q))
+							continue;
+						q = r;
+						if (value < 0) {
+							int count = k == 0 ? chunk.positions.size() : k == 1 ? chunk.uvs.size() : chunk.normals.size();
+							corner[k] = count + value;
+							relative |= 1 << k;
+						}
+						else
+							corner[k] = value - 1;
+					}
+					while (q < eol && !isBlank(*q))
+						q++;
+					if (corner.x != MISSING) {
+						chunk.corners.push_back(corner);
+						chunk.relative.push_back(relative);
+					}
+				}
+				if (chunk.corners.size() - start >= 3)
+					chunk.polygonStart.push_back(start);
+				else {
+					chunk.corners.resize(start);
+					chunk.relative.resize(start);
+				}
+			}
+		}
+	}
+
+	// area weighted face normals for vertices flagged in missing
+	void smoothNormals(LoadedMesh &mesh, const vector<char> &missing) {
+		vector<vec3> sum(mesh.positions.size(), vec3(0));
+		for (ivec3 f: mesh.faces) {
+			vec3 n = cross(mesh.positions[f.y] - mesh.positions[f.x], mesh.positions[f.z] - mesh.positions[f.x]);
+			for (int k = 0; k < 3; k++)
+				if (missing[f[k]])
+					sum[f[k]] += n;
+		}
+		parallelFor(sum.size(), [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				if (missing[i])
+					mesh.normals[i] = dot(sum[i], sum[i]) > 1e-30f ? normalize(sum[i]) : vec3(0, 0, 1);
+		}, 4096);
+	}
+
+	// cuts [begin, end) into n pieces ending at line breaks
+	vector<const char*> splitLines(const char *begin, const char *end, int n) {
+		vector<const char*> cuts(n + 1, end);
+		cuts[0] = begin;
+		for (int k = 1; k < n; k++) {
+			const char *c = std::max(begin + (end - begin)*k/n, cuts[k - 1]);
+			const char *eol = lineEnd(c, end);
+			cuts[k] = eol < end ? eol + 1 : end;
+		}
+		return cuts;
+	}
+}
+
+
+LoadedMesh loadOBJ(const char *filename) {
+	MappedFile file = MappedFile(filename);
+	const char *begin = file.data(), *end = begin + file.size();
+	int chunks = chunkCount(static_cast<int>(std::min<size_t>(file.size(), INT_MAX)), 1 << 20);
+	vector<const char*> cuts = splitLines(begin, end, chunks);
+	vector<ObjChunk> parts(chunks);
+	parallelForChunks(chunks, [&](int k) { parseObjChunk(cuts[k], cuts[k + 1], parts[k]); });
+
+	vector<ivec3> offsets(chunks + 1, ivec3(0));
+	vector<int> cornerOffsets(chunks + 1, 0), polygonOffsets(chunks + 1, 0);
+	bool hasColors = false;
+	for (int k = 0; k < chunks; k++) {
+		offsets[k + 1] = offsets[k] + ivec3(parts[k].positions.size(), parts[k].uvs.size(), parts[k].normals.size());
+		cornerOffsets[k + 1] = cornerOffsets[k] + parts[k].corners.size();
+		polygonOffsets[k + 1] = polygonOffsets[k] + parts[k].polygonStart.size();
+		hasColors |= parts[k].hasColors;
+	}
+	ivec3 total = offsets[chunks];
+	vector<vec3> positions(total.x), normals(total.z);
+	vector<vec2> uvs(total.y);
+	vector<vec4> colors(hasColors ? total.x : 0);
+	vector<ivec3> corners(cornerOffsets[chunks]);
+	vector<int> polygonStart(polygonOffsets[chunks] + 1, cornerOffsets[chunks]);
+
+	parallelForChunks(chunks, [&](int k) {
+		ObjChunk &part = parts[k];
+		std::copy(part.positions.begin(), part.positions.end(), positions.begin() + offsets[k].x);
+		std::copy(part.uvs.begin(), part.uvs.end(), uvs.begin() + offsets[k].y);
+		std::copy(part.normals.begin(), part.normals.end(), normals.begin() + offsets[k].z);
+		if (hasColors)
+			std::copy(part.colors.begin(), part.colors.end(), colors.begin() + offsets[k].x);
+		for (int i = 0; i < part.corners.size(); i++) {
+			ivec3 c = part.corners[i];
+			for (int j = 0; j < 3; j++) {
+				if (c[j] == MISSING)
+					continue;
+				if (part.relative[i] & (1 << j))
+					c[j] += offsets[k][j];
+				if (c[j] < 0 || c[j] >= total[j])
+					throw std::runtime_error("OBJ face refers to a missing element");
+			}
+			corners[cornerOffsets[k] + i] = c;
+		}
+		for (int i = 0; i < part.polygonStart.size(); i++)
+			polygonStart[polygonOffsets[k] + i] = cornerOffsets[k] + part.polygonStart[i];
+		part = ObjChunk();
+	});
+
+	// corners sharing a position are chained from head[position], so equal tuples are found without hashing
+	LoadedMesh mesh = {};
+	mesh.hasUVs = !uvs.empty();
+	mesh.hasNormals = !normals.empty();
+	mesh.hasColors = hasColors;
+	vector<int> vertexOf(corners.size());
+	vector<int> head(total.x, -1), next = {};
+	vector<ivec2> attributes = {};
+	vector<char> missingNormal = {};
+	bool anyMissingNormal = false;
+	next.reserve(total.x);
+	attributes.reserve(total.x);
+	for (int i = 0; i < corners.size(); i++) {
+		ivec3 c = corners[i];
+		int v = head[c.x];
+		while (v >= 0 && attributes[v] != ivec2(c.y, c.z))
+			v = next[v];
+		if (v < 0) {
+			v = mesh.positions.size();
+			mesh.positions.push_back(positions[c.x]);
+			mesh.uvs.push_back(c.y != MISSING ? uvs[c.y] : vec2(0));
+			mesh.normals.push_back(c.z != MISSING ? normals[c.z] : vec3(0));
+			mesh.colors.push_back(hasColors ? colors[c.x] : vec4(0, 0, 0, 1));
+			missingNormal.push_back(c.z == MISSING);
+			anyMissingNormal |= c.z == MISSING;
+			attributes.emplace_back(c.y, c.z);
+			next.push_back(head[c.x]);
+			head[c.x] = v;
+		}
+		vertexOf[i] = v;
+	}
+
+	vector<int> faceOffsets(polygonStart.size(), 0);
+	for (int p = 0; p + 1 < polygonStart.size(); p++)
+		faceOffsets[p + 1] = faceOffsets[p] + polygonStart[p + 1] - polygonStart[p] - 2;
+	mesh.faces.resize(faceOffsets.back());
+	parallelFor(polygonStart.size() - 1, [&](int b, int e) {
+		for (int p = b; p < e; p++)
+			for (int i = polygonStart[p] + 1; i + 1 < polygonStart[p + 1]; i++)
+				mesh.faces[faceOffsets[p] + i - polygonStart[p] - 1] = ivec3(vertexOf[polygonStart[p]], vertexOf[i], vertexOf[i + 1]);
+	}, 4096);
+
+	if (anyMissingNormal)
+		smoothNormals(mesh, missingNormal);
+	return mesh;
+}
+
+
+namespace {
+	enum class PlyType { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64 };
+
+	PlyType plyType(const string &name) {
+		if (name == "char" || name == "int8") return PlyType::INT8;
+		if (name == "uchar" || name == "uint8") return PlyType::UINT8;
+		if (name == "short" || name == "int16") return PlyType::INT16;
+		if (name == "ushort" || name == "uint16") return PlyType::UINT16;
+		if (name == "int" || name == "int32") return PlyType::INT32;
+		if (name == "uint" || name == "uint32") return PlyType::UINT32;
+		if (name == "float" || name == "float32") return PlyType::FLOAT32;
+		if (name == "double" || name == "float64") return PlyType::FLOAT64;
+		throw std::runtime_error("Unknown PLY type " + name);
+	}
+
+	int plySize(PlyType t) {
+		switch (t) {
+			case PlyType::INT8: case PlyType::UINT8: return 1;
+			case PlyType::INT16: case PlyType::UINT16: return 2;
+			case PlyType::INT32: case PlyType::UINT32: case PlyType::FLOAT32: return 4;
+			case PlyType::FLOAT64: return 8;
+		}
+		return 0;
+	}
+
+	bool isIntegral(PlyType t) { return t != PlyType::FLOAT32 && t != PlyType::FLOAT64; }
+
+	template<typename T>
+	T readAs(const char *p, bool swap) {
+		char raw[sizeof(T)];
+		std::memcpy(raw, p, sizeof(T));
+		if (swap)
+			std::reverse(raw, raw + sizeof(T));
+		T value;
+		std::memcpy(&value, raw, sizeof(T));
+		return value;
+	}
+
+	double readBinary(const char *p, PlyType t, bool swap) {
+		switch (t) {
+			case PlyType::INT8: return readAs<int8_t>(p, swap);
+			case PlyType::UINT8: return readAs<uint8_t>(p, swap);
+			case PlyType::INT16: return readAs<int16_t>(p, swap);
+			case PlyType::UINT16: return readAs<uint16_t>(p, swap);
+			case PlyType::INT32: return readAs<int32_t>(p, swap);
+			case PlyType::UINT32: return readAs<uint32_t>(p, swap);
+			case PlyType::FLOAT32: return readAs<float>(p, swap);
+			case PlyType::FLOAT64: return readAs<double>(p, swap);
+		}
+		return 0;
+	}
+
+	// role is the vertex attribute slot a property feeds: 0-2 position, 3-5 normal, 6-7 uv, 8-11 colour, -1 none
+	struct PlyProperty {
+		string name;
+		PlyType type;
+		bool list = false;
+		PlyType countType = PlyType::UINT8;
+		int role = -1;
+	};
+
+	struct PlyElement {
+		string name;
+		int count;
+		vector<PlyProperty> properties;
+	};
+
+	int vertexRole(const string &name) {
+		static const std::pair<const char*, int> roles[] = {
+			{"x", 0}, {"y", 1}, {"z", 2}, {"nx", 3}, {"ny", 4}, {"nz", 5},
+			{"s", 6}, {"u", 6}, {"texture_u", 6}, {"texture_s", 6}, {"t", 7}, {"v", 7}, {"texture_v", 7}, {"texture_t", 7},
+			{"red", 8}, {"r", 8}, {"green", 9}, {"g", 9}, {"blue", 10}, {"b", 10}, {"alpha", 11}, {"a", 11}};
+		for (auto [n, role]: roles)
+			if (name == n)
+				return role;
+		return -1;
+	}
+
+	struct PlyVertexLayout {
+		bool normals = false, uvs = false, colors = false;
+		void note(int role) { normals |= role >= 3 && role < 6; uvs |= role == 6 || role == 7; colors |= role >= 8; }
+	};
+
+	void storeVertexValue(LoadedMesh &mesh, int i, const PlyProperty &prop, double value) {
+		int r = prop.role;
+		if (r < 0)
+			return;
+		if (r < 3) mesh.positions[i][r] = value;
+		else if (r < 6) mesh.normals[i][r - 3] = value;
+		else if (r < 8) mesh.uvs[i][r - 6] = value;
+		else mesh.colors[i][r - 8] = isIntegral(prop.type) ? value/255.0 : value;
+	}
+
+	void fan(const vector<int> &polygon, vector<ivec3> &faces) {
+		for (int i = 1; i + 1 < polygon.size(); i++)
+			faces.emplace_back(polygon[0], polygon[i], polygon[i + 1]);
+	}
+
+	bool isFaceList(const PlyElement &e, const PlyProperty &prop) {
+		return e.name == "face" && prop.list && (prop.name == "vertex_indices" || prop.name == "vertex_index");
+	}
+
+	// parses one ASCII element line, sending scalars to scalar(prop, value) and face lists to polygon
+	const char* parseAsciiRecord(const char *p, const char *end, const PlyElement &e, vector<int> &polygon,
+								 const std::function<void(const PlyProperty&, double)> &scalar) {
+		for (const PlyProperty &prop: e.properties) {
+			float value = 0;
+			if (!prop.list) {
+				p = parseFloat(p, end, value);
+				scalar(prop, value);
+				continue;
+			}
+			int n = 0;
+			p = parseInt(p, end, n);
+			bool face = isFaceList(e, prop);
+			if (face)
+				polygon.clear();
+			for (int j = 0; j < n; j++) {
+				int index = 0;
+				const char *q = parseInt(p, end, index);
+				if (q == p)
+					q = parseFloat(p, end, value);
+				p = q;
+				if (face)
+					polygon.push_back(index);
+			}
+		}
+		return p;
+	}
+}
+
+
+LoadedMesh loadPLY(const char *filename) {
+	MappedFile file = MappedFile(filename);
+	const char *p = file.data(), *end = p + file.size();
+
+	auto nextHeaderLine = [&] {
+		const char *eol = lineEnd(p, end);
+		string line = string(p, eol - p);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		p = eol < end ? eol + 1 : end;
+		return line;
+	};
+	if (nextHeaderLine() != "ply")
+		throw std::runtime_error(string("Not a PLY file: ") + filename);
+
+	enum { ASCII, LITTLE, BIG } format = ASCII;
+	vector<PlyElement> elements = {};
+	while (p < end) {
+		string line = nextHeaderLine();
+		vector<string> words = {};
+		for (size_t i = 0; i < line.size();) {
+			size_t j = line.find_first_of(" \t", i);
+			if (j == string::npos)
+				j = line.size();
+			if (j > i)
+				words.push_back(line.substr(i, j - i));
+			i = j + 1;
+		}
+		if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+			continue;
+		if (words[0] == "end_header")
+			break;
+		if (words[0] == "format" && words.size() > 1)
+			format = words[1] == "ascii" ? ASCII : words[1] == "binary_little_endian" ? LITTLE : BIG;
+		else if (words[0] == "element" && words.size() > 2)
+			elements.push_back({words[1], std::stoi(words[2]), {}});
+		else if (words[0] == "property" && !elements.empty()) {
+			PlyProperty prop = {};
+			if (words.size() > 4 && words[1] == "list") {
+				prop.list = true;
+				prop.countType = plyType(words[2]);
+				prop.type = plyType(words[3]);
+				prop.name = words[4];
+			}
+			else if (words.size() > 2) {
+				prop.type = plyType(words[1]);
+				prop.name = words[2];
+			}
+			if (elements.back().name == "vertex" && !prop.list)
+				prop.role = vertexRole(prop.name);
+			elements.back().properties.push_back(prop);
+		}
+	}
+
+	uint16_t probe = 1;
+	bool littleEndianHost = *reinterpret_cast<uint8_t*>(&probe) == 1;
+	bool swap = format != ASCII && (format == LITTLE) != littleEndianHost;
+
+	LoadedMesh mesh = {};
+	vector<char> missingNormal = {};
+	for (const PlyElement &e: elements) {
+		bool vertex = e.name == "vertex";
+		if (vertex) {
+			PlyVertexLayout layout = {};
+			for (const PlyProperty &prop: e.properties)
+				layout.note(prop.role);
+			mesh.positions.assign(e.count, vec3(0));
+			mesh.normals.assign(e.count, vec3(0));
+			mesh.uvs.assign(e.count, vec2(0));
+			mesh.colors.assign(e.count, vec4(0, 0, 0, 1));
+			mesh.hasNormals = layout.normals;
+			mesh.hasUVs = layout.uvs;
+			mesh.hasColors = layout.colors;
+		}
+
+		if (format == ASCII) {
+			vector<const char*> lines = {};
+			lines.reserve(e.count + 1);
+			for (int i = 0; i < e.count && p < end; i++) {
+				lines.push_back(p);
+				const char *eol = lineEnd(p, end);
+				p = eol < end ? eol + 1 : end;
+			}
+			lines.push_back(p);
+			if (lines.size() < e.count + 1)
+				throw std::runtime_error("PLY file ends before all elements are read");
+			int chunks = chunkCount(e.count, 4096);
+			vector<vector<ivec3>> faceParts(chunks);
+			parallelForChunks(chunks, [&](int c) {
+				vector<int> polygon = {};
+				for (int i = static_cast<long>(e.count)*c/chunks; i < static_cast<long>(e.count)*(c + 1)/chunks; i++) {
+					polygon.clear();
+					parseAsciiRecord(lines[i], lines[i + 1], e, polygon, [&](const PlyProperty &prop, double value) {
+						if (vertex)
+							storeVertexValue(mesh, i, prop, value);
+					});
+					fan(polygon, faceParts[c]);
+				}
+			});
+			for (const vector<ivec3> &part: faceParts)
+				mesh.faces.insert(mesh.faces.end(), part.begin(), part.end());
+			continue;
+		}
+
+		bool fixedStride = std::none_of(e.properties.begin(), e.properties.end(), [](const PlyProperty &prop) { return prop.list; });
+		if (fixedStride) {
+			int stride = 0;
+			for (const PlyProperty &prop: e.properties)
+				stride += plySize(prop.type);
+			if (end - p < static_cast<long>(stride)*e.count)
+				throw std::runtime_error("PLY file ends before all elements are read");
+			if (vertex)
+				parallelFor(e.count, [&](int b, int en) {
+					for (int i = b; i < en; i++) {
+						const char *q = p + static_cast<long>(stride)*i;
+						for (const PlyProperty &prop: e.properties) {
+							storeVertexValue(mesh, i, prop, readBinary(q, prop.type, swap));
+							q += plySize(prop.type);
+						}
+					}
+				}, 4096);
+			p += static_cast<long>(stride)*e.count;
+			continue;
+		}
+
+		vector<int> polygon = {};
+		for (int i = 0; i < e.count; i++) {
+			polygon.clear();
+			for (const PlyProperty &prop: e.properties) {
+				int n = 1;
+				if (prop.list) {
+					if (end - p < plySize(prop.countType))
+						throw std::runtime_error("PLY file ends before all elements are read");
+					n = static_cast<int>(readBinary(p, prop.countType, swap));
+					p += plySize(prop.countType);
+				}
+				if (end - p < static_cast<long>(n)*plySize(prop.type))
+					throw std::runtime_error("PLY file ends before all elements are read");
+				for (int j = 0; j < n; j++, p += plySize(prop.type)) {
+					double value = readBinary(p, prop.type, swap);
+					if (vertex && !prop.list)
+						storeVertexValue(mesh, i, prop, value);
+					if (isFaceList(e, prop))
+						polygon.push_back(static_cast<int>(value));
+				}
+			}
+			fan(polygon, mesh.faces);
+		}
+	}
+
+	for (ivec3 f: mesh.faces)
+		if (min(f.x, min(f.y, f.z)) < 0 || max(f.x, max(f.y, f.z)) >= mesh.positions.size())
+			throw std::runtime_error("PLY face refers to a missing vertex");
+	if (!mesh.hasNormals)
+		smoothNormals(mesh, vector<char>(mesh.positions.size(), 1));
+	return mesh;
+}
+
+LoadedMesh loadMesh(const char *filename) {
+	string name = filename;
+	string extension = name.substr(name.find_last_of('.') + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	return extension == "ply" ? loadPLY(filename) : loadOBJ(filename);
+}
+
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+	const char *p = static_cast<const char*>(data);
+	uint64_t h = seed;
+	size_t words = size/8;
+	for (size_t i = 0; i < words; i++) {
+		uint64_t w;
+		std::memcpy(&w, p + 8*i, 8);
+		h = (h ^ w)*1099511628211ull;
+	}
+	for (size_t i = 8*words; i < size; i++)
+		h = (h ^ static_cast<unsigned char>(p[i]))*1099511628211ull;
+	return h;
+}
+
+
+namespace {
+	constexpr char SECTION_MAGIC[8] = {'S', 'H', 'D', 'M', 'E', 'S', 'H', '\0'};
+	constexpr uint32_t SECTION_VERSION = 1;
+	constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+	struct SectionFileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t sectionCount;
+		uint64_t key;
+		uint64_t fileSize;
+		uint64_t tableChecksum;
+		char reserved[24];
+	};
+	static_assert(sizeof(SectionFileHeader) == 64);
+	static_assert(sizeof(SectionFileView::Entry) == 32);
+
+	uint64_t aligned(uint64_t offset) { return (offset + SECTION_ALIGNMENT - 1)/SECTION_ALIGNMENT*SECTION_ALIGNMENT; }
+}
+
+void writeSectionFile(const char *filename, uint64_t key, const vector<BinarySection> &sections) {
+	vector<SectionFileView::Entry> table(sections.size());
+	uint64_t offset = aligned(sizeof(SectionFileHeader) + sections.size()*sizeof(SectionFileView::Entry));
+	for (int i = 0; i < sections.size(); i++) {
+		const BinarySection &s = sections[i];
+		table[i] = {s.tag, s.elementSize, offset, s.count, 0};
+		offset = aligned(offset + s.count*s.elementSize);
+	}
+	parallelForChunks(sections.size(), [&](int i) {
+		table[i].checksum = hashBytes(sections[i].data, sections[i].count*sections[i].elementSize);
+	});
+
+	SectionFileHeader header = {};
+	std::memcpy(header.magic, SECTION_MAGIC, 8);
+	header.version = SECTION_VERSION;
+	header.sectionCount = sections.size();
+	header.key = key;
+	header.fileSize = offset;
+	header.tableChecksum = hashBytes(table.data(), table.size()*sizeof(SectionFileView::Entry));
+
+	string temporary = string(filename) + ".tmp";
+	std::FILE *out = std::fopen(temporary.c_str(), "wb");
+	if (out == nullptr)
+		throw std::runtime_error("Cannot write " + temporary);
+	static const char padding[SECTION_ALIGNMENT] = {};
+	uint64_t written = 0;
+	auto put = [&](const void *data, uint64_t size) {
+		if (size > 0 && std::fwrite(data, 1, size, out) != size) {
+			std::fclose(out);
+			std::remove(temporary.c_str());
+			throw std::runtime_error("Cannot write " + temporary);
+		}
+		written += size;
+	};
+	auto padTo = [&](uint64_t target) { put(padding, target - written); };
+
+	put(&header, sizeof(header));
+	put(table.data(), table.size()*sizeof(SectionFileView::Entry));
+	for (int i = 0; i < sections.size(); i++) {
+		padTo(table[i].offset);
+		put(sections[i].data, sections[i].count*sections[i].elementSize);
+	}
+	padTo(offset);
+	std::fclose(out);
+	std::remove(filename);
+	if (std::rename(temporary.c_str(), filename) != 0)
+		throw std::runtime_error(string("Cannot move cache into ") + filename);
+}
+
+SectionFileView::SectionFileView(const char *filename) : file(filename) {
+	if (file.size() < sizeof(SectionFileHeader))
+		throw std::runtime_error(string("Truncated section file ") + filename);
+	SectionFileHeader header;
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, SECTION_MAGIC, 8) != 0 || header.version != SECTION_VERSION)
+		throw std::runtime_error(string("Not a section file of this version: ") + filename);
+	uint64_t tableEnd = sizeof(SectionFileHeader) + uint64_t(header.sectionCount)*sizeof(Entry);
+	if (header.fileSize != file.size() || tableEnd > file.size())
+		throw std::runtime_error(string("Truncated section file ") + filename);
+
+	entries.resize(header.sectionCount);
+	std::memcpy(entries.data(), file.data() + sizeof(SectionFileHeader), entries.size()*sizeof(Entry));
+	if (hashBytes(entries.data(), entries.size()*sizeof(Entry)) != header.tableChecksum)
+		throw std::runtime_error(string("Corrupted section table in ") + filename);
+	for (const Entry &e: entries)
+		if (e.offset % SECTION_ALIGNMENT != 0 || e.offset < tableEnd || e.offset > file.size() || e.elementSize == 0
+			|| e.count > (file.size() - e.offset)/e.elementSize)
+			throw std::runtime_error(string("Section out of bounds in ") + filename);
+
+	vector<char> valid(entries.size(), 0);
+	parallelForChunks(entries.size(), [&](int i) {
+		valid[i] = hashBytes(file.data() + entries[i].offset, entries[i].count*entries[i].elementSize) == entries[i].checksum;
+	});
+	if (std::find(valid.begin(), valid.end(), 0) != valid.end())
+		throw std::runtime_error(string("Checksum mismatch in ") + filename);
+	fileKey = header.key;
+}
+
+const SectionFileView::Entry* SectionFileView::find(uint32_t tag) const {
+	for (const Entry &e: entries)
+		if (e.tag == tag)
+			return &e;
+	return nullptr;
+}
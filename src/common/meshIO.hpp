@@ -0,0 +1,154 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+// read-only view of a whole file, mapped into memory
+class MappedFile {
+	const char *bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void *file = nullptr;
+	void *mapping = nullptr;
+#else
+	int descriptor = -1;
+#endif
+	void release();
+
+public:
+	explicit MappedFile(const char *filename);
+	~MappedFile() { release(); }
+	MappedFile(const MappedFile &other) = delete;
+	MappedFile & operator=(const MappedFile &other) = delete;
+
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+};
+
+
+// triangulated mesh with one vertex per distinct attribute tuple; missing normals are smoothed from the faces
+struct LoadedMesh {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec4> colors;
+	std::vector<glm::ivec3> faces;
+	bool hasNormals = false;
+	bool hasUVs = false;
+	bool hasColors = false;
+};
+
+// parses a float starting at p (leading blanks skipped), returns the end of the number or p if there is none
+const char* parseFloat(const char *p, const char *end, float &out);
+const char* parseInt(const char *p, const char *end, int &out);
+
+// OBJ is parsed in parallel chunks of lines; faces may be polygons, with v, v/vt, v//vn or v/vt/vn corners and
+// negative (relative) indices. Vertex colours after the position are read if present.
+LoadedMesh loadOBJ(const char *filename);
+// ASCII, binary little and big endian PLY with vertex positions, normals, uvs, colours and polygonal faces
+LoadedMesh loadPLY(const char *filename);
+// dispatches on the extension
+LoadedMesh loadMesh(const char *filename);
+
+
+// FNV-1a over 8-byte words (tail bytewise); used for cache checksums and keys
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Hashes a value field by field, so padding never enters the hash. Scalars are hashed by value (with -0 as 0), glm
+// vectors and matrices and std::array by component; other types must have no padding and are hashed as bytes.
+template<typename T>
+uint64_t hashField(const T &value, uint64_t seed) {
+	if constexpr (std::is_floating_point_v<T>) {
+		T canonical = value == 0 ? T(0) : value;
+		return hashBytes(&canonical, sizeof(T), seed);
+	}
+	else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+		return hashBytes(&value, sizeof(T), seed);
+	else {
+		static_assert(std::has_unique_object_representations_v<T>, "parameterHash needs a hashField overload for types with padding or floats");
+		return hashBytes(&value, sizeof(T), seed);
+	}
+}
+
+template<glm::length_t L, typename T, glm::qualifier Q>
+uint64_t hashField(const glm::vec<L, T, Q> &value, uint64_t seed) {
+	for (glm::length_t i = 0; i < L; i++)
+		seed = hashField(value[i], seed);
+	return seed;
+}
+
+template<glm::length_t C, glm::length_t R, typename T, glm::qualifier Q>
+uint64_t hashField(const glm::mat<C, R, T, Q> &value, uint64_t seed) {
+	for (glm::length_t i = 0; i < C; i++)
+		seed = hashField(value[i], seed);
+	return seed;
+}
+
+template<typename T, size_t N>
+uint64_t hashField(const std::array<T, N> &value, uint64_t seed) {
+	for (const T &x: value)
+		seed = hashField(x, seed);
+	return seed;
+}
+
+// key of a cached object from the values it was generated from
+template<typename... Args>
+uint64_t parameterHash(const Args&... args) {
+	uint64_t h = 14695981039346656037ull;
+	((h = hashField(args, h)), ...);
+	return h;
+}
+
+// Versioned binary container: a 64-byte header, a table of tagged sections and their payloads at 64-byte aligned
+// offsets, each with its own checksum. The file is written to a temporary name and renamed into place.
+struct BinarySection {
+	uint32_t tag;
+	uint32_t elementSize;
+	const void *data;
+	uint64_t count;
+};
+
+void writeSectionFile(const char *filename, uint64_t key, const std::vector<BinarySection> &sections);
+
+// zero-copy view of a section file; the constructor checks the header, bounds and all checksums and throws on failure
+class SectionFileView {
+public:
+	struct Entry {
+		uint32_t tag;
+		uint32_t elementSize;
+		uint64_t offset;
+		uint64_t count;
+		uint64_t checksum;
+	};
+
+private:
+	MappedFile file;
+	uint64_t fileKey = 0;
+	std::vector<Entry> entries = {};
+
+	const Entry* find(uint32_t tag) const;
+
+public:
+	explicit SectionFileView(const char *filename);
+
+	uint64_t key() const { return fileKey; }
+	bool has(uint32_t tag) const { return find(tag) != nullptr; }
+
+	template<typename T>
+	std::span<const T> section(uint32_t tag) const {
+		const Entry *e = find(tag);
+		if (e == nullptr)
+			return {};
+		if (e->elementSize != sizeof(T))
+			throw std::runtime_error("Section element size does not match the requested type");
+		return {reinterpret_cast<const T*>(file.data() + e->offset), static_cast<size_t>(e->count)};
+	}
+};
@@ -13,10 +13,15 @@
 #include <random>
 #include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <bit>
+#include <cstdint>
 
 
 
 #include "renderingUtils.hpp"
+#include "meshIO.hpp"
+#include "src/fundamentals/parallel.hpp"
 
 
 using namespace glm;
@@ -227,11 +232,12 @@ TriangleR3 TriangleR3::operator+(vec3 v) const {
 
 
 
-string Vertex::hash() const {
-    return to_string(this->position.x) + to_string(this->position.y) + to_string(this->position.z) + 
-	to_string(this->normal.x) + to_string(this->normal.y) + to_string(this->normal.z) + 
-	to_string(this->uv.x) + to_string(this->uv.y) + 
-	to_string(this->color.x) + to_string(this->color.y) + to_string(this->color.z) + to_string(this->color.w);
+// FNV-1a over the bit patterns of the compared attributes, with signed zeros identified as in operator==
+size_t Vertex::hash() const {
+    uint64_t h = 1469598103934665603ull;
+    for (float f: {position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y, color.x, color.y, color.z, color.w})
+        h = (h ^ (f == 0 ? 0u : std::bit_cast<uint32_t>(f)))*1099511628211ull;
+    return h;
 }
 
 bool Vertex::operator<(const Vertex& v) const
@@ -378,108 +384,38 @@ TriangularMesh::TriangularMesh(const vector<TriangleR3> &triangles) : Triangular
 
 
 std::map<std::string, int> countEstimatedBufferSizesInOBJFile(const char *filename) {
+    MappedFile file = MappedFile(filename);
+    const char *p = file.data(), *end = p + file.size();
     int positions = 0;
     int normals = 0;
     int faces = 0;
     int uvs = 0;
-
-    FILE* file = fopen(filename, "r");
-
-    while (1) {
-        char lineHeader[1024];
-        // read the first word of the line
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-            break;
-
-        if (strcmp(lineHeader, "v") == 0)
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (end - p > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
             positions++;
-        else if (strcmp(lineHeader, "vn") == 0)
+        else if (end - p > 2 && p[0] == 'v' && p[1] == 'n')
             normals++;
-        else if (strcmp(lineHeader, "vt") == 0)
+        else if (end - p > 2 && p[0] == 'v' && p[1] == 't')
             uvs++;
-        else if (strcmp(lineHeader, "f") == 0)
+        else if (end - p > 1 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
             faces++;
+        const void *eol = memchr(p, '\n', end - p);
+        p = eol != nullptr ? static_cast<const char*>(eol) + 1 : end;
     }
-    fclose(file);
     return std::map<std::string, int> {{"positions", positions}, {"normals", normals}, {"uvs", uvs}, {"faces", faces}};
 }
 
 TriangularMesh::TriangularMesh(const char* filename, MeshFormat format) : TriangularMesh()
 {
-	if (format == 0)
-	{
-		FILE* file = fopen(filename, "r");
-		if (file == NULL) {
-			printf("Impossible to open the file !\n");
-			return;
-		}
-
-			auto pos = vector<vec3>();
-			auto norms = vector<vec3>();
-			auto uvs = vector<vec2>();
-			this->triangles = vector <TriangleR3>();
-			bool vertices_loading_started = false;
-			bool vertices_loading_ended = false;
-
-			while (1) {
-				char lineHeader[1024];
-				// read the first word of the line
-				int res = fscanf(file, "%s", lineHeader);
-				if (res == EOF)
-					break;
-
-				if (strcmp(lineHeader, "v") == 0) {
-					vec3 vertex;
-					fscanf(file, "%_f %_f %_f\n", &vertex.x, &vertex.y, &vertex.z);
-					pos.push_back(vertex);
-				}
-
-				
-				if (vertices_loading_started && !vertices_loading_ended)
-				{
-					vertices_loading_ended = true;
-					int nVertices = pos.size();
-					norms.reserve(nVertices);
-					uvs.reserve(nVertices);
-				}
-
-				else if (strcmp(lineHeader, "vt") == 0) {
-					vec2 uv;
-					fscanf(file, "%_f %_f\n", &uv.x, &uv.y);
-					uvs.push_back(uv);
-				}
-				else if (strcmp(lineHeader, "vn") == 0) {
-					vec3 normal;
-					fscanf(file, "%_f %_f %_f\n", &normal.x, &normal.y, &normal.z);
-					norms.push_back(normal);
-				}
-
-				else if (strcmp(lineHeader, "_f") == 0) {
-					ivec3 vertexIndex, uvIndex, normalIndex;
-					int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-					if (matches != 9) {
-						printf("File can't be read by our simple parser : ( Try exporting with other options\n");
-						return;
-					}
-					vertexIndex -= ivec3(1, 1, 1);
-					uvIndex -= ivec3(1, 1, 1);
-					normalIndex -= ivec3(1, 1, 1);
-
-					vector<vec2> uvsVec = { uvs.at(uvIndex[0]), uvs.at(uvIndex[1]), uvs.at(uvIndex[2]) };
-					vector<vec3> normsVec = { norms.at(normalIndex[0]), norms.at(normalIndex[1]), norms.at(normalIndex[2]) };
-					vector<vec4> colorsVec = { vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.0f, 0.0f, 0.0f, 1.0f) };
-					vector<vec3> posVec = { pos.at(vertexIndex[0]), pos.at(vertexIndex[1]), pos.at(vertexIndex[2]) };	
-
-					this->triangles.push_back(TriangleR3(posVec, normsVec, colorsVec, uvsVec));
-
-				}
-			}
-	}
-	else 
-	{
-		std::cout << "Format not supported" << std::endl;
-	}
+	LoadedMesh mesh = format == PLY ? loadPLY(filename) : loadOBJ(filename);
+	this->triangles.reserve(mesh.faces.size());
+	for (ivec3 f: mesh.faces)
+		this->triangles.emplace_back(vector<vec3>{mesh.positions[f.x], mesh.positions[f.y], mesh.positions[f.z]},
+									 vector<vec3>{mesh.normals[f.x], mesh.normals[f.y], mesh.normals[f.z]},
+									 vector<vec4>{mesh.colors[f.x], mesh.colors[f.y], mesh.colors[f.z]},
+									 vector<vec2>{mesh.uvs[f.x], mesh.uvs[f.y], mesh.uvs[f.z]});
 }
 
 TriangularMesh::TriangularMesh(ComplexCurve* curve, int nSegments, float h_middle, float w_middle, float w_side)
@@ -947,15 +883,23 @@ array<TriangleComplex, 3> TriangleComplex::subdivide() const {
 			TriangleComplex({vertices[2], vertices[0], center},	{vertexColors[2], vertexColors[0], centerColor}, {uvs[2], uvs[0], centerUV})};
 }
 
+// chunks are subdivided in parallel and concatenated in order
 vector<TriangleComplex> TriangleComplex::subdivideTriangulation(const vector<TriangleComplex> &triangles) {
+	int n = triangles.size();
+	int chunks = chunkCount(n, 1024);
+	vector<vector<TriangleComplex>> parts = vector<vector<TriangleComplex>>(chunks);
+	parallelForChunks(chunks, [&](int c) {
+		int begin = static_cast<long>(n)*c/chunks, end = static_cast<long>(n)*(c + 1)/chunks;
+		parts[c].reserve(3*(end - begin));
+		for (int i = begin; i < end; i++) {
+			auto subTriangles = triangles[i].subdivide();
+			parts[c].insert(parts[c].end(), subTriangles.begin(), subTriangles.end());
+		}
+	});
 	vector<TriangleComplex> newTriangles;
 	newTriangles.reserve(triangles.size() * 3);
-	for (int i = 0; i < triangles.size(); i++) {
-		auto subTriangles = triangles[i].subdivide();
-		newTriangles.push_back(subTriangles[0]);
-		newTriangles.push_back(subTriangles[1]);
-		newTriangles.push_back(subTriangles[2]);
-	}
+	for (auto &part: parts)
+		newTriangles.insert(newTriangles.end(), part.begin(), part.end());
 	return newTriangles;
 }
 
@@ -2042,22 +1986,22 @@ void SuperCurve::transformMeshByAmbientMap(const SpaceEndomorphism &f) {
  vector<CurveSample> sampleCurve(SmoothParametricCurve curve, std::function<float(float)> width,
                                      std::function<MaterialPhongConstColor(float)> material, float t0, float t1, int n, bool periodic) {
 	vector<CurveSample> samples = vector<CurveSample>();
-	samples.reserve(n);
+	samples.reserve(n+2);
+	vector<float> params = linspace(t0, t1, n+1);
+	vector<mat3> frames = curve.rotationMinimisingFrames(params, periodic);
 	for (int i = 0; i <= n; i++) {
-		float t = t0 + (t1 - t0) * i / n;
+		float t = params[i];
 		vec3 pos = curve(t);
-		vec3 tangent = curve.tangent(t);
-		vec3 normal = curve.normal(t);
 		float w = width(t);
 
 		MaterialPhongConstColor mat = material(t);
-		samples.emplace_back(pos, normal, tangent, mat, w);
+		samples.emplace_back(pos, frames[i][1], frames[i][0], mat, w);
 		samples.at(i).updateExtra(t);
 	}
 	if (periodic) {
 		vec3 pos = curve(t0);
-		vec3 tangent = curve.tangent(t0);
-		vec3 normal = curve.normal(t0);
+		vec3 tangent = frames[0][0];
+		vec3 normal = frames[0][1];
 		float w = width(t0);
 		MaterialPhongConstColor mat = material(t0);
 		samples.push_back(CurveSample(pos, normal, tangent, mat, w));
@@ -269,7 +269,7 @@ public:
 	Vertex(vec3 position, vec3 normal=vec3(0,0,1),  vec4 color=vec4(0,0,0,1), // set projected position as uv
 	       maybeMaterial material=std::nullopt) : Vertex(position, vec2(position.x, position.y), normal, color, material) {}
 
-	std::string hash() const;
+	size_t hash() const;
 	bool operator<(const Vertex& v) const;
 	bool operator==(const Vertex& v) const;
     void setIndex(int i) { index = i; }
@@ -390,7 +390,8 @@ public:
 
 
 enum MeshFormat {
-	OBJ = 0
+	OBJ = 0,
+	PLY = 1
 };
 
 std::map<std::string, int> countEstimatedBufferSizesInOBJFile(const char *filename);
@@ -390,11 +390,7 @@ inline WeakSuperMesh icosahedron(float r, vec3 center, std::variant<int, std::st
 }
 
 WeakSuperMesh icosphere(float r, int n, vec3 center, PolyGroupID id, vec4 color) {
-    WeakSuperMesh unitSphere = icosahedron(1, vec3(0, 0, 0), id);
-    while (n > 0) {
-        unitSphere = unitSphere.subdivideEdgecentric(id);
-        n--;
-    }
+    WeakSuperMesh unitSphere = icosahedron(1, vec3(0, 0, 0), id).subdivideMidpoint(id, n);
 
     auto normaliseVertices = [r, center, color](BufferedVertex &v) {
         v.setNormal(normalise(v.getPosition()));
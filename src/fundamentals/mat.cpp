@@ -1,4 +1,5 @@
 #include "mat.hpp"
+#include "parallel.hpp"
 
 #include <array>
 #include <cmath>
@@ -752,6 +753,107 @@ SparseMatrix SparseMatrix::operator-(SparseMatrix M) {
 	return result;
 }
 
+CSRMatrix::CSRMatrix(vector<int> rowStart, vector<int> columns, vector<float> values)
+: rowStart(std::move(rowStart)), columns(std::move(columns)), values(std::move(values)) {
+	if (this->columns.size() != this->values.size() || this->rowStart.empty() || this->rowStart.back() != this->values.size())
+		throw std::format_error("inconsistent CSR arrays");
+}
+
+float CSRMatrix::get(int i, int j) const {
+	for (int k = rowStart[i]; k < rowStart[i + 1]; k++)
+		if (columns[k] == j)
+			return values[k];
+	return 0;
+}
+
+vector<float> CSRMatrix::diagonal() const {
+	vector<float> d(size(), 0);
+	for (int i = 0; i < size(); i++)
+		d[i] = get(i, i);
+	return d;
+}
+
+void CSRMatrix::multiply(const vector<vec3> &x, vector<vec3> &result) const {
+	result.resize(size());
+	parallelFor(size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			vec3 sum = vec3(0);
+			for (int k = rowStart[i]; k < rowStart[i + 1]; k++)
+				sum += values[k]*x[columns[k]];
+			result[i] = sum;
+		}
+	}, 1024);
+}
+
+vector<vec3> CSRMatrix::operator*(const vector<vec3> &x) const {
+	vector<vec3> result = {};
+	multiply(x, result);
+	return result;
+}
+
+namespace {
+	vec3 componentDot(const vector<vec3> &u, const vector<vec3> &v) {
+		int chunks = chunkCount(u.size(), 4096);
+		vector<vec3> partial(chunks, vec3(0));
+		parallelForChunks(chunks, [&](int c) {
+			for (int i = static_cast<long>(u.size())*c/chunks; i < static_cast<long>(u.size())*(c+1)/chunks; i++)
+				partial[c] += u[i]*v[i];
+		});
+		vec3 sum = vec3(0);
+		for (vec3 p: partial)
+			sum += p;
+		return sum;
+	}
+
+	vec3 safeRatio(vec3 a, vec3 b) {
+		return vec3(b.x != 0 ? a.x/b.x : 0, b.y != 0 ? a.y/b.y : 0, b.z != 0 ? a.z/b.z : 0);
+	}
+}
+
+CGStats conjugateGradient(const CSRMatrix &A, const vector<vec3> &b, vector<vec3> &x, int maxIter, float tol) {
+	int n = A.size();
+	x.resize(n, vec3(0));
+	vector<float> invDiagonal = A.diagonal();
+	for (float &d: invDiagonal)
+		d = d != 0 ? 1.f/d : 1.f;
+
+	vector<vec3> r = A*x, z(n), p(n), Ap(n);
+	parallelFor(n, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			r[i] = b[i] - r[i];
+			z[i] = r[i]*invDiagonal[i];
+			p[i] = z[i];
+		}
+	}, 4096);
+
+	vec3 bNorm = max(componentDot(b, b), vec3(1e-30f));
+	vec3 rz = componentDot(r, z);
+	auto residual = [&] { vec3 rel = componentDot(r, r)/bNorm; return std::sqrt(std::max(rel.x, std::max(rel.y, rel.z))); };
+
+	CGStats stats = {0, residual()};
+	while (stats.iterations < maxIter && stats.residual > tol) {
+		A.multiply(p, Ap);
+		vec3 alpha = safeRatio(rz, componentDot(p, Ap));
+		parallelFor(n, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				x[i] += alpha*p[i];
+				r[i] -= alpha*Ap[i];
+				z[i] = r[i]*invDiagonal[i];
+			}
+		}, 4096);
+		vec3 rzNew = componentDot(r, z);
+		vec3 beta = safeRatio(rzNew, rz);
+		rz = rzNew;
+		parallelFor(n, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				p[i] = z[i] + beta*p[i];
+		}, 4096);
+		stats.iterations++;
+		stats.residual = residual();
+	}
+	return stats;
+}
+
 BigVector::BigVector(const std::vector<std::vector<float>> &data) {
 	this->data = data[0];
 	for (int i = 1; i < data.size(); i++)
@@ -275,6 +275,37 @@ public:
 };
 
 
+// square matrix in compressed rows, pattern fixed at construction
+class CSRMatrix {
+	std::vector<int> rowStart, columns;
+	std::vector<float> values;
+
+public:
+	CSRMatrix(std::vector<int> rowStart, std::vector<int> columns, std::vector<float> values);
+
+	int size() const { return rowStart.size() - 1; }
+	int nonZeros() const { return values.size(); }
+	int rowBegin(int i) const { return rowStart[i]; }
+	int rowEnd(int i) const { return rowStart[i + 1]; }
+	int column(int k) const { return columns[k]; }
+	float value(int k) const { return values[k]; }
+	float& value(int k) { return values[k]; }
+	float get(int i, int j) const;
+	std::vector<float> diagonal() const;
+
+	void multiply(const std::vector<glm::vec3> &x, std::vector<glm::vec3> &result) const;
+	std::vector<glm::vec3> operator*(const std::vector<glm::vec3> &x) const;
+};
+
+struct CGStats {
+	int iterations;
+	float residual; // relative, worst of the three components
+};
+
+// Jacobi preconditioned CG for symmetric positive definite A, three right hand sides solved in lockstep; x is the initial guess
+CGStats conjugateGradient(const CSRMatrix &A, const std::vector<glm::vec3> &b, std::vector<glm::vec3> &x, int maxIter=200, float tol=1e-6f);
+
+
 
 
 class BigVector {
@@ -0,0 +1,145 @@
+#include "parallel.hpp"
+
+#include <cfenv>
+#include <exception>
+
+using std::vector;
+
+
+int hardwareThreads() {
+	static const int n = std::max(1u, std::thread::hardware_concurrency());
+	return n;
+}
+
+struct ThreadPool::Batch {
+	const std::function<void(int)> *body;
+	std::atomic<int> remaining;
+	vector<std::exception_ptr> errors;
+
+	Batch(const std::function<void(int)> *body, int tasks) : body(body), remaining(tasks), errors(tasks, nullptr) {}
+
+	void execute(int index) {
+		try { (*body)(index); }
+		catch (...) { errors[index] = std::current_exception(); }
+		remaining.fetch_sub(1, std::memory_order_acq_rel);
+	}
+};
+
+namespace {
+	// index of the calling thread among the workers of workerPool, -1 for threads outside of it
+	thread_local const ThreadPool *workerPool = nullptr;
+	thread_local int workerIndex = -1;
+}
+
+ThreadPool::ThreadPool(int workers) {
+	for (int i = 0; i < workers; i++)
+		queues.push_back(std::make_unique<Queue>());
+	for (int i = 0; i < workers; i++)
+		threads.emplace_back([this, i]() { work(i); });
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto &t: threads)
+		t.join();
+}
+
+ThreadPool & ThreadPool::shared() {
+	static ThreadPool pool(hardwareThreads() - 1);
+	return pool;
+}
+
+// own queue from the back first, then the others from the front
+bool ThreadPool::runOne(int self) {
+	Task task = {nullptr, 0};
+	int n = queues.size();
+	for (int k = 0; task.batch == nullptr && k < n; k++) {
+		int q = self < 0 ? k : (self + k) % n;
+		std::lock_guard lock(queues[q]->mutex);
+		std::deque<Task> &tasks = queues[q]->tasks;
+		if (tasks.empty())
+			continue;
+		if (q == self) {
+			task = tasks.back();
+			tasks.pop_back();
+		} else {
+			task = tasks.front();
+			tasks.pop_front();
+		}
+	}
+	if (task.batch == nullptr)
+		return false;
+	queued.fetch_sub(1, std::memory_order_relaxed);
+	task.batch->execute(task.index);
+	return true;
+}
+
+void ThreadPool::work(int self) {
+	workerPool = this;
+	workerIndex = self;
+	while (true) {
+		if (runOne(self))
+			continue;
+		std::unique_lock lock(sleepMutex);
+		wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+		if (stopping && queued.load() <= 0)
+			return;
+	}
+}
+
+void ThreadPool::run(int tasks, const std::function<void(int)> &body) {
+	if (tasks <= 0)
+		return;
+	Batch batch = Batch(&body, tasks);
+	int self = workerPool == this ? workerIndex : -1;
+	if (queues.empty())
+		for (int i = 0; i < tasks; i++)
+			batch.execute(i);
+	else {
+		queued.fetch_add(tasks - 1, std::memory_order_relaxed);
+		// the submitter keeps task 0; a worker queues the rest for itself to be stolen, other threads deal them out
+		for (int i = 1; i < tasks; i++) {
+			Queue &q = *queues[self >= 0 ? self : (i - 1) % queues.size()];
+			std::lock_guard lock(q.mutex);
+			q.tasks.push_back({&batch, i});
+		}
+		{ std::lock_guard lock(sleepMutex); }
+		wake.notify_all();
+		batch.execute(0);
+	}
+	while (batch.remaining.load(std::memory_order_acquire) > 0)
+		if (!runOne(self))
+			std::this_thread::yield();
+	for (const auto &e: batch.errors)
+		if (e)
+			std::rethrow_exception(e);
+}
+
+void parallelForChunks(int chunks, const std::function<void(int)> &body) {
+	if (chunks == 1) {
+		body(0);
+		return;
+	}
+	ThreadPool::shared().run(chunks, body);
+}
+
+void parallelForFixed(int n, const std::function<void(int, int)> &body, int chunkSize) {
+	std::fenv_t environment;
+	std::fegetenv(&environment);
+	int chunks = (n + chunkSize - 1)/chunkSize;
+	parallelForChunks(chunks, [&](int c) {
+		std::fenv_t previous;
+		std::fegetenv(&previous);
+		std::fesetenv(&environment);
+		try { body(c*chunkSize, std::min(n, (c + 1)*chunkSize)); }
+		catch (...) {
+			std::fesetenv(&previous);
+			throw;
+		}
+		std::fesetenv(&previous);
+	});
+}
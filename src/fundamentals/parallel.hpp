@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+int hardwareThreads();
+inline int chunkCount(int n, int minChunk) { return std::max(1, std::min(hardwareThreads(), (n + minChunk - 1)/std::max(minChunk, 1))); }
+
+// Work-stealing pool. Every worker owns a deque of tasks: it takes its own tasks from the back and steals from the
+// front of the others. The thread that submits a batch runs tasks too while it waits, so batches may be submitted from
+// inside tasks without deadlocking.
+class ThreadPool {
+	struct Batch;
+	struct Task {
+		Batch *batch;
+		int index;
+	};
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues = {};
+	std::vector<std::thread> threads = {};
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<int> queued = 0;
+	bool stopping = false;
+
+	bool runOne(int self);
+	void work(int self);
+
+public:
+	explicit ThreadPool(int workers);
+	~ThreadPool();
+	ThreadPool(const ThreadPool &other) = delete;
+	ThreadPool & operator=(const ThreadPool &other) = delete;
+
+	// hardwareThreads() - 1 workers, the submitting thread being the last one
+	static ThreadPool& shared();
+	int workerCount() const { return static_cast<int>(threads.size()); }
+
+	// runs body(0), ..., body(tasks-1) and returns when all have finished, rethrowing the exception of the first task that threw
+	void run(int tasks, const std::function<void(int)> &body);
+};
+
+// runs body(0), ..., body(chunks-1) concurrently on the shared pool and rethrows the first exception after all have finished
+void parallelForChunks(int chunks, const std::function<void(int)> &body);
+
+// body(begin, end) on contiguous disjoint ranges covering [0, n)
+inline void parallelFor(int n, const std::function<void(int, int)> &body, int minChunk=256) {
+	int chunks = chunkCount(n, minChunk);
+	parallelForChunks(chunks, [&body, n, chunks](int c) { body(static_cast<long>(n)*c/chunks, static_cast<long>(n)*(c+1)/chunks); });
+}
+
+// body(begin, end) on consecutive ranges of chunkSize elements, each run under the floating point environment of the
+// calling thread. The partition depends only on n, so every run does the same work per chunk on any machine.
+void parallelForFixed(int n, const std::function<void(int, int)> &body, int chunkSize=1024);
+
+// How bulk per-element operations are scheduled. SEQUENTIAL runs in order on the calling thread. PARALLEL splits the
+// work into chunks sized by the number of threads and runs independent groups (e.g. polygroups) concurrently.
+// DETERMINISTIC_PARALLEL goes through parallelForFixed one group after another, so for callbacks that read and write
+// only their own element the result is bit-identical to SEQUENTIAL.
+enum ExecutionMode {
+	SEQUENTIAL,
+	PARALLEL,
+	DETERMINISTIC_PARALLEL
+};
+
+// partial sums are combined in chunk order, so the result does not depend on scheduling
+template<typename T>
+T parallelSum(int n, const std::function<T(int)> &term, T zero, int minChunk=64) {
+	int chunks = chunkCount(n, minChunk);
+	std::vector<T> partial(chunks, zero);
+	parallelForChunks(chunks, [&](int c) {
+		for (int i = static_cast<long>(n)*c/chunks; i < static_cast<long>(n)*(c+1)/chunks; i++)
+			partial[c] += term(i);
+	});
+	T sum = zero;
+	for (const T &p: partial)
+		sum += p;
+	return sum;
+}
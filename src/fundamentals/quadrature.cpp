@@ -0,0 +1,222 @@
+#include "quadrature.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+
+using namespace glm;
+using std::vector, std::pair, std::array;
+
+
+QuadratureRule1D GaussLegendreRule(int n) {
+	QuadratureRule1D rule = {vector<double>(n), vector<double>(n)};
+	for (int i = 0; i < (n + 1)/2; i++) {
+		double x = std::cos(PI*(i + .75)/(n + .5));
+		double dp = 1;
+		for (int it = 0; it < 100; it++) {
+			double p0 = 1, p1 = x;
+			for (int k = 2; k <= n; k++) {
+				double p2 = ((2*k - 1)*x*p1 - (k - 1)*p0)/k;
+				p0 = p1;
+				p1 = p2;
+			}
+			dp = n*(x*p1 - p0)/(x*x - 1);
+			double dx = p1/dp;
+			x -= dx;
+			if (std::abs(dx) < 1e-15)
+				break;
+		}
+		rule.nodes[i] = -x;
+		rule.nodes[n - 1 - i] = x;
+		rule.weights[i] = rule.weights[n - 1 - i] = 2/((1 - x*x)*dp*dp);
+	}
+	return rule;
+}
+
+
+namespace {
+	TriangleQuadratureRule symmetricRule(int degree, const vector<pair<float, float>> &orbits, float centroidWeight=0) {
+		TriangleQuadratureRule rule = {{}, {}, degree};
+		if (centroidWeight != 0) {
+			rule.barycentric.emplace_back(1/3.f, 1/3.f, 1/3.f);
+			rule.weights.push_back(centroidWeight);
+		}
+		for (auto [a, w]: orbits) {
+			float b = 1 - 2*a;
+			for (vec3 p: {vec3(a, a, b), vec3(a, b, a), vec3(b, a, a)}) {
+				rule.barycentric.push_back(p);
+				rule.weights.push_back(w);
+			}
+		}
+		return rule;
+	}
+
+	const array<TriangleQuadratureRule, 4> DUNAVANT_RULES = {
+		symmetricRule(1, {}, 1),
+		symmetricRule(2, {{1/6.f, 1/3.f}}),
+		symmetricRule(4, {{0.445948490915965f, 0.223381589678011f}, {0.091576213509771f, 0.109951743655322f}}),
+		symmetricRule(5, {{0.470142064105115f, 0.132394152788506f}, {0.101286507323456f, 0.125939180544827f}}, 0.225f)
+	};
+
+	constexpr array<double, 8> KRONROD_NODES = {0.991455371120812639, 0.949107912342758525, 0.864864423359769073, 0.741531185599394440,
+												 0.586087235467691130, 0.405845151377397167, 0.207784955007898468, 0.};
+	constexpr array<double, 8> KRONROD_WEIGHTS = {0.022935322010529225, 0.063092092629978553, 0.104790010322250184, 0.140653259715525919,
+												   0.169004726639267903, 0.190350578064785410, 0.204432940075298892, 0.209482141084727828};
+	constexpr array<double, 4> GAUSS_WEIGHTS = {0.129484966168869693, 0.279705391489276668, 0.381830050505118945, 0.417959183673469388};
+
+	// differences of two estimates below this fraction of the local magnitude are float noise of f, not discretisation error
+	constexpr double FLOAT_NOISE = 8*FLT_EPSILON;
+
+	struct KronrodEstimate {
+		double value, error, magnitude; // K15, |K15 - G7|, K15 of |f|
+	};
+
+	KronrodEstimate GaussKronrod15(const Fooo &f, double a, double b) {
+		double c = (a + b)/2, h = (b - a)/2;
+		double fc = f(c);
+		double kronrod = fc*KRONROD_WEIGHTS[7];
+		double gauss = fc*GAUSS_WEIGHTS[3];
+		double magnitude = std::abs(fc)*KRONROD_WEIGHTS[7];
+		for (int i = 0; i < 7; i++) {
+			double fl = f(c - h*KRONROD_NODES[i]), fr = f(c + h*KRONROD_NODES[i]);
+			kronrod += (fl + fr)*KRONROD_WEIGHTS[i];
+			magnitude += (std::abs(fl) + std::abs(fr))*KRONROD_WEIGHTS[i];
+			if (i % 2 == 1)
+				gauss += (fl + fr)*GAUSS_WEIGHTS[i/2];
+		}
+		return {kronrod*h, std::abs(kronrod - gauss)*h, magnitude*std::abs(h)};
+	}
+
+	double integrateGaussKronrodRec(const Fooo &f, double a, double b, double tolerance, int depth, const KronrodEstimate &estimate) {
+		if (estimate.error <= std::max(tolerance, FLOAT_NOISE*estimate.magnitude) || depth <= 0)
+			return estimate.value;
+		double c = (a + b)/2;
+		return integrateGaussKronrodRec(f, a, c, tolerance/2, depth - 1, GaussKronrod15(f, a, c)) +
+			   integrateGaussKronrodRec(f, c, b, tolerance/2, depth - 1, GaussKronrod15(f, c, b));
+	}
+
+	double tensorRule(const Foo111 &f, const QuadratureRule1D &rule, double t0, double t1, double u0, double u1) {
+		double ht = (t1 - t0)/2, hu = (u1 - u0)/2, ct = (t0 + t1)/2, cu = (u0 + u1)/2;
+		double sum = 0;
+		for (int i = 0; i < rule.size(); i++) {
+			double row = 0;
+			for (int j = 0; j < rule.size(); j++)
+				row += rule.weights[j]*f(ct + ht*rule.nodes[i], cu + hu*rule.nodes[j]);
+			sum += rule.weights[i]*row;
+		}
+		return sum*ht*hu;
+	}
+
+	// coarse estimate of the cell is compared with the sum over its four quarters
+	double integrateRectangleRec(const Foo111 &f, const QuadratureRule1D &rule, double t0, double t1, double u0, double u1, double coarse, double tolerance, int depth) {
+		double tm = (t0 + t1)/2, um = (u0 + u1)/2;
+		array<double, 4> quarters = {tensorRule(f, rule, t0, tm, u0, um), tensorRule(f, rule, tm, t1, u0, um),
+									  tensorRule(f, rule, t0, tm, um, u1), tensorRule(f, rule, tm, t1, um, u1)};
+		double fine = quarters[0] + quarters[1] + quarters[2] + quarters[3];
+		if (std::abs(fine - coarse) <= std::max(tolerance, FLOAT_NOISE*std::abs(fine)) || depth <= 0)
+			return fine;
+		return integrateRectangleRec(f, rule, t0, tm, u0, um, quarters[0], tolerance/4, depth - 1) +
+			   integrateRectangleRec(f, rule, tm, t1, u0, um, quarters[1], tolerance/4, depth - 1) +
+			   integrateRectangleRec(f, rule, t0, tm, um, u1, quarters[2], tolerance/4, depth - 1) +
+			   integrateRectangleRec(f, rule, tm, t1, um, u1, quarters[3], tolerance/4, depth - 1);
+	}
+
+	double triangleRule(const Foo31 &f, const TriangleQuadratureRule &rule, vec3 a, vec3 b, vec3 c) {
+		double sum = 0;
+		for (int i = 0; i < rule.size(); i++)
+			sum += rule.weights[i]*f(mat3(a, b, c)*rule.barycentric[i]);
+		return sum*length(cross(b - a, c - a))/2;
+	}
+
+	double integrateTriangleRec(const Foo31 &f, const TriangleQuadratureRule &rule, vec3 a, vec3 b, vec3 c, double coarse, double tolerance, int depth) {
+		vec3 ab = (a + b)/2.f, bc = (b + c)/2.f, ca = (c + a)/2.f;
+		array<double, 4> parts = {triangleRule(f, rule, a, ab, ca), triangleRule(f, rule, ab, b, bc),
+								   triangleRule(f, rule, ca, bc, c), triangleRule(f, rule, ab, bc, ca)};
+		double fine = parts[0] + parts[1] + parts[2] + parts[3];
+		if (std::abs(fine - coarse) <= std::max(tolerance, FLOAT_NOISE*std::abs(fine)) || depth <= 0)
+			return fine;
+		return integrateTriangleRec(f, rule, a, ab, ca, parts[0], tolerance/4, depth - 1) +
+			   integrateTriangleRec(f, rule, ab, b, bc, parts[1], tolerance/4, depth - 1) +
+			   integrateTriangleRec(f, rule, ca, bc, c, parts[2], tolerance/4, depth - 1) +
+			   integrateTriangleRec(f, rule, ab, bc, ca, parts[3], tolerance/4, depth - 1);
+	}
+}
+
+
+const TriangleQuadratureRule& DunavantRule(int degree) {
+	for (const auto &rule: DUNAVANT_RULES)
+		if (rule.degree >= degree)
+			return rule;
+	return DUNAVANT_RULES.back();
+}
+
+// tolerance is relative to the integral of |f| over [a, b]
+float integrateGaussKronrod(const Fooo &f, float a, float b, float tolerance, int maxDepth) {
+	KronrodEstimate whole = GaussKronrod15(f, a, b);
+	return integrateGaussKronrodRec(f, a, b, tolerance*whole.magnitude, maxDepth, whole);
+}
+
+float integrateGaussLegendre(const Fooo &f, float a, float b, int n) {
+	QuadratureRule1D rule = GaussLegendreRule(n);
+	double sum = 0;
+	for (int i = 0; i < n; i++)
+		sum += rule.weights[i]*f((a + b)/2 + (b - a)/2*rule.nodes[i]);
+	return sum*(b - a)/2;
+}
+
+float integrateGaussLegendre(const Foo111 &f, vec2 t_range, vec2 u_range, int n) {
+	return tensorRule(f, GaussLegendreRule(n), t_range.x, t_range.y, u_range.x, u_range.y);
+}
+
+// initial grid cells are refined independently, concurrently unless mode is SEQUENTIAL, in which case f has to be
+// safe to call from several threads; tolerance is relative to the sum of absolute values of the coarse cell estimates.
+// Cells are summed in order, so the result does not depend on the mode.
+float integrateRectangle(const Foo111 &f, vec2 t_range, vec2 u_range, float tolerance, int order, int initialGrid, int maxDepth, ExecutionMode mode) {
+	QuadratureRule1D rule = GaussLegendreRule(order);
+	int cells = initialGrid*initialGrid;
+	double dt = (t_range.y - t_range.x)/initialGrid, du = (u_range.y - u_range.x)/initialGrid;
+	auto cellOrigin = [&](int k) { return pair<double, double>(t_range.x + dt*(k/initialGrid), u_range.x + du*(k%initialGrid)); };
+	auto forCells = [&](const std::function<void(int)> &body) {
+		auto range = [&](int b, int e) {
+			for (int k = b; k < e; k++)
+				body(k);
+		};
+		if (mode == SEQUENTIAL)
+			range(0, cells);
+		else if (mode == DETERMINISTIC_PARALLEL)
+			parallelForFixed(cells, range, 1);
+		else
+			parallelFor(cells, range, 1);
+	};
+
+	vector<double> coarse = vector<double>(cells);
+	forCells([&](int k) {
+		auto [t0, u0] = cellOrigin(k);
+		coarse[k] = tensorRule(f, rule, t0, t0 + dt, u0, u0 + du);
+	});
+	double magnitude = 0;
+	for (double c: coarse)
+		magnitude += std::abs(c);
+	double cellTolerance = tolerance*magnitude/cells;
+	vector<double> refined = vector<double>(cells);
+	forCells([&](int k) {
+		auto [t0, u0] = cellOrigin(k);
+		refined[k] = integrateRectangleRec(f, rule, t0, t0 + dt, u0, u0 + du, coarse[k], cellTolerance, maxDepth);
+	});
+	double sum = 0;
+	for (double r: refined)
+		sum += r;
+	return sum;
+}
+
+float integrateTriangle(const Foo31 &f, vec3 a, vec3 b, vec3 c, int degree) {
+	return triangleRule(f, DunavantRule(degree), a, b, c);
+}
+
+// tolerance is relative to the coarse estimate
+float integrateTriangle(const Foo31 &f, vec3 a, vec3 b, vec3 c, float tolerance, int degree, int maxDepth) {
+	const TriangleQuadratureRule &rule = DunavantRule(degree);
+	double coarse = triangleRule(f, rule, a, b, c);
+	return integrateTriangleRec(f, rule, a, b, c, coarse, tolerance*std::abs(coarse), maxDepth);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "func.hpp"
+#include "parallel.hpp"
+
+
+struct QuadratureRule1D {
+	std::vector<double> nodes;
+	std::vector<double> weights;
+	int size() const { return nodes.size(); }
+};
+
+// barycentric nodes, weights normalised to sum 1 (integral = area * weighted sum)
+struct TriangleQuadratureRule {
+	std::vector<vec3> barycentric;
+	std::vector<float> weights;
+	int degree;
+	int size() const { return weights.size(); }
+};
+
+QuadratureRule1D GaussLegendreRule(int n); // on [-1, 1]
+const TriangleQuadratureRule& DunavantRule(int degree); // exact up to given degree, available 1, 2, 4, 5 (others rounded up, capped at 5)
+
+float integrateGaussKronrod(const Fooo &f, float a, float b, float tolerance=1e-6f, int maxDepth=8); // relative tolerance
+float integrateGaussLegendre(const Fooo &f, float a, float b, int n=8);
+
+float integrateGaussLegendre(const Foo111 &f, vec2 t_range, vec2 u_range, int n=8);
+float integrateRectangle(const Foo111 &f, vec2 t_range, vec2 u_range, float tolerance=1e-5f, int order=6, int initialGrid=8, int maxDepth=5, ExecutionMode mode=SEQUENTIAL); // relative tolerance
+
+float integrateTriangle(const Foo31 &f, vec3 a, vec3 b, vec3 c, int degree=5);
+float integrateTriangle(const Foo31 &f, vec3 a, vec3 b, vec3 c, float tolerance, int degree=5, int maxDepth=6); // relative tolerance
@@ -1,5 +1,8 @@
 #include "complexGeo.hpp"
 #include <map>
+#include <stdexcept>
+
+#include "src/fundamentals/parallel.hpp"
 
 using namespace glm;
 using std::vector, std::string, std::shared_ptr, std::unique_ptr, std::pair, std::make_unique, std::make_shared;
@@ -96,6 +99,7 @@ ComplexCurve ComplexCurve::arc(Complex center, Complex z0, Complex z1)
 Meromorphism::Meromorphism() {
 	_f = make_shared<endC>([](Complex z) {return z; });
 	_df =  make_shared<endC>([](Complex z) {return ONE; });
+	type = HolomorphicType::MOBIUS;
 }
 
 Meromorphism::Meromorphism(shared_ptr<endC> f, shared_ptr<endC> df) {
@@ -111,7 +115,88 @@ Meromorphism::operator PlaneSmoothEndomorphism() const {
 		make_shared<std::function<mat2(vec2) >>([new_df](vec2 x) {return mat2((*new_df)(Complex(x)).re(), (*new_df)(Complex(x)).im(), -(*new_df)(Complex(x)).im(), (*new_df)(Complex(x)).re()); }));
 }
 
+namespace {
+	vector<Complex> polynomialSum(const vector<Complex> &p, const vector<Complex> &q) {
+		vector<Complex> r = vector<Complex>(std::max(p.size(), q.size()), ZERO);
+		for (int i = 0; i < p.size(); i++)
+			r[i] += p[i];
+		for (int i = 0; i < q.size(); i++)
+			r[i] += q[i];
+		return r;
+	}
+
+	vector<Complex> polynomialProduct(const vector<Complex> &p, const vector<Complex> &q) {
+		if (p.empty() || q.empty())
+			return {};
+		vector<Complex> r = vector<Complex>(p.size() + q.size() - 1, ZERO);
+		for (int i = 0; i < p.size(); i++)
+			for (int j = 0; j < q.size(); j++)
+				r[i + j] += p[i]*q[j];
+		return r;
+	}
+
+	// p(q(z)) by Horner's scheme on coefficient vectors
+	vector<Complex> polynomialComposition(const vector<Complex> &p, const vector<Complex> &q) {
+		vector<Complex> r = {};
+		for (int i = p.size() - 1; i >= 0; i--)
+			r = polynomialSum(polynomialProduct(r, q), {p[i]});
+		return r;
+	}
+
+	Complex horner(const vector<Complex> &p, Complex z) {
+		Complex r = ZERO;
+		for (int i = p.size() - 1; i >= 0; i--)
+			r = r*z + p[i];
+		return r;
+	}
+}
+
+Meromorphism Meromorphism::polynomial(const vector<Complex> &coefficients) {
+	vector<Complex> derivative = {};
+	for (int i = 1; i < coefficients.size(); i++)
+		derivative.push_back(coefficients[i]*static_cast<float>(i));
+	Meromorphism res = Meromorphism(make_shared<endC>([coefficients](Complex z) { return horner(coefficients, z); }),
+									make_shared<endC>([derivative](Complex z) { return horner(derivative, z); }));
+	res.type = HolomorphicType::POLYNOMIAL;
+	res.coefficients = coefficients;
+	return res;
+}
+
+void Meromorphism::evaluate(vector<Complex> &z) const {
+	parallelFor(z.size(), [&](int begin, int end) {
+		switch (type) {
+			case HolomorphicType::MOBIUS:
+				for (int i = begin; i < end; i++)
+					z[i] = (mob.a*z[i] + mob.b)/(mob.c*z[i] + mob.d);
+				break;
+			case HolomorphicType::POLYNOMIAL:
+				for (int i = begin; i < end; i++)
+					z[i] = horner(coefficients, z[i]);
+				break;
+			case HolomorphicType::POWER:
+				for (int i = begin; i < end; i++)
+					z[i] = z[i].pow(exponent);
+				break;
+			case HolomorphicType::EXP:
+				for (int i = begin; i < end; i++)
+					z[i] = exp(z[i]);
+				break;
+			case HolomorphicType::LOG:
+				for (int i = begin; i < end; i++)
+					z[i] = log(z[i]);
+				break;
+			default:
+				for (int i = begin; i < end; i++)
+					z[i] = (*_f)(z[i]);
+		}
+	}, 4096);
+}
+
 Meromorphism Meromorphism::compose(Meromorphism g) const {
+	if (type == HolomorphicType::MOBIUS && g.type == HolomorphicType::MOBIUS)
+		return Biholomorphism::mobius(mob*g.mob);
+	if (type == HolomorphicType::POLYNOMIAL && g.type == HolomorphicType::POLYNOMIAL)
+		return polynomial(polynomialComposition(coefficients, g.coefficients));
 	auto new_f = _f;
 	auto new_df = _df;
 	auto g_f = g._f;
@@ -121,6 +206,8 @@ Meromorphism Meromorphism::compose(Meromorphism g) const {
 }
 
 Meromorphism Meromorphism::operator+(Meromorphism g) const {
+	if (type == HolomorphicType::POLYNOMIAL && g.type == HolomorphicType::POLYNOMIAL)
+		return polynomial(polynomialSum(coefficients, g.coefficients));
 	auto new_f = _f;
 	auto new_df = _df;
 	auto g_f = g._f;
@@ -130,6 +217,8 @@ Meromorphism Meromorphism::operator+(Meromorphism g) const {
 }
 
 Meromorphism Meromorphism::operator*(Meromorphism g) const {
+	if (type == HolomorphicType::POLYNOMIAL && g.type == HolomorphicType::POLYNOMIAL)
+		return polynomial(polynomialProduct(coefficients, g.coefficients));
 	auto new_f = _f;
 	auto new_df = _df;
 	auto g_f = g._f;
@@ -139,6 +228,10 @@ Meromorphism Meromorphism::operator*(Meromorphism g) const {
 }
 
 Meromorphism Meromorphism::operator-() const {
+	if (type == HolomorphicType::POLYNOMIAL)
+		return polynomial(polynomialProduct(coefficients, {-ONE}));
+	if (type == HolomorphicType::MOBIUS)
+		return Biholomorphism::mobius(Mob(-mob.a, -mob.b, mob.c, mob.d));
 	auto new_f = _f;
 	auto new_df = _df;
 	return Meromorphism(make_shared<endC>([new_f](Complex z) {return -(*new_f)(z); }),
@@ -147,6 +240,8 @@ Meromorphism Meromorphism::operator-() const {
 }
 
 Meromorphism Meromorphism::operator-(Meromorphism g) const {
+	if (type == HolomorphicType::POLYNOMIAL && g.type == HolomorphicType::POLYNOMIAL)
+		return polynomial(polynomialSum(coefficients, polynomialProduct(g.coefficients, {-ONE})));
 	auto new_f = _f;
 	auto new_df = _df;
 	auto g_f = g._f;
@@ -178,6 +273,7 @@ Biholomorphism::Biholomorphism() {
 	_f = make_shared<endC>([](Complex z) {return z; });
 	_df = make_shared<endC>([](Complex z) {return ONE; });
 	_f_inv = make_shared<endC>([](Complex z) {return z; });
+	type = HolomorphicType::MOBIUS;
 }
 
 Biholomorphism::Biholomorphism(shared_ptr<endC> f, shared_ptr<endC> df, shared_ptr<endC> f_inv) : Meromorphism(f, df) {
@@ -187,8 +283,12 @@ Biholomorphism::Biholomorphism(shared_ptr<endC> f, shared_ptr<endC> df, shared_p
 Biholomorphism Biholomorphism::mobius(Matrix<Complex, 2> mobius) {
 	auto _f = make_shared<endC>([mobius](Complex z) {return mobius.mobius(z); });
 	auto _df = make_shared<endC>([mobius](Complex z) {return mobius.mobius_derivative(z); });
-	auto _f_inv = make_shared<endC>([mobius](Complex z) {return (~mobius).mobius(z); });
-	return Biholomorphism(_f, _df, _f_inv);
+	Mob inverse = ~mobius;
+	auto _f_inv = make_shared<endC>([inverse](Complex z) {return inverse.mobius(z); });
+	Biholomorphism res = Biholomorphism(_f, _df, _f_inv);
+	res.type = HolomorphicType::MOBIUS;
+	res.mob = mobius;
+	return res;
 }
 
 Biholomorphism Biholomorphism::linear(Complex a, Complex b) {
@@ -199,21 +299,28 @@ Biholomorphism Biholomorphism::_LOG() {
 	auto _f = make_shared<endC>([](Complex z) {return log(z); });
 	auto _df = make_shared<endC>([](Complex z) {return ONE / z; });
 	auto _f_inv = make_shared<endC>([](Complex z) {return exp(z); });
-	return Biholomorphism(_f, _df, _f_inv);
+	Biholomorphism res = Biholomorphism(_f, _df, _f_inv);
+	res.type = HolomorphicType::LOG;
+	return res;
 }
 
 Biholomorphism Biholomorphism::_EXP() {
 	auto _f = make_shared<endC>([](Complex z) {return exp(z); });
 	auto _df = make_shared<endC>([](Complex z) {return exp(z); });
 	auto _f_inv = make_shared<endC>([](Complex z) {return log(z); });
-	return Biholomorphism(_f, _df, _f_inv);
+	Biholomorphism res = Biholomorphism(_f, _df, _f_inv);
+	res.type = HolomorphicType::EXP;
+	return res;
 }
 
 Biholomorphism Biholomorphism::power(float a) {
 	auto _f = make_shared<endC>([a](Complex z) {return z.pow(a); });
 	auto _df = make_shared<endC>([a](Complex z) {return a!=0 ? z.pow(a - 1)*a : ZERO; });
 	auto _f_inv = make_shared<endC>([a](Complex z) {return z.pow(1 / a); });
-	return Biholomorphism(_f, _df, _f_inv);
+	Biholomorphism res = Biholomorphism(_f, _df, _f_inv);
+	res.type = HolomorphicType::POWER;
+	res.exponent = a;
+	return res;
 }
 
 Complex Biholomorphism::f_inv(Complex z) const {
@@ -221,6 +328,16 @@ Complex Biholomorphism::f_inv(Complex z) const {
 }
 
 Biholomorphism Biholomorphism::operator~() const {
+    switch (type) {
+        case HolomorphicType::MOBIUS: return mobius(~mob);
+        case HolomorphicType::EXP: return _LOG();
+        case HolomorphicType::LOG: return _EXP();
+        case HolomorphicType::POWER:
+            if (exponent == 0)
+                throw std::domain_error("z^0 is constant and has no inverse");
+            return power(1/exponent);
+        default: break;
+    }
     auto df_cpy = _df;
     auto f_inv_cpy = _f_inv;
     return Biholomorphism(_f_inv, make_shared<endC>([df_cpy, f_inv_cpy](Complex z) {return ONE / (*df_cpy)((*f_inv_cpy)(z)); }), _f);
@@ -236,6 +353,14 @@ Biholomorphism::operator PlaneAutomorphism() const {
 }
 
 Biholomorphism Biholomorphism::compose(Biholomorphism g) const {
+    if (type == HolomorphicType::MOBIUS && g.type == HolomorphicType::MOBIUS)
+        return mobius(mob*g.mob);
+    if (type == HolomorphicType::POLYNOMIAL && g.type == HolomorphicType::POLYNOMIAL) {
+        auto new_inv = _f_inv;
+        auto g_inv = g._f_inv;
+        return Biholomorphism(polynomial(polynomialComposition(coefficients, g.coefficients)),
+                              make_shared<endC>([new_inv, g_inv](Complex z) {return (*g_inv)((*new_inv)(z)); }));
+    }
     auto new_f = _f;
     auto new_df = _df;
     auto new_inv = _f_inv;
@@ -32,10 +32,26 @@ public:
 };
 
 
+// closed form kept next to the closures: compositions and inverses of Mobius maps, and sums, products and compositions
+// of polynomials, collapse into a single map of the same type instead of nesting closures
+enum class HolomorphicType {
+	GENERIC,
+	MOBIUS,
+	POLYNOMIAL,
+	POWER,
+	EXP,
+	LOG
+};
+
 class Meromorphism {
 public:
 	std::shared_ptr<endC> _f; // TODO: is this shared ptr even making sense
 	std::shared_ptr<endC> _df;
+	HolomorphicType type = HolomorphicType::GENERIC;
+	Mob mob = Imob; // MOBIUS
+	std::vector<Complex> coefficients = {}; // POLYNOMIAL, from the constant term
+	float exponent = 1; // POWER
+
 	Meromorphism();
 	Meromorphism(std::shared_ptr<endC> f, std::shared_ptr<endC> df);
 	Meromorphism(std::shared_ptr<endC> f, float eps); // todo
@@ -50,6 +66,10 @@ public:
 	Meromorphism operator-() const;
 	Meromorphism operator-(Meromorphism g) const;
 	Meromorphism operator/(Meromorphism g) const;
+
+	// in place, dispatched once per call on the type instead of per point through the closure
+	void evaluate(std::vector<Complex> &z) const;
+	static Meromorphism polynomial(const std::vector<Complex> &coefficients);
 };
 
 
@@ -59,6 +79,7 @@ public:
 	Biholomorphism();
 	Biholomorphism(std::shared_ptr<endC> f, std::shared_ptr<endC> df, std::shared_ptr<endC> f_inv);
 	Biholomorphism(std::shared_ptr<endC> f, std::shared_ptr<endC> f_inv, float eps);
+	explicit Biholomorphism(const Meromorphism &f, std::shared_ptr<endC> f_inv) : Meromorphism(f), _f_inv(f_inv) {}
 	Complex f_inv(Complex z) const;
 	Complex inv(Complex z) const { return f_inv(z); }
 	Biholomorphism operator~() const;
@@ -1,9 +1,14 @@
 #include "hyperbolic.hpp"
+#include <algorithm>
 #include <random>
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <unordered_map>
 #include <src/common/specific.hpp>
+#include "src/fundamentals/parallel.hpp"
 
 using namespace glm;
 using std::vector, std::string, std::shared_ptr, std::unique_ptr, std::pair, std::make_unique, std::make_shared;
@@ -489,24 +494,162 @@ SchwarzPolygon SchwarzPolygon::stripD(float a, float b, float shift, float h0, f
     return SchwarzPolygon(vert, Imob, make_shared<HyperbolicPlane>(PoincareDisk()), subdivision);
 }
 
-std::vector<HyperbolicTriangleH> HyperbolicTriangleH:: subdivideRec(float max_sidelen, int n, std::vector<HyperbolicTriangleH> tr) {
-    auto result = std::vector<HyperbolicTriangleH>();
-    result.reserve(tr.size());
-    for (int i = 0; i < tr.size(); i++) {
-        float m = tr[i].edgeEuclideanLength(tr[i].longestEdge());
-        if (m > max_sidelen) {
-            auto new_tr = tr[i].subdivideLongestEdge(n);
-            for (int j = 0; j < new_tr.size(); j++)
-                result.push_back(new_tr[j]);
+namespace {
+    // geodesic through two points of H, parametrised by hyperbolic arclength s: ln y on vertical lines and ln tan(theta/2) on circles
+    struct GeodesicH {
+        bool vertical;
+        float center, radius;
+        float s0, s1;
+        float euclideanLength;
+
+        GeodesicH(Complex z0, Complex z1) {
+            vertical = std::abs(z0.x - z1.x) < 1e-6f*(abs(z0) + abs(z1));
+            if (vertical) {
+                center = (z0.x + z1.x)/2;
+                radius = 0;
+                s0 = log(z0.y);
+                s1 = log(z1.y);
+                euclideanLength = std::abs(z1.y - z0.y);
+                return;
+            }
+            center = (norm2(z1) - norm2(z0))/(2*(z1.x - z0.x));
+            radius = abs(z0 - Complex(center, 0));
+            float t0 = clamp((z0 - Complex(center, 0)).arg(), 1e-6f, PI - 1e-6f);
+            float t1 = clamp((z1 - Complex(center, 0)).arg(), 1e-6f, PI - 1e-6f);
+            s0 = log(tan(t0/2));
+            s1 = log(tan(t1/2));
+            euclideanLength = radius*std::abs(t1 - t0);
         }
-        else
-            result.push_back(tr[i]);
+
+        Complex midpoint() const {
+            float s = (s0 + s1)/2;
+            if (vertical)
+                return Complex(center, exp(s));
+            float theta = 2*atan(exp(s));
+            return Complex(center + radius*cos(theta), radius*sin(theta));
+        }
+    };
+}
+
+
+HyperbolicTriangulation::HyperbolicTriangulation(const vector<HyperbolicTriangleH> &triangles) {
+    std::map<pair<float, float>, int> welded = {};
+    for (const auto &t: triangles) {
+        ivec3 face;
+        for (int i = 0; i < 3; i++) {
+            Complex z = t.getVertices()[i];
+            auto it = welded.find({z.x, z.y});
+            if (it == welded.end()) {
+                it = welded.emplace(pair<float, float>(z.x, z.y), vertices.size()).first;
+                vertices.push_back(z);
+            }
+            face[i] = it->second;
+        }
+        faces.push_back(face);
     }
-    if (result.size() == tr.size())
-        return result;
-    return subdivideRec(max_sidelen, n, result);
 }
 
+void HyperbolicTriangulation::subdivide(float max_sidelen, int maxLevels) {
+    for (int level = 0; level < maxLevels; level++) {
+        std::unordered_map<int64_t, int> edgeIndex = {};
+        vector<ivec2> edges = {};
+        vector<ivec3> faceEdges = vector<ivec3>(faces.size());
+        edgeIndex.reserve(faces.size()*2);
+        for (int f = 0; f < faces.size(); f++)
+            for (int i = 0; i < 3; i++) {
+                int a = faces[f][i], b = faces[f][(i + 1) % 3];
+                int64_t key = static_cast<int64_t>(std::min(a, b)) << 32 | std::max(a, b);
+                auto [it, inserted] = edgeIndex.emplace(key, edges.size());
+                if (inserted)
+                    edges.emplace_back(a, b);
+                faceEdges[f][i] = it->second;
+            }
+
+        vector<char> split = vector<char>(edges.size(), 0);
+        vector<Complex> midpoints = vector<Complex>(edges.size());
+        parallelFor(edges.size(), [&](int begin, int end) {
+            for (int e = begin; e < end; e++) {
+                GeodesicH g = GeodesicH(vertices[edges[e].x], vertices[edges[e].y]);
+                if (g.euclideanLength > max_sidelen) {
+                    split[e] = 1;
+                    midpoints[e] = g.midpoint();
+                }
+            }
+        }, 64);
+
+        if (std::none_of(split.begin(), split.end(), [](char c) { return c; }))
+            return;
+        vector<int> midpointIndex = vector<int>(edges.size(), -1);
+        for (int e = 0; e < edges.size(); e++)
+            if (split[e]) {
+                midpointIndex[e] = vertices.size();
+                vertices.push_back(midpoints[e]);
+            }
+
+        vector<int> offsets = vector<int>(faces.size() + 1, 0);
+        for (int f = 0; f < faces.size(); f++)
+            offsets[f + 1] = offsets[f] + 1 + split[faceEdges[f].x] + split[faceEdges[f].y] + split[faceEdges[f].z];
+        vector<ivec3> newFaces = vector<ivec3>(offsets.back());
+
+        // faces are rotated so that the single split edge is the first one, or the single unsplit edge is the last one
+        parallelFor(faces.size(), [&](int begin, int end) {
+            for (int f = begin; f < end; f++) {
+                ivec3 s = ivec3(split[faceEdges[f].x], split[faceEdges[f].y], split[faceEdges[f].z]);
+                int count = s.x + s.y + s.z;
+                int r = 0;
+                if (count == 1)
+                    r = s.x ? 0 : s.y ? 1 : 2;
+                if (count == 2)
+                    r = (!s.x ? 0 : !s.y ? 1 : 2) + 1;
+                ivec3 v, m;
+                for (int i = 0; i < 3; i++) {
+                    v[i] = faces[f][(i + r) % 3];
+                    m[i] = midpointIndex[faceEdges[f][(i + r) % 3]];
+                }
+                ivec3 *out = newFaces.data() + offsets[f];
+                if (count == 0)
+                    out[0] = v;
+                else if (count == 1) {
+                    out[0] = ivec3(v[0], m[0], v[2]);
+                    out[1] = ivec3(m[0], v[1], v[2]);
+                } else if (count == 2) {
+                    out[0] = ivec3(m[0], v[1], m[1]);
+                    if (abs(vertices[v[0]] - vertices[m[1]]) < abs(vertices[m[0]] - vertices[v[2]])) {
+                        out[1] = ivec3(v[0], m[0], m[1]);
+                        out[2] = ivec3(v[0], m[1], v[2]);
+                    } else {
+                        out[1] = ivec3(v[0], m[0], v[2]);
+                        out[2] = ivec3(m[0], m[1], v[2]);
+                    }
+                } else {
+                    out[0] = ivec3(v[0], m[0], m[2]);
+                    out[1] = ivec3(m[0], v[1], m[1]);
+                    out[2] = ivec3(m[2], m[1], v[2]);
+                    out[3] = ivec3(m[0], m[1], m[2]);
+                }
+            }
+        }, 256);
+        faces = std::move(newFaces);
+    }
+}
+
+vector<HyperbolicTriangleH> HyperbolicTriangulation::triangles() const {
+    vector<HyperbolicTriangleH> res = {};
+    res.reserve(faces.size());
+    for (ivec3 f: faces)
+        res.emplace_back(vertices[f.x], vertices[f.y], vertices[f.z]);
+    return res;
+}
+
+vector<TriangleComplex> HyperbolicTriangulation::flatten() const {
+    vector<TriangleComplex> res = {};
+    res.reserve(faces.size());
+    for (ivec3 f: faces)
+        res.emplace_back(std::array<Complex, 3>{vertices[f.x], vertices[f.y], vertices[f.z]});
+    return res;
+}
+
+
 HyperbolicTriangleH::HyperbolicTriangleH(Complex z0, Complex z1, Complex z2) {
     this->vertices = {z0, z1, z2};
 }
@@ -571,7 +714,13 @@ std::vector<HyperbolicTriangleH> HyperbolicTriangleH::subdivideLongestEdge(int n
 }
 
 std::vector<HyperbolicTriangleH> HyperbolicTriangleH::subdivide(float max_sidelen, int n) const {
-    return subdivideRec(max_sidelen, n, {HyperbolicTriangleH(vertices[0], vertices[1], vertices[2])});
+    return indexedSubdivision(max_sidelen).triangles();
+}
+
+HyperbolicTriangulation HyperbolicTriangleH::indexedSubdivision(float max_sidelen) const {
+    HyperbolicTriangulation t = HyperbolicTriangulation({*this});
+    t.subdivide(max_sidelen);
+    return t;
 }
 
 TriangleComplex HyperbolicTriangleH::flatten() const {
@@ -579,12 +728,7 @@ TriangleComplex HyperbolicTriangleH::flatten() const {
 }
 
 std::vector<TriangleComplex> HyperbolicTriangleH::triangulation(float max_sidelen, int n) const {
-    auto tr = subdivide(max_sidelen, n);
-    std::vector<TriangleComplex> result;
-    result.reserve(tr.size());
-    for (auto t: tr)
-        result.push_back(t.flatten());
-    return result;
+    return indexedSubdivision(max_sidelen).flatten();
 }
 
 
@@ -610,11 +754,9 @@ SchwarzPolygon::SchwarzPolygon(HyperbolicTriangleH t, float max_len, int n): mob
 SchwarzPolygon::SchwarzPolygon(std::vector<Complex> vertices, std::vector<HyperbolicTriangleH> trs, float max_len, int n): mobiusToFDDisk(1, 0, 0, 1) {
     this->vertices = vertices;
     this->plane = make_shared<HyperbolicPlane>(HyperbolicPlane());
-    this->triangulation = {};
-    for (auto t: trs) {
-        std::vector<TriangleComplex> tr = t.triangulation(max_len, n);
-        triangulation.insert(triangulation.end(), tr.begin(), tr.end());
-    }
+    HyperbolicTriangulation t = HyperbolicTriangulation(trs);
+    t.subdivide(max_len);
+    this->triangulation = t.flatten();
 }
 
 SchwarzPolygon SchwarzPolygon::transform(Matrix<Complex, 2> m) {
@@ -673,81 +815,225 @@ std::vector<Complex> SchwarzPolygon::getVertices() const {
 }
 
 
-std::vector<std::vector<Matrix<Complex, 2>>> FuchsianGroup::extendGeneratingList(int last_len, int n, std::vector<std::vector<Matrix<Complex, 2>>> list) {
-    auto newList = list;
-    for (auto g: generatorsD) {
-        for (auto l: list) {
-            if(l.size() == last_len) {
-                auto newL = l;
-                newL.push_back(g);
-                if (isValidNewSequence(newL))
-                    newList.push_back(newL);
-                if (newList.size() >= n)
-                    return newList;
-                // newL = l;
-                // newL.push_back(g.inv());
-                // if (isValidNewSequence(newL))
-                //     newList.push_back(newL);
-                // if (newList.size() >= n)
-                //     return newList;
-            }
-        }
-    }
-    if (newList.size() == list.size())
-        return newList;
-    return extendGeneratingList(last_len + 1, n, newList);
+Mob normalisePSL(const Mob &m) {
+    Mob n = m/m.det().sqrt();
+    if (n.a.re() < 0 || (n.a.re() == 0 && n.a.im() < 0))
+        return -n;
+    return n;
 }
 
-Matrix<Complex, 2> FuchsianGroup::multiplyGeneratingSequence(std::vector<Matrix<Complex, 2>> seq) {
-    Mob result = Imob;
-    for (auto m: seq)
-        result = result * m;
-    return result;
+bool nearlyEqualPSL(const Mob &m1, const Mob &m2, float tolerance) {
+    float scale = abs(m1.a) + abs(m1.b) + abs(m1.c) + abs(m1.d);
+    float plus = abs(m1.a - m2.a) + abs(m1.b - m2.b) + abs(m1.c - m2.c) + abs(m1.d - m2.d);
+    float minus = abs(m1.a + m2.a) + abs(m1.b + m2.b) + abs(m1.c + m2.c) + abs(m1.d + m2.d);
+    return std::min(plus, minus) <= tolerance*scale;
 }
 
-bool FuchsianGroup::isValidNewSequence(std::vector<Matrix<Complex, 2>> seq) {
-    if (relationDuplicateIndicator(seq))
-        return false;
-    if (seq.size() >= 2 && nearlyEqual(seq[seq.size() - 1], seq[seq.size() - 2].inv()))
-        return false;
-    return true;
+float displacementD(const Mob &m) {
+    float r = std::min(abs(m.b/m.d), 1 - 1e-7f);
+    return 2*atanh(r);
 }
 
-std::vector<Matrix<Complex, 2>> FuchsianGroup::multiplyGeneratingSequences(std::vector<std::vector<Matrix<Complex, 2>>> list) {
-    std::vector<Matrix<Complex, 2>> result;
-    result.reserve(list.size());
-    for (const auto l: list)
-        result.push_back(multiplyGeneratingSequence(l));
-    return result;
+
+// Two representatives of an element within tolerance move m(0) = b/d by at most ~8*tolerance in the disk, whatever their
+// distance from 0, since |d| >= |b| for maps of the disk. Rings are cellSize thick hyperbolically until that is thinner
+// than radialFloor() = 10*tolerance in the disk, and radialFloor() thick from there on; sectors are ~cellSize long along
+// the outer circle, but never narrower than 2*radialFloor()/r radians. A match therefore always lies in a neighbouring ring
+// and sector. Coordinates are taken in double, so the cells do not drift with the magnitude of their indices.
+double MobiusSet::ringRadius(int ring) const {
+    double rFloor = std::sqrt(std::max(0., 1 - 2*radialFloor()/cellSize));
+    double hyperbolicRings = 2*std::atanh(rFloor)/cellSize;
+    if (ring <= hyperbolicRings)
+        return std::tanh(ring*cellSize/2.);
+    return std::min(1., rFloor + (ring - hyperbolicRings)*radialFloor());
 }
 
+int MobiusSet::sectors(int ring) const {
+    if (ring == 0)
+        return 1;
+    double outer = std::min(ringRadius(ring + 1), 1 - 1e-12);
+    double width = std::max(cellSize/std::sinh(2*std::atanh(outer)), 2*radialFloor()/ringRadius(ring));
+    return std::max(1, static_cast<int>(TAU/width));
+}
+
+std::pair<int, double> MobiusSet::polar(const Mob &m) const {
+    double br = m.b.re(), bi = m.b.im(), dr = m.d.re(), di = m.d.im();
+    double den = dr*dr + di*di;
+    double x = (br*dr + bi*di)/den;
+    double y = (bi*dr - br*di)/den;
+    double r = std::min(std::hypot(x, y), 1.);
+    double rFloor = std::sqrt(std::max(0., 1 - 2*radialFloor()/cellSize));
+    double hyperbolicRings = 2*std::atanh(rFloor)/cellSize;
+    int ring = static_cast<int>(std::floor(r <= rFloor ? 2*std::atanh(r)/cellSize : hyperbolicRings + (r - rFloor)/radialFloor()));
+    return {ring, std::atan2(y, x)/TAU + .5};
+}
+
+int MobiusSet::find(const Mob &m) const {
+    auto [ring, turn] = polar(m);
+    for (int r = std::max(ring - 1, 0); r <= ring + 1; r++) {
+        int n = sectors(r);
+        int sector = static_cast<int>(std::floor(turn*n));
+        for (int s = sector - 1; s <= sector + std::min(1, n - 2); s++) {
+            auto it = buckets.find(key(r, (s % n + n) % n));
+            if (it == buckets.end())
+                continue;
+            for (int i: it->second)
+                if (nearlyEqualPSL(m, elements[i], tolerance))
+                    return i;
+        }
+    }
+    return -1;
+}
+
+int MobiusSet::insert(const Mob &m) {
+    if (find(m) >= 0)
+        return -1;
+    auto [ring, turn] = polar(m);
+    int n = sectors(ring);
+    int sector = static_cast<int>(std::floor(turn*n));
+    buckets[key(ring, (sector % n + n) % n)].push_back(elements.size());
+    elements.push_back(m);
+    return elements.size() - 1;
+}
+
+
 FuchsianGroup::FuchsianGroup() {
     this->generatorsD = vector<Mob>();
 }
 
 std::vector<Matrix<Complex, 2>> FuchsianGroup::generateElementsD(int n) {
-    std::vector<std::vector<Matrix<Complex, 2>>> list = {};
-    list.reserve(n);
-    for (auto g: getGeneratorsD())
-        list.push_back({g});
-    list = extendGeneratingList(1, n-1, list);
-    list.insert(list.begin(), {Imob});
-    return multiplyGeneratingSequences(list);
+    auto elements = enumerate(std::numeric_limits<int>::max(), n);
+    vector<Mob> result = {};
+    result.reserve(elements.size());
+    for (const auto &e: elements)
+        result.push_back(e.m);
+    return result;
 }
 
+vector<GroupElement> FuchsianGroup::enumerate(int maxLength, int maxCount, float maxRadius, float tolerance) {
+    vector<Mob> gens = getGeneratorsAndInverses();
+    for (auto &g: gens)
+        g = normalisePSL(g);
+    vector<int> inverse = vector<int>(gens.size(), -1);
+    for (int i = 0; i < gens.size(); i++)
+        for (int j = 0; j < gens.size(); j++)
+            if (nearlyEqualPSL(gens[i]*gens[j], Imob, tolerance))
+                inverse[i] = j;
+
+    MobiusSet seen = MobiusSet(tolerance);
+    vector<GroupElement> elements = {GroupElement{Imob, -1, -1, 0}};
+    seen.insert(Imob);
+    for (int head = 0; head < elements.size() && elements.size() < maxCount; head++) {
+        if (elements[head].length >= maxLength)
+            break;
+        for (int g = 0; g < gens.size() && elements.size() < maxCount; g++) {
+            if (elements[head].generator >= 0 && inverse[elements[head].generator] == g)
+                continue;
+            // not renormalised: dividing by the square root of ad - bc, which cancels catastrophically far from 0, would
+            // cost more precision than the drift of the determinant of a product of unimodular factors
+            Mob m = elements[head].m*gens[g];
+            if (displacementD(m) > maxRadius || seen.insert(m) < 0)
+                continue;
+            elements.push_back(GroupElement{m, head, g, elements[head].length + 1});
+        }
+    }
+    return elements;
+}
+
+ReducedPoint FuchsianGroup::reduceToDirichletDomain(Complex z, Complex center, int maxSteps) {
+    vector<Mob> gens = getGeneratorsAndInverses();
+    auto distance = [center](Complex w) { return norm2((w - center)/(ONE - center.conj()*w)); };
+    ReducedPoint res = {z, Imob, {}};
+    float current = distance(z);
+    for (int s = 0; s < maxSteps; s++) {
+        int best = -1;
+        float bestDistance = current*(1 - 1e-6f);
+        Complex bestZ = res.z;
+        for (int g = 0; g < gens.size(); g++) {
+            Complex w = gens[g].mobius(res.z);
+            float d = distance(w);
+            if (d < bestDistance) {
+                best = g;
+                bestDistance = d;
+                bestZ = w;
+            }
+        }
+        if (best < 0)
+            break;
+        res.z = bestZ;
+        res.m = gens[best]*res.m;
+        res.word.push_back(best);
+        current = bestDistance;
+    }
+    return res;
+}
+
+void FuchsianGroup::reduceToDirichletDomain(vector<Complex> &points, vector<int> *steps, vector<Mob> *maps, Complex center, int maxSteps) {
+    vector<MobiusCoefficients> gens = {};
+    for (const Mob &g: getGeneratorsAndInverses())
+        gens.emplace_back(g);
+    vec2 c = vec2(center);
+    vec2 cBar = vec2(c.x, -c.y);
+    auto distance = [c, cBar](vec2 w) {
+        vec2 u = MobiusCoefficients::div(w - c, vec2(1, 0) - MobiusCoefficients::mul(cBar, w));
+        return dot(u, u);
+    };
+    if (steps)
+        steps->assign(points.size(), 0);
+    if (maps)
+        maps->assign(points.size(), Imob);
+
+    parallelFor(points.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            vec2 z = vec2(points[i]);
+            float current = distance(z);
+            MobiusCoefficients m = MobiusCoefficients(Imob);
+            int s = 0;
+            for (; s < maxSteps; s++) {
+                int best = -1;
+                float bestDistance = current*(1 - 1e-6f);
+                vec2 bestZ = z;
+                for (int g = 0; g < gens.size(); g++) {
+                    vec2 w = gens[g](z);
+                    float d = distance(w);
+                    if (d < bestDistance) {
+                        best = g;
+                        bestDistance = d;
+                        bestZ = w;
+                    }
+                }
+                if (best < 0)
+                    break;
+                z = bestZ;
+                current = bestDistance;
+                if (maps)
+                    m = gens[best]*m;
+            }
+            points[i] = Complex(z);
+            if (steps)
+                (*steps)[i] = s;
+            if (maps)
+                (*maps)[i] = m.mob();
+        }
+    }, 1024);
+}
 
+vector<int> FuchsianGroup::word(const vector<GroupElement> &elements, int i) {
+    vector<int> w = {};
+    for (; elements[i].parent >= 0; i = elements[i].parent)
+        w.push_back(elements[i].generator);
+    std::reverse(w.begin(), w.end());
+    return w;
+}
 
 
-FuchsianGroup::FuchsianGroup(std::vector<Matrix<Complex, 2>> generators, std::function<bool(std::vector<Matrix<Complex, 2>>)> relationDuplicateIndicator, bool disk) {
+FuchsianGroup::FuchsianGroup(std::vector<Mob> generators, bool disk) {
     this->generatorsD = generators;
-    this->relationDuplicateIndicator = relationDuplicateIndicator;
     if (!disk)
         for (int i = 0; i < generators.size(); i++)
             this->generatorsD[i] = CayleyTransform * generators[i] * CayleyTransformInv;
 }
 
-FuchsianGroup::FuchsianGroup(std::vector<Mob> generators, bool disk) : FuchsianGroup(generators, [](std::vector<Mob> v) { return false; }, disk) {}
-
 vector<Mob> FuchsianGroup::getGeneratorsD() {
     return generatorsD;
 }
@@ -756,13 +1042,13 @@ std::vector<Matrix<Complex, 2>> FuchsianGroup::getGeneratorsAndInverses() {
     vector<Mob> gens = getGeneratorsD();
     gens.reserve(gens.size()*2);
     for (auto g: generatorsD)
-        if (!nearlyEqual(g, g.inv()))
+        if (!nearlyEqualPSL(g, g.inv()))
             gens.push_back(g.inv());
     return gens;
 }
 
 FuchsianGroup FuchsianGroup::Zn(int n) {
-    return FuchsianGroup({Mob(Complex (cos(2*PI/n), sin(2*PI/n)), 0, 0, 1)}, [n](vector<Mob> v) { return v.size() >= n;});
+    return FuchsianGroup({Mob(Complex (cos(2*PI/n), sin(2*PI/n)), 0, 0, 1)});
 }
 
 FuchsianGroup FuchsianGroup::Gm(float a, float b) {
@@ -774,11 +1060,7 @@ FuchsianGroup FuchsianGroup::Ga(float a, float b) {
 }
 
 FuchsianGroup FuchsianGroup::modular() {
-    return FuchsianGroup({Mob(0, 1, -1, 0), Mob(0, 1, -1, 0)*Mob(1, 1, 0, 1)}, [](vector<Mob> v) {
-        return v.size() >= 3 && nearlyEqual(v[v.size() - 1]*v[v.size() - 2], v[v.size() - 3].inv()) ||
-            v.size() >= 3 && nearlyEqual(v[v.size() - 1]*v[v.size() - 2], -v[v.size() - 3].inv()) ||
-                v.size() >= 2 && nearlyEqual(v[v.size() - 1], -v[v.size() - 2].inv());
-    }, false);
+    return FuchsianGroup({Mob(0, 1, -1, 0), Mob(0, 1, -1, 0)*Mob(1, 1, 0, 1)}, false);
 }
 
 
@@ -797,26 +1079,268 @@ std::vector<SchwarzPolygon> HyperbolicTesselation::generateTesselation(int n) {
 }
 
 std::vector<TriangularMesh> HyperbolicTesselation::realiseTesselation(int n) {
-    auto tess = generateTesselation(n);
-    std::vector<TriangularMesh> meshes = {};
-    meshes.reserve(tess.size());
-    for (auto sp: tess) {
-        meshes.push_back(sp.embedd());
-    }
-    return meshes;
+    return realiseTesselation(n, [](int) { return 0.f; });
 }
 
+// heights are evaluated in order on the calling thread, only the tile meshes are built concurrently
 std::vector<TriangularMesh> HyperbolicTesselation::
 realiseTesselation(int n, const std::function<float(int)> &height_function) {
-    auto tess = generateTesselation(n);
-    std::vector<TriangularMesh> meshes = {};
-    meshes.reserve(tess.size());
-    for (int i = 0; i < tess.size(); i++) {
-        meshes.push_back(tess[i].embedd(height_function(i)));
-    }
+    InstancedTesselation tess = instanced(n);
+    std::vector<float> heights = std::vector<float>(tess.size());
+    for (int i = 0; i < tess.size(); i++)
+        heights[i] = height_function(i);
+    std::vector<TriangularMesh> meshes = std::vector<TriangularMesh>(tess.size());
+    parallelFor(tess.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            meshes[i] = tess.tileMesh(i, heights[i]);
+    }, 4);
     return meshes;
 }
 
+InstancedTesselation HyperbolicTesselation::instanced(int n) {
+    return InstancedTesselation(fd, fd.domain(), G.generateElementsD(n));
+}
+
+InstancedTesselation HyperbolicTesselation::instanced(int maxLength, float maxRadius) {
+    vector<Mob> elements = {};
+    for (const auto &e: G.enumerate(maxLength, std::numeric_limits<int>::max(), maxRadius))
+        elements.push_back(e.m);
+    return InstancedTesselation(fd, fd.domain(), elements);
+}
+
+
+InstancedTesselation::InstancedTesselation(const SchwarzPolygon &fd, shared_ptr<HyperbolicPlane> plane, const vector<Mob> &elements)
+: plane(plane) {
+    std::map<std::array<int, 4>, int> welded = {};
+    for (const TriangleComplex &t: fd.getTriangulation()) {
+        ivec3 face;
+        for (int i = 0; i < 3; i++) {
+            vec2 z = vec2(plane->toDisk(t.vertices[i]));
+            auto key = std::array<int, 4>{static_cast<int>(round(z.x*1e5f)), static_cast<int>(round(z.y*1e5f)),
+                                          static_cast<int>(round(t.uvs[i].x*1e5f)), static_cast<int>(round(t.uvs[i].y*1e5f))};
+            auto it = welded.find(key);
+            if (it == welded.end()) {
+                it = welded.emplace(key, baseVertices.size()).first;
+                baseVertices.push_back(z);
+                baseUVs.push_back(t.uvs[i]);
+                baseColors.push_back(t.vertexColors[i]);
+            }
+            face[i] = it->second;
+        }
+        baseFaces.push_back(face);
+    }
+    for (vec2 z: baseVertices)
+        baseCenter += z/(1.f*baseVertices.size());
+    for (vec2 z: baseVertices)
+        baseRadius = std::max(baseRadius, norm(z - baseCenter));
+
+    // the centre of the image circle is the image of the point inverse (wrt the base circle) to the pole of the map
+    tiles.reserve(elements.size());
+    for (const Mob &m: elements) {
+        MobiusCoefficients f = MobiusCoefficients(m);
+        TesselationTile tile = {f, f(baseCenter), INFINITY};
+        if (dot(f.c, f.c) < 1e-12f)
+            tile.radius = baseRadius*norm(MobiusCoefficients::div(f.a, f.d));
+        else {
+            vec2 pole = -MobiusCoefficients::div(f.d, f.c);
+            vec2 offset = pole - baseCenter;
+            if (norm(offset) > baseRadius*(1 + 1e-4f)) {
+                vec2 inverse = baseCenter + offset*baseRadius*baseRadius/dot(offset, offset);
+                tile.center = f(inverse);
+                tile.radius = norm(f(baseCenter + vec2(baseRadius, 0)) - tile.center);
+            }
+        }
+        tiles.push_back(tile);
+    }
+}
+
+LimitSetSampler::LimitSetSampler(const vector<Mob> &generators) {
+    for (const Mob &g: generators) {
+        gens.emplace_back(normalisePSL(g));
+        // an involution is its own inverse letter, otherwise g g would never be cancelled
+        if (nearlyEqualPSL(normalisePSL(g), normalisePSL(g.inv()))) {
+            inverse.push_back(gens.size() - 1);
+            continue;
+        }
+        gens.emplace_back(normalisePSL(g.inv()));
+        inverse.push_back(gens.size() - 1);
+        inverse.push_back(gens.size() - 2);
+    }
+    // attracting root of c z^2 + (d - a) z - b, derivative 1/(cz + d)^2 for det 1;
+    // an affine map z -> (az + b)/d attracts towards its finite fixed point only if |a| < |d|, otherwise towards infinity
+    for (const MobiusCoefficients &g: gens) {
+        Complex a = Complex(g.a), b = Complex(g.b), c = Complex(g.c), d = Complex(g.d);
+        Complex fixed;
+        if (abs(c) < 1e-7f)
+            fixed = abs(a) < abs(d) && abs(d - a) > 1e-7f ? b/(d - a) : Complex(1e8f, 0);
+        else {
+            Complex root = ((a - d).square() + b*c*4.f).sqrt();
+            Complex z1 = (a - d + root)/(c*2.f), z2 = (a - d - root)/(c*2.f);
+            fixed = abs(c*z1 + d) >= abs(c*z2 + d) ? z1 : z2;
+        }
+        attractingFixedPoints.push_back(vec2(fixed));
+    }
+}
+
+vector<vec2> LimitSetSampler::chaosGame(int n, int burnIn, unsigned seed) const {
+    constexpr int LANES = 8;
+    vector<vec2> points = vector<vec2>(n);
+    int k = gens.size();
+    if (k == 0 || n == 0)
+        return points;
+    int chunks = chunkCount(n, 4096);
+    parallelForChunks(chunks, [&](int chunk) {
+        std::mt19937 rng = std::mt19937(seed + 7919u*chunk);
+        std::uniform_int_distribution<int> first = std::uniform_int_distribution<int>(0, k - 1);
+        std::uniform_int_distribution<int> next = std::uniform_int_distribution<int>(0, std::max(k - 2, 0));
+        int begin = static_cast<long>(n)*chunk/chunks, end = static_cast<long>(n)*(chunk + 1)/chunks;
+
+        std::array<float, LANES> x, y, ax, ay, bx, by, cx, cy, dx, dy;
+        std::array<int, LANES> letter;
+        for (int l = 0; l < LANES; l++) {
+            letter[l] = first(rng);
+            x[l] = 0;
+            y[l] = 0;
+        }
+        int emitted = begin;
+        for (int step = 0; emitted < end; step++) {
+            // reduced walk: a uniform letter among the k - 1 which are not the inverse of the last one
+            for (int l = 0; l < LANES; l++) {
+                int j = k > 1 ? next(rng) : 0;
+                if (k > 1 && j >= inverse[letter[l]])
+                    j++;
+                letter[l] = j;
+                const MobiusCoefficients &g = gens[j];
+                ax[l] = g.a.x; ay[l] = g.a.y; bx[l] = g.b.x; by[l] = g.b.y;
+                cx[l] = g.c.x; cy[l] = g.c.y; dx[l] = g.d.x; dy[l] = g.d.y;
+            }
+            for (int l = 0; l < LANES; l++) {
+                float nx = ax[l]*x[l] - ay[l]*y[l] + bx[l], ny = ax[l]*y[l] + ay[l]*x[l] + by[l];
+                float mx = cx[l]*x[l] - cy[l]*y[l] + dx[l], my = cx[l]*y[l] + cy[l]*x[l] + dy[l];
+                float m2 = std::max(mx*mx + my*my, 1e-30f);
+                x[l] = (nx*mx + ny*my)/m2;
+                y[l] = (ny*mx - nx*my)/m2;
+            }
+            if (step < burnIn)
+                continue;
+            for (int l = 0; l < LANES && emitted < end; l++)
+                points[emitted++] = vec2(x[l], y[l]);
+        }
+    });
+    return points;
+}
+
+vector<vec2> LimitSetSampler::wordTree(float epsilon, int maxDepth, int maxNodes) const {
+    int k = gens.size();
+    vector<vector<vec2>> parts = vector<vector<vec2>>(k);
+    int budget = std::max(1, maxNodes/std::max(k, 1));
+    parallelForChunks(k, [&](int root) {
+        struct Node { MobiusCoefficients m; int last; int depth; };
+        vector<Node> stack = {{gens[root], root, 1}};
+        vector<vec2> images = {};
+        for (int visited = 1; !stack.empty(); visited++) {
+            Node node = stack.back();
+            stack.pop_back();
+            images.clear();
+            float spread = 0;
+            for (int j = 0; j < k; j++) {
+                if (j == inverse[node.last])
+                    continue;
+                images.push_back(node.m(attractingFixedPoints[j]));
+                if (images.size() > 1)
+                    spread = std::max(spread, norm(images.back() - images[images.size() - 2]));
+            }
+            if (spread < epsilon || node.depth >= maxDepth || visited >= budget) {
+                for (vec2 p: images)
+                    if (dot(p, p) < 1e12f)
+                        parts[root].push_back(p);
+                continue;
+            }
+            for (int j = k - 1; j >= 0; j--)
+                if (j != inverse[node.last])
+                    stack.push_back({node.m*gens[j], j, node.depth + 1});
+        }
+    });
+    vector<vec2> points = {};
+    for (const auto &part: parts)
+        points.insert(points.end(), part.begin(), part.end());
+    return points;
+}
+
+// each chunk bins its own range of points into a private histogram, the histograms are summed pixel by pixel afterwards
+vector<float> LimitSetSampler::densityImage(const vector<vec2> &points, ivec2 size, vec2 lo, vec2 hi) {
+    int pixels = size.x*size.y;
+    vec2 scale = vec2(size)/(hi - lo);
+    int chunks = std::min(chunkCount(points.size(), 1 << 16), std::max(1, (1 << 24)/std::max(pixels, 1)));
+    vector<vector<float>> partial = vector<vector<float>>(chunks);
+    parallelForChunks(chunks, [&](int c) {
+        vector<float> &histogram = partial[c];
+        histogram = vector<float>(pixels, 0);
+        for (int i = static_cast<long>(points.size())*c/chunks; i < static_cast<long>(points.size())*(c+1)/chunks; i++) {
+            ivec2 pixel = ivec2(floor((points[i] - lo)*scale));
+            if (pixel.x >= 0 && pixel.x < size.x && pixel.y >= 0 && pixel.y < size.y)
+                histogram[pixel.y*size.x + pixel.x] += 1;
+        }
+    });
+    vector<float> image = std::move(partial[0]);
+    parallelFor(pixels, [&](int begin, int end) {
+        for (int c = 1; c < chunks; c++)
+            for (int i = begin; i < end; i++)
+                image[i] += partial[c][i];
+    }, 4096);
+    return image;
+}
+
+vector<int> InstancedTesselation::visibleTiles(float minRadius) const {
+    vector<int> visible = {};
+    for (int i = 0; i < tiles.size(); i++)
+        if (tiles[i].radius >= minRadius)
+            visible.push_back(i);
+    return visible;
+}
+
+Complex InstancedTesselation::vertex(int tile, int i) const {
+    return plane->fromDisk(Complex(tiles[tile].m(baseVertices[i])));
+}
+
+TriangularMesh InstancedTesselation::tileMesh(int tile, float z) const {
+    vector<vec3> positions = {};
+    positions.reserve(baseVertices.size());
+    for (int i = 0; i < baseVertices.size(); i++)
+        positions.push_back(vec3(vec2(vertex(tile, i)), z));
+    vector<TriangleR3> triangles = {};
+    triangles.reserve(baseFaces.size());
+    for (ivec3 f: baseFaces)
+        triangles.emplace_back(vector<vec3>{positions[f.x], positions[f.y], positions[f.z]}, vec3(0, 0, 1),
+                               vector<vec4>{baseColors[f.x], baseColors[f.y], baseColors[f.z]}, vector<vec2>{baseUVs[f.x], baseUVs[f.y], baseUVs[f.z]});
+    return TriangularMesh(triangles);
+}
+
+void InstancedTesselation::expand(vector<vec3> &positions, vector<vec2> &uvs, vector<vec4> &colors, vector<ivec3> &faces,
+                                  float minRadius, const std::function<float(int)> &height) const {
+    vector<int> visible = visibleTiles(minRadius);
+    int nv = baseVertices.size(), nf = baseFaces.size();
+    int v0 = positions.size(), f0 = faces.size();
+    positions.resize(v0 + visible.size()*nv);
+    uvs.resize(v0 + visible.size()*nv);
+    colors.resize(v0 + visible.size()*nv);
+    faces.resize(f0 + visible.size()*nf);
+
+    parallelFor(visible.size(), [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            float z = height(visible[k]);
+            int vk = v0 + k*nv, fk = f0 + k*nf;
+            for (int i = 0; i < nv; i++) {
+                positions[vk + i] = vec3(vec2(vertex(visible[k], i)), z);
+                uvs[vk + i] = baseUVs[i];
+                colors[vk + i] = baseColors[i];
+            }
+            for (int i = 0; i < nf; i++)
+                faces[fk + i] = baseFaces[i] + ivec3(vk);
+        }
+    }, 4);
+}
+
 std::shared_ptr<HyperbolicPlane> HyperbolicTesselation::domain() {
     return fd.domain();
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
 #include "complexGeo.hpp"
 // #include "src/common/specific.hpp"
 
@@ -115,9 +119,27 @@ public:
 
 
 
+class HyperbolicTriangleH;
+
+// indexed triangulation of a region of H with counterclockwise faces
+struct HyperbolicTriangulation {
+	std::vector<Complex> vertices = {};
+	std::vector<ivec3> faces = {};
+
+	HyperbolicTriangulation() = default;
+	explicit HyperbolicTriangulation(const std::vector<HyperbolicTriangleH> &triangles); // equal vertices are welded
+
+	// Level by level, every edge with Euclidean length above max_sidelen is split at its hyperbolic midpoint and faces are
+	// split 1:2, 1:3 or 1:4 according to their split edges. Edges are collected in a hash, so shared edges get one midpoint and
+	// the result is conforming; geodesics, midpoints and new faces of a level are computed in parallel.
+	void subdivide(float max_sidelen, int maxLevels=32);
+	std::vector<HyperbolicTriangleH> triangles() const;
+	std::vector<TriangleComplex> flatten() const;
+};
+
+
 class HyperbolicTriangleH {
 	std::array<Complex, 3> vertices;
-	static std::vector<HyperbolicTriangleH> subdivideRec(float max_sidelen, int n, std::vector<HyperbolicTriangleH>);
 public:
 	HyperbolicTriangleH(Complex z0, Complex z1, Complex z2);
 	std::array<Complex, 3> getVertices() const;
@@ -128,7 +150,9 @@ public:
 	glm::vec2 edgeArgs(int i) const;
 	int longestEdge() const;
 	std::vector<HyperbolicTriangleH> subdivideLongestEdge(int n);
+	// n is ignored since edges are bisected, see HyperbolicTriangulation::subdivide
 	std::vector<HyperbolicTriangleH> subdivide(float max_sidelen, int n=2) const;
+	HyperbolicTriangulation indexedSubdivision(float max_sidelen) const;
 	TriangleComplex flatten() const;
 	std::vector<TriangleComplex> triangulation(float max_sidelen, int n=2) const;
 };
@@ -150,6 +174,7 @@ public:
 	SchwarzPolygon(std::vector<Complex> vertices, std::vector<HyperbolicTriangleH> trs, float max_len, int n=2);
 	Mob getMob() const;
 	std::vector<Complex> getVertices() const;
+	const std::vector<TriangleComplex>& getTriangulation() const { return triangulation; }
 	virtual SchwarzPolygon transform(Mob m);
 	virtual TriangularMesh embedd(float z=0);
 	std::shared_ptr<HyperbolicPlane> domain();
@@ -161,23 +186,77 @@ public:
 	static SchwarzPolygon stripD(float a, float b, float shift, float h0, float h1, float cutbd);
 };
 
+// representative with det 1, the sign is left for comparisons to handle
+Mob normalisePSL(const Mob &m);
+bool nearlyEqualPSL(const Mob &m1, const Mob &m2, float tolerance=1e-4f);
+// hyperbolic distance from 0 to m(0) in the disk
+float displacementD(const Mob &m);
+
+
+// set of elements of PSL(2, C) acting on the disk, up to relative tolerance. Elements are bucketed by the image of 0
+// in polar coordinates, in cells of hyperbolic size ~cellSize that are never smaller than the tolerance allows, so lookups
+// compare against a few candidates only
+class MobiusSet {
+	float tolerance;
+	float cellSize;
+	std::unordered_map<int64_t, std::vector<int>> buckets = {};
+	std::vector<Mob> elements = {};
+
+	double radialFloor() const { return 10.0*tolerance; }
+	double ringRadius(int ring) const;
+	int sectors(int ring) const;
+	std::pair<int, double> polar(const Mob &m) const; // ring and angle of m(0), in turns from 0 to 1
+	int64_t key(int ring, int sector) const { return static_cast<int64_t>(ring) << 32 | static_cast<uint32_t>(sector); }
+
+public:
+	explicit MobiusSet(float tolerance=1e-4f, float cellSize=.05f) : tolerance(tolerance), cellSize(cellSize) {}
+	int find(const Mob &m) const;
+	int insert(const Mob &m); // index of the new element or -1 if already present
+	int size() const { return elements.size(); }
+	const Mob& operator[](int i) const { return elements[i]; }
+};
+
+
+// element of a group found by breadth first search over the Cayley graph: its word is the word of parent followed by generator
+struct GroupElement {
+	Mob m;
+	int parent;
+	int generator; // index in getGeneratorsAndInverses(), -1 for the identity
+	int length;
+};
+
+
+// z = m(original point), m = g_k ... g_1 for word = (g_1, ..., g_k) indexing getGeneratorsAndInverses()
+struct ReducedPoint {
+	Complex z;
+	Mob m;
+	std::vector<int> word;
+};
+
+
 class FuchsianGroup {
 protected:
 	std::vector<Mob> generatorsD;
-	std::function<bool(std::vector<Mob>)> relationDuplicateIndicator = [](std::vector<Mob> v) { return false; };
-	std::vector<std::vector<Mob>> extendGeneratingList(int last_len, int n, std::vector<std::vector<Mob>> list);
-	Mob multiplyGeneratingSequence(std::vector<Mob> seq);
-	bool isValidNewSequence(std::vector<Mob> seq);
-	std::vector<Mob> multiplyGeneratingSequences(std::vector<std::vector<Mob>> list);
 public:
 	virtual ~FuchsianGroup() {};
 	FuchsianGroup();
 	FuchsianGroup(std::vector<Mob> generators, bool disk=true);
-	FuchsianGroup(std::vector<Mob> generators, std::function<bool(std::vector<Mob>)> relationDuplicateIndicator, bool disk=true);
 	virtual std::vector<Mob> generateElementsD(int n);
 	std::vector<Mob> getGeneratorsD();
 	std::vector<Mob> getGeneratorsAndInverses();
 
+	// distinct elements in order of word length, up to maxCount elements, words of length maxLength and displacement of 0
+	// at most maxRadius (only through words whose prefixes stay within the radius)
+	std::vector<GroupElement> enumerate(int maxLength, int maxCount=1000000, float maxRadius=INFINITY, float tolerance=1e-4f);
+	static std::vector<int> word(const std::vector<GroupElement> &elements, int i);
+
+	// Moves z into the Dirichlet domain centred at center by applying the side pairing of a violated side while there is one,
+	// i.e. the generator bringing z closest to the centre. When the generators pair the sides of that domain this ends in it after
+	// O(word length) steps, for other generating sets in a point no generator moves closer to the centre.
+	ReducedPoint reduceToDirichletDomain(Complex z, Complex center=0, int maxSteps=1000);
+	// in place and in parallel over the points, steps gets the word lengths and maps the reducing maps if given
+	void reduceToDirichletDomain(std::vector<Complex> &points, std::vector<int> *steps=nullptr, std::vector<Mob> *maps=nullptr, Complex center=0, int maxSteps=1000);
+
 	static FuchsianGroup Zn(int n);
 	static FuchsianGroup Gm(float a, float b);
 	static FuchsianGroup Ga(float a, float b);
@@ -189,6 +268,89 @@ bool isInAutH(Mob m);
 bool isInAutD(Mob m);
 
 
+// Mobius map as four complex numbers packed in vec2s, cheap to store per tile and to apply
+struct MobiusCoefficients {
+	vec2 a, b, c, d;
+
+	MobiusCoefficients() = default;
+	explicit MobiusCoefficients(const Mob &m) : a(vec2(m.a)), b(vec2(m.b)), c(vec2(m.c)), d(vec2(m.d)) {}
+	static vec2 mul(vec2 p, vec2 q) { return vec2(p.x*q.x - p.y*q.y, p.x*q.y + p.y*q.x); }
+	static vec2 div(vec2 p, vec2 q) { return vec2(p.x*q.x + p.y*q.y, p.y*q.x - p.x*q.y)/dot(q, q); }
+	vec2 operator()(vec2 z) const { return div(mul(a, z) + b, mul(c, z) + d); }
+	MobiusCoefficients operator*(const MobiusCoefficients &M) const {
+		MobiusCoefficients res;
+		res.a = mul(a, M.a) + mul(b, M.c);
+		res.b = mul(a, M.b) + mul(b, M.d);
+		res.c = mul(c, M.a) + mul(d, M.c);
+		res.d = mul(c, M.b) + mul(d, M.d);
+		return res;
+	}
+	Mob mob() const { return Mob(Complex(a), Complex(b), Complex(c), Complex(d)); }
+};
+
+// image of a tile in the disk is contained in the circle, radius is infinite if the circle got turned inside out
+struct TesselationTile {
+	MobiusCoefficients m;
+	vec2 center;
+	float radius;
+};
+
+
+// tesselation stored as one indexed triangulation of the fundamental domain (in disk coordinates, vertices welded)
+// and a Mobius map with a bounding circle per tile; flat geometry is expanded on demand in parallel over tiles
+class InstancedTesselation {
+	std::shared_ptr<HyperbolicPlane> plane;
+	std::vector<vec2> baseVertices = {};
+	std::vector<vec2> baseUVs = {};
+	std::vector<vec4> baseColors = {};
+	std::vector<ivec3> baseFaces = {};
+	vec2 baseCenter = vec2(0);
+	float baseRadius = 0;
+	std::vector<TesselationTile> tiles = {};
+
+public:
+	InstancedTesselation(const SchwarzPolygon &fd, std::shared_ptr<HyperbolicPlane> plane, const std::vector<Mob> &elements);
+
+	int size() const { return tiles.size(); }
+	const TesselationTile& tile(int i) const { return tiles[i]; }
+	int verticesPerTile() const { return baseVertices.size(); }
+	int facesPerTile() const { return baseFaces.size(); }
+	// tiles whose bounding circle in the disk has radius at least minRadius
+	std::vector<int> visibleTiles(float minRadius=0) const;
+
+	// vertex i of a tile in the coordinates of the plane of the fundamental domain
+	Complex vertex(int tile, int i) const;
+	TriangularMesh tileMesh(int tile, float z=0) const;
+	// visible tiles written one after another, faces index into the output arrays, height(i) is the z coordinate of tile i
+	void expand(std::vector<vec3> &positions, std::vector<vec2> &uvs, std::vector<vec4> &colors, std::vector<ivec3> &faces,
+				float minRadius=0, const std::function<float(int)> &height=[](int) { return 0.f; }) const;
+};
+
+
+// Points of the limit set of the group generated by the given Mobius maps and their inverses, for Kleinian groups acting on the
+// sphere as well as Fuchsian groups on the disk. Infinity and points far away are dropped from the output.
+class LimitSetSampler {
+	std::vector<MobiusCoefficients> gens = {};
+	std::vector<int> inverse = {};
+	std::vector<vec2> attractingFixedPoints = {};
+
+public:
+	explicit LimitSetSampler(const std::vector<Mob> &generators);
+	explicit LimitSetSampler(FuchsianGroup &G) : LimitSetSampler(G.getGeneratorsD()) {}
+
+	// chaos game: independent random reduced walks, a block of lanes per thread advanced together (coefficients gathered into
+	// arrays so the Mobius arithmetic vectorises); each walk drops its first burnIn points
+	std::vector<vec2> chaosGame(int n, int burnIn=64, unsigned seed=0) const;
+	// depth first over reduced words w, in parallel over the first letter; a branch ends when the images under w of the attracting
+	// fixed points of the possible next letters are epsilon-close (or at maxDepth) and those images are emitted; every first letter
+	// expands at most maxNodes/#letters words, after which the remaining branches are emitted as they are; involutions are
+	// their own inverse letters, other relators are not reduced
+	std::vector<vec2> wordTree(float epsilon, int maxDepth=40, int maxNodes=1 << 22) const;
+	// counts of points in size.x * size.y pixels covering [lo, hi], row major
+	static std::vector<float> densityImage(const std::vector<vec2> &points, ivec2 size, vec2 lo, vec2 hi);
+};
+
+
 class HyperbolicTesselation {
 	FuchsianGroup G;
 	SchwarzPolygon fd;
@@ -197,6 +359,8 @@ public:
 	std::vector<SchwarzPolygon> generateTesselation(int n);
 	std::vector<TriangularMesh> realiseTesselation(int n);
 	std::vector<TriangularMesh> realiseTesselation(int n, const std::function<float(int)> &height_function);
+	InstancedTesselation instanced(int n);
+	InstancedTesselation instanced(int maxLength, float maxRadius);
 	std::shared_ptr<HyperbolicPlane> domain();
 
 	static HyperbolicTesselation ringsInH(int radial, int horizontal, float a, float b, float cut_bd=.99);
@@ -1,6 +1,12 @@
 #include "smoothImplicit.hpp"
 #include "src/fundamentals/func.hpp"
 #include "src/common/indexedRendering.hpp"
+#include "src/fundamentals/parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <unordered_map>
 
 using std::vector, std::string, std::shared_ptr, std::unique_ptr, std::pair, std::make_unique, std::make_shared, std::function;
 
@@ -14,6 +20,486 @@ float SmoothImplicitSurface::operator()(vec3 p) const {
     return _F(p);
 }
 
+ProjectionStats& ProjectionStats::operator+=(const ProjectionStats &other) {
+	points += other.points;
+	converged += other.converged;
+	stalled += other.stalled;
+	totalIterations += other.totalIterations;
+	maxIterations = std::max(maxIterations, other.maxIterations);
+	maxResidual = std::max(maxResidual, other.maxResidual);
+	return *this;
+}
+
+ProjectionStats SmoothImplicitSurface::project(vector<vec3> &points, float level, int maxSteps, float eps, vector<char> *converged) const {
+	constexpr int LANES = 16;
+	int n = points.size();
+	if (converged)
+		converged->assign(n, 0);
+	int chunks = chunkCount(n, 4*LANES);
+	vector<ProjectionStats> partial = vector<ProjectionStats>(chunks);
+
+	parallelForChunks(chunks, [&](int c) {
+		ProjectionStats &stats = partial[c];
+		int end = static_cast<long>(n)*(c + 1)/chunks;
+		for (int b = static_cast<long>(n)*c/chunks; b < end; b += LANES) {
+			int lanes = std::min(LANES, end - b);
+			std::array<vec3, LANES> x;
+			std::array<float, LANES> residual = {};
+			std::array<int, LANES> steps = {};
+			uint32_t active = (1u << lanes) - 1, done = 0;
+			for (int l = 0; l < lanes; l++)
+				x[l] = points[b + l];
+
+			for (int it = 0; it < maxSteps && active; it++)
+				for (int l = 0; l < lanes; l++) {
+					if (!(active >> l & 1))
+						continue;
+					float f = _F(x[l]) - level;
+					vec3 g = _F.df(x[l]);
+					float g2 = dot(g, g);
+					residual[l] = std::abs(f);
+					if (g2 < 1e-20f) {
+						active &= ~(1u << l);
+						stats.stalled++;
+						continue;
+					}
+					vec3 dx = g*(f/g2);
+					x[l] -= dx;
+					steps[l]++;
+					if (dot(dx, dx) < eps*eps) {
+						active &= ~(1u << l);
+						done |= 1u << l;
+					}
+				}
+
+			for (int l = 0; l < lanes; l++) {
+				points[b + l] = x[l];
+				stats.totalIterations += steps[l];
+				stats.maxIterations = std::max(stats.maxIterations, steps[l]);
+				stats.maxResidual = std::max(stats.maxResidual, residual[l]);
+				if (converged)
+					(*converged)[b + l] = done >> l & 1;
+			}
+			stats.points += lanes;
+			stats.converged += std::popcount(done);
+		}
+	});
+
+	ProjectionStats stats;
+	for (const auto &s: partial)
+		stats += s;
+	return stats;
+}
+
+vec3 SmoothImplicitSurface::project(vec3 p, float level, int maxSteps, float eps) const {
+	vector<vec3> points = {p};
+	project(points, level, maxSteps, eps);
+	return points[0];
+}
+
+SmoothImplicitSurface SmoothImplicitSurface::cached(vec3 boxMin, vec3 boxMax, float h, float band, float lipschitz) const {
+	return SmoothImplicitSurface(SparseFieldCache(_F, boxMin, boxMax, h, band, lipschitz).function());
+}
+
+
+SparseFieldCache::SparseFieldCache(const RealFunctionR3 &F, vec3 boxMin, vec3 boxMax, float h, float band, float lipschitz, int brickSize)
+: F(F), boxMin(boxMin), h(h), band(band), brickSize(brickSize) {
+	bricks = max(ivec3(ceil((boxMax - boxMin)/(h*brickSize))), ivec3(1));
+	int n = bricks.x*bricks.y*bricks.z;
+	float brickSide = h*brickSize;
+	auto brickOf = [this](int i) { return ivec3(i/(bricks.y*bricks.z), i/bricks.z % bricks.y, i % bricks.z); };
+
+	centreValues = vector<float>(n);
+	vector<float> centreSlopes = vector<float>(n);
+	parallelFor(n, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			vec3 c = boxMin + (vec3(brickOf(i)) + vec3(.5f))*brickSide;
+			centreValues[i] = F(c);
+			if (lipschitz <= 0)
+				centreSlopes[i] = norm(F.df(c));
+		}
+	}, 16);
+	if (lipschitz <= 0)
+		lipschitz = 2*(*std::max_element(centreSlopes.begin(), centreSlopes.end()));
+
+	float reach = band + lipschitz*brickSide*sqrt(3.f)/2;
+	brickSlot = vector<int>(n, -1);
+	int stored = 0;
+	for (int i = 0; i < n; i++)
+		if (std::abs(centreValues[i]) <= reach)
+			brickSlot[i] = stored++;
+
+	int m = samplesPerBrick();
+	values = vector<float>(stored*m);
+	gradients = vector<vec3>(stored*m);
+	parallelFor(n, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			if (brickSlot[i] < 0)
+				continue;
+			vec3 corner = boxMin + vec3(brickOf(i))*brickSide;
+			int s = brickSlot[i]*m;
+			for (int x = 0; x <= brickSize; x++)
+				for (int y = 0; y <= brickSize; y++)
+					for (int z = 0; z <= brickSize; z++, s++) {
+						vec3 p = corner + vec3(x, y, z)*h;
+						values[s] = F(p);
+						gradients[s] = F.df(p);
+					}
+		}
+	}, 1);
+}
+
+bool SparseFieldCache::locate(vec3 p, int &brick, vec3 &local) const {
+	vec3 g = (p - boxMin)/h;
+	if (any(lessThan(g, vec3(0))) || any(greaterThan(g, vec3(bricks*brickSize))))
+		return false;
+	ivec3 b = min(ivec3(floor(g))/brickSize, bricks - ivec3(1));
+	brick = brickIndex(b);
+	local = g - vec3(b*brickSize);
+	return true;
+}
+
+bool SparseFieldCache::cached(vec3 p) const {
+	int brick;
+	vec3 local;
+	return locate(p, brick, local) && brickSlot[brick] >= 0;
+}
+
+namespace {
+	template<typename T>
+	T trilinear(const T *samples, int side, vec3 local) {
+		ivec3 c = min(ivec3(floor(local)), ivec3(side - 2));
+		vec3 f = local - vec3(c);
+		auto at = [samples, side](int x, int y, int z) { return samples[(x*side + y)*side + z]; };
+		T x00 = lerp(at(c.x, c.y, c.z), at(c.x + 1, c.y, c.z), f.x);
+		T x10 = lerp(at(c.x, c.y + 1, c.z), at(c.x + 1, c.y + 1, c.z), f.x);
+		T x01 = lerp(at(c.x, c.y, c.z + 1), at(c.x + 1, c.y, c.z + 1), f.x);
+		T x11 = lerp(at(c.x, c.y + 1, c.z + 1), at(c.x + 1, c.y + 1, c.z + 1), f.x);
+		return lerp(lerp(x00, x10, f.y), lerp(x01, x11, f.y), f.z);
+	}
+}
+
+float SparseFieldCache::operator()(vec3 p) const {
+	int brick;
+	vec3 local;
+	if (!locate(p, brick, local))
+		return F(p);
+	if (brickSlot[brick] < 0)
+		return centreValues[brick];
+	return trilinear(values.data() + brickSlot[brick]*samplesPerBrick(), brickSize + 1, local);
+}
+
+vec3 SparseFieldCache::df(vec3 p) const {
+	int brick;
+	vec3 local;
+	if (!locate(p, brick, local) || brickSlot[brick] < 0)
+		return F.df(p);
+	return trilinear(gradients.data() + brickSlot[brick]*samplesPerBrick(), brickSize + 1, local);
+}
+
+namespace {
+	RealFunctionR3 sharedFunction(const shared_ptr<const SparseFieldCache> &cache) {
+		return RealFunctionR3([cache](vec3 p) { return (*cache)(p); }, [cache](vec3 p) { return cache->df(p); });
+	}
+}
+
+RealFunctionR3 SparseFieldCache::function() const & {
+	return sharedFunction(make_shared<const SparseFieldCache>(*this));
+}
+
+RealFunctionR3 SparseFieldCache::function() && {
+	return sharedFunction(make_shared<const SparseFieldCache>(std::move(*this)));
+}
+
+
+namespace {
+	const std::array<ivec3, 8> CUBE_CORNERS = {ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(0, 1, 0), ivec3(1, 1, 0),
+											   ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(0, 1, 1), ivec3(1, 1, 1)};
+
+	// corner c sits at CUBE_CORNERS[c] (bit i of c is coordinate i), edge e starts at corner edges[e].first along axis edges[e].second
+	struct MarchingCubesTable {
+		std::array<pair<int, int>, 12> edges;
+		std::array<int, 64> edgeOf;
+		std::array<vector<ivec3>, 256> triangles;
+	};
+
+	// Built by tracing the contour on the cube faces instead of the usual hardcoded table. Segments on each face are oriented
+	// with the inside corners (mask bit set) on their left seen from outside, so they chain into consistently oriented loops;
+	// on ambiguous faces the inside corners are always separated, which both cells sharing the face agree on.
+	const MarchingCubesTable& marchingCubesTable() {
+		static const MarchingCubesTable table = [] {
+			MarchingCubesTable T;
+			T.edgeOf.fill(-1);
+			int count = 0;
+			for (int axis = 0; axis < 3; axis++)
+				for (int a = 0; a < 8; a++)
+					if (!((a >> axis) & 1)) {
+						T.edges[count] = {a, axis};
+						T.edgeOf[a*8 + (a | 1 << axis)] = T.edgeOf[(a | 1 << axis)*8 + a] = count;
+						count++;
+					}
+			auto corner = [](int c) { return vec3(CUBE_CORNERS[c]); };
+			auto midpoint = [&](int e) { return (corner(T.edges[e].first) + corner(T.edges[e].first | 1 << T.edges[e].second))/2.f; };
+
+			for (int mask = 0; mask < 256; mask++) {
+				auto inside = [mask](int c) { return (mask >> c) & 1; };
+				std::array<int, 12> next;
+				next.fill(-1);
+				for (int d = 0; d < 3; d++)
+					for (int s = 0; s < 2; s++) {
+						int e1 = (d + 1) % 3, e2 = (d + 2) % 3;
+						std::array<int, 4> fc = {s << d, s << d | 1 << e1, s << d | 1 << e1 | 1 << e2, s << d | 1 << e2};
+						vec3 n = vec3(0);
+						n[d] = 2.f*s - 1;
+						vector<int> active = {};
+						for (int k = 0; k < 4; k++)
+							if (inside(fc[k]) != inside(fc[(k + 1) % 4]))
+								active.push_back(k);
+
+						vector<std::array<int, 3>> segments = {}; // face edge, face edge, cut off corner or -1
+						if (active.size() == 2) {
+							int k0 = active[0], k1 = active[1];
+							int cut = k1 == k0 + 1 ? fc[k1] : k0 == 0 && k1 == 3 ? fc[0] : -1;
+							segments.push_back({k0, k1, cut});
+						}
+						if (active.size() == 4)
+							for (int m = 0; m < 4; m++)
+								if (inside(fc[m]))
+									segments.push_back({(m + 3) % 4, m, fc[m]});
+
+						for (auto [k0, k1, cut]: segments) {
+							int ea = T.edgeOf[fc[k0]*8 + fc[(k0 + 1) % 4]];
+							int eb = T.edgeOf[fc[k1]*8 + fc[(k1 + 1) % 4]];
+							vec3 a = midpoint(ea), b = midpoint(eb);
+							int ref = cut;
+							if (ref < 0)
+								for (int c: fc)
+									if (inside(c))
+										ref = c;
+							float side = dot(cross(b - a, corner(ref) - a), n);
+							if ((side > 0) != static_cast<bool>(inside(ref)))
+								std::swap(ea, eb);
+							next[ea] = eb;
+						}
+					}
+
+				std::array<bool, 12> visited = {};
+				for (int e = 0; e < 12; e++) {
+					if (next[e] < 0 || visited[e])
+						continue;
+					vector<int> loop = {};
+					for (int f = e; f >= 0 && !visited[f] && loop.size() < 12; f = next[f]) {
+						visited[f] = true;
+						loop.push_back(f);
+					}
+					// loops run around the inside region, reversed fan puts the normal towards the outside
+					for (int i = 1; i + 1 < loop.size(); i++)
+						T.triangles[mask].emplace_back(loop[0], loop[i + 1], loop[i]);
+				}
+			}
+			return T;
+		}();
+		return table;
+	}
+
+	struct IsosurfaceGrid {
+		vec3 boxMin, step;
+		ivec3 res;
+		vector<float> values;
+		vector<int> slabBegin;
+		vector<int> planeSlab;
+
+		IsosurfaceGrid(const SmoothImplicitSurface &surf, vec3 boxMin, vec3 boxMax, ivec3 resolution, float level)
+		: boxMin(boxMin), step((boxMax - boxMin)/vec3(resolution)), res(resolution) {
+			values = vector<float>((res.x + 1)*(res.y + 1)*(res.z + 1));
+			parallelFor(res.x + 1, [&](int begin, int end) {
+				for (int i = begin; i < end; i++)
+					for (int j = 0; j <= res.y; j++)
+						for (int k = 0; k <= res.z; k++)
+							values[index(ivec3(i, j, k))] = surf(point(ivec3(i, j, k))) - level;
+			}, 2);
+			int slabs = chunkCount(res.x + 1, 4);
+			planeSlab = vector<int>(res.x + 1);
+			for (int c = 0; c <= slabs; c++)
+				slabBegin.push_back((res.x + 1)*c/slabs);
+			for (int c = 0; c < slabs; c++)
+				for (int i = slabBegin[c]; i < slabBegin[c + 1]; i++)
+					planeSlab[i] = c;
+		}
+
+		int slabs() const { return slabBegin.size() - 1; }
+		int index(ivec3 g) const { return (g.x*(res.y + 1) + g.y)*(res.z + 1) + g.z; }
+		int64_t edgeKey(ivec3 g, int axis) const { return 3*static_cast<int64_t>(index(g)) + axis; }
+		int64_t cellKey(ivec3 g) const { return (static_cast<int64_t>(g.x)*res.y + g.y)*res.z + g.z; }
+		float value(ivec3 g) const { return values[index(g)]; }
+		vec3 point(ivec3 g) const { return boxMin + vec3(g)*step; }
+		bool inGrid(ivec3 g) const { return all(greaterThanEqual(g, ivec3(0))) && all(lessThanEqual(g, res)); }
+		bool inCells(ivec3 g) const { return all(greaterThanEqual(g, ivec3(0))) && all(lessThan(g, res)); }
+
+		vec3 crossing(ivec3 g, int axis) const {
+			ivec3 h = g;
+			h[axis]++;
+			float a = value(g), b = value(h);
+			return lerp(point(g), point(h), a/(a - b));
+		}
+		bool signChange(ivec3 g, int axis) const {
+			ivec3 h = g;
+			h[axis]++;
+			return inGrid(h) && (value(g) < 0) != (value(h) < 0);
+		}
+	};
+
+	struct IsosurfaceSlab {
+		std::unordered_map<int64_t, int> index = {};
+		vector<vec3> positions = {};
+		vector<vec3> normals = {};
+		vector<ivec3> faces = {};
+	};
+
+	IsosurfaceMesh gatherSlabs(vector<IsosurfaceSlab> &slabs, const vector<int> &offsets) {
+		IsosurfaceMesh mesh;
+		mesh.positions.reserve(offsets.back());
+		mesh.normals.reserve(offsets.back());
+		int faceCount = 0;
+		for (const auto &slab: slabs)
+			faceCount += slab.faces.size();
+		mesh.faces.reserve(faceCount);
+		for (auto &slab: slabs) {
+			mesh.positions.insert(mesh.positions.end(), slab.positions.begin(), slab.positions.end());
+			mesh.normals.insert(mesh.normals.end(), slab.normals.begin(), slab.normals.end());
+			mesh.faces.insert(mesh.faces.end(), slab.faces.begin(), slab.faces.end());
+		}
+		return mesh;
+	}
+
+	vector<int> slabOffsets(const vector<IsosurfaceSlab> &slabs) {
+		vector<int> offsets = {0};
+		for (const auto &slab: slabs)
+			offsets.push_back(offsets.back() + slab.positions.size());
+		return offsets;
+	}
+}
+
+
+IsosurfaceMesh marchingCubes(const SmoothImplicitSurface &surf, vec3 boxMin, vec3 boxMax, ivec3 resolution, float level) {
+	const MarchingCubesTable &table = marchingCubesTable();
+	IsosurfaceGrid grid = IsosurfaceGrid(surf, boxMin, boxMax, resolution, level);
+	vector<IsosurfaceSlab> slabs = vector<IsosurfaceSlab>(grid.slabs());
+
+	// vertices on edges starting in the planes of the slab
+	parallelForChunks(grid.slabs(), [&](int c) {
+		IsosurfaceSlab &slab = slabs[c];
+		for (int i = grid.slabBegin[c]; i < grid.slabBegin[c + 1]; i++)
+			for (int j = 0; j <= grid.res.y; j++)
+				for (int k = 0; k <= grid.res.z; k++)
+					for (int axis = 0; axis < 3; axis++)
+						if (grid.signChange(ivec3(i, j, k), axis)) {
+							vec3 p = grid.crossing(ivec3(i, j, k), axis);
+							slab.index[grid.edgeKey(ivec3(i, j, k), axis)] = slab.positions.size();
+							slab.positions.push_back(p);
+							slab.normals.push_back(surf.normal(p));
+						}
+	});
+	vector<int> offsets = slabOffsets(slabs);
+
+	parallelForChunks(grid.slabs(), [&](int c) {
+		IsosurfaceSlab &slab = slabs[c];
+		for (int i = grid.slabBegin[c]; i < min(grid.slabBegin[c + 1], grid.res.x); i++)
+			for (int j = 0; j < grid.res.y; j++)
+				for (int k = 0; k < grid.res.z; k++) {
+					ivec3 g = ivec3(i, j, k);
+					int mask = 0;
+					for (int v = 0; v < 8; v++)
+						if (grid.value(g + CUBE_CORNERS[v]) < 0)
+							mask |= 1 << v;
+					if (table.triangles[mask].empty())
+						continue;
+					ivec3 vertex;
+					for (ivec3 tr: table.triangles[mask]) {
+						for (int v = 0; v < 3; v++) {
+							auto [corner, axis] = table.edges[tr[v]];
+							ivec3 start = g + CUBE_CORNERS[corner];
+							int owner = grid.planeSlab[start.x];
+							vertex[v] = offsets[owner] + slabs[owner].index.at(grid.edgeKey(start, axis));
+						}
+						slab.faces.push_back(vertex);
+					}
+				}
+	});
+	return gatherSlabs(slabs, offsets);
+}
+
+
+// one vertex per cell crossed by the surface, minimising the quadric error of the tangent planes at edge crossings
+// (regularised towards their mass point and clamped to the cell), one quad per edge with a sign change
+IsosurfaceMesh dualContouring(const SmoothImplicitSurface &surf, vec3 boxMin, vec3 boxMax, ivec3 resolution, float level) {
+	IsosurfaceGrid grid = IsosurfaceGrid(surf, boxMin, boxMax, resolution, level);
+	vector<IsosurfaceSlab> slabs = vector<IsosurfaceSlab>(grid.slabs());
+	float regularisation = .05f;
+
+	parallelForChunks(grid.slabs(), [&](int c) {
+		IsosurfaceSlab &slab = slabs[c];
+		for (int i = grid.slabBegin[c]; i < min(grid.slabBegin[c + 1], grid.res.x); i++)
+			for (int j = 0; j < grid.res.y; j++)
+				for (int k = 0; k < grid.res.z; k++) {
+					ivec3 g = ivec3(i, j, k);
+					mat3 AtA = mat3(0);
+					vec3 Atb = vec3(0), mass = vec3(0);
+					int crossings = 0;
+					for (const auto &[corner, axis]: marchingCubesTable().edges) {
+						ivec3 start = g + CUBE_CORNERS[corner];
+						if (!grid.signChange(start, axis))
+							continue;
+						vec3 p = grid.crossing(start, axis);
+						vec3 n = surf.normal(p);
+						AtA += outerProduct(n, n);
+						Atb += n*dot(n, p);
+						mass += p;
+						crossings++;
+					}
+					if (crossings == 0)
+						continue;
+					mass /= crossings;
+					vec3 x = mass + inverse(AtA + mat3(regularisation))*(Atb - AtA*mass);
+					x = clamp(x, grid.point(g), grid.point(g + ivec3(1)));
+					slab.index[grid.cellKey(g)] = slab.positions.size();
+					slab.positions.push_back(x);
+					slab.normals.push_back(surf.normal(x));
+				}
+	});
+	vector<int> offsets = slabOffsets(slabs);
+	auto cellVertex = [&](ivec3 g) {
+		int owner = grid.planeSlab[g.x];
+		return offsets[owner] + slabs[owner].index.at(grid.cellKey(g));
+	};
+
+	parallelForChunks(grid.slabs(), [&](int c) {
+		IsosurfaceSlab &slab = slabs[c];
+		for (int i = grid.slabBegin[c]; i < grid.slabBegin[c + 1]; i++)
+			for (int j = 0; j <= grid.res.y; j++)
+				for (int k = 0; k <= grid.res.z; k++)
+					for (int axis = 0; axis < 3; axis++) {
+						ivec3 g = ivec3(i, j, k);
+						if (!grid.signChange(g, axis))
+							continue;
+						ivec3 u1 = ivec3(0), u2 = ivec3(0);
+						u1[(axis + 1) % 3] = 1;
+						u2[(axis + 2) % 3] = 1;
+						std::array<ivec3, 4> cells = {g - u1 - u2, g - u2, g, g - u1};
+						if (!std::all_of(cells.begin(), cells.end(), [&](ivec3 cell) { return grid.inCells(cell); }))
+							continue;
+						std::array<int, 4> q;
+						for (int v = 0; v < 4; v++)
+							q[v] = cellVertex(cells[v]);
+						if (grid.value(g) >= 0)
+							std::swap(q[1], q[3]);
+						slab.faces.emplace_back(q[0], q[1], q[2]);
+						slab.faces.emplace_back(q[0], q[2], q[3]);
+					}
+	});
+	return gatherSlabs(slabs, offsets);
+}
+
 AffinePlane::AffinePlane(vec3 n, float d) :
 SmoothImplicitSurface(RealFunctionR3([n, d](vec3 p) {return dot(p, n) - d; }, [n](vec3 p) {return n; })) {
     this->n = normalise(n);
@@ -82,11 +568,14 @@ SmoothParametricCurve::SmoothParametricCurve(Foo13 f, Foo13 df, PolyGroupID id,
 
 SmoothParametricCurve::SmoothParametricCurve(const SmoothParametricCurve &other) :
     _f(other._f), _df(other._df), _ddf(other._ddf), _der_higher(other._der_higher), eps(other.eps), t0(other.t0), t1(other.t1),
-    periodic(other.periodic), id(other.id){}
+    periodic(other.periodic), id(other.id) {
+    std::lock_guard lock(other.arcLengthMutex);
+    _arcLength = other._arcLength;
+}
 
 SmoothParametricCurve::SmoothParametricCurve(SmoothParametricCurve &&other) noexcept :
     _f(std::move(other._f)), _df(std::move(other._df)), _ddf(std::move(other._ddf)), _der_higher(std::move(other._der_higher)),
-    eps(other.eps), t0(other.t0), t1(std::move(other.t1)), periodic(other.periodic), id(other.id) {}
+    eps(other.eps), t0(other.t0), t1(std::move(other.t1)), periodic(other.periodic), id(other.id), _arcLength(std::move(other._arcLength)) {}
 
 SmoothParametricCurve &SmoothParametricCurve::operator=(const SmoothParametricCurve &other) {
     if (this == &other)
@@ -100,6 +589,8 @@ SmoothParametricCurve &SmoothParametricCurve::operator=(const SmoothParametricCu
     t1 = other.t1;
     periodic = other.periodic;
     id = other.id;
+    std::scoped_lock lock(arcLengthMutex, other.arcLengthMutex);
+    _arcLength = other._arcLength;
     return *this;
 }
 SmoothParametricCurve &SmoothParametricCurve::operator=(SmoothParametricCurve &&other) noexcept {
@@ -114,6 +605,7 @@ SmoothParametricCurve &SmoothParametricCurve::operator=(SmoothParametricCurve &&
     t1 = std::move(other.t1);
     periodic = other.periodic;
     id = other.id;
+    _arcLength = std::move(other._arcLength);
     return *this;
 }
 
@@ -159,6 +651,7 @@ void SmoothParametricCurve::precomposeInPlace(SpaceEndomorphism g) {
     this->_f = [f = this->_f, gg=g](float t) {return gg(f(t)); };
     this->_df = [f = this->_f, d = this->_df, g](float t) {return g(f(t)) * d(t); };
     this->_ddf = [f = this->_f, d = this->_df, dd = this->_ddf, gg=g](float t) {return gg(f(t)) * dd(t) + gg.df(f(t)) * d(t); };
+    invalidateArcLengthTable();
 }
 
 vec3 SmoothParametricCurve::operator()(float t) const { return this->_f(t); }
@@ -238,13 +731,31 @@ vec3 ImplicitSurfacePoint::rotateAroundNormal(vec3 q, float angle) const {
 	return projected*cos(angle) + cross(projected, getNormal())*sin(angle);
 }
 
-float TriangulatedImplicitSurface::angle(int i) { return points[i].getAngle(); }
+void SpatialHash::remove(int i, vec3 p) {
+	auto it = cells.find(key(cell(p)));
+	if (it == cells.end())
+		return;
+	vector<int> &bucket = it->second;
+	for (int k = 0; k < bucket.size(); k++)
+		if (bucket[k] == i) {
+			bucket[k] = bucket.back();
+			bucket.pop_back();
+			break;
+		}
+	if (bucket.empty())
+		cells.erase(it);
+}
+
+
+TriangulatedImplicitSurface::TriangulatedImplicitSurface(const RealFunctionR3 &F, int max_iter, HOM(vec3, bool) borderCheck, int NewtonMaxSteps, float NewtonEps)
+: F(F), borderCheck(borderCheck), max_iter(max_iter), NewtonMaxSteps(NewtonMaxSteps), NewtonEps(NewtonEps) {}
 
 
 ImplicitSurfacePoint TriangulatedImplicitSurface::projectOnSurface(vec3 p) {
 	vec3 last_q = p;
 	for (int i = 0; i < NewtonMaxSteps; i++) {
-		vec3 q = last_q - F.df(last_q)*F(last_q)/norm2(F.df(last_q));
+		vec3 g = F.df(last_q);
+		vec3 q = last_q - g*F(last_q)/norm2(g);
 		if (norm(q - last_q) < NewtonEps) {
 			last_q = q;
 			break;
@@ -254,68 +765,244 @@ ImplicitSurfacePoint TriangulatedImplicitSurface::projectOnSurface(vec3 p) {
 	return constructPoint(last_q);
 }
 
+// frame columns are (t1, t2, normal) with t1 x t2 = normal
 ImplicitSurfacePoint TriangulatedImplicitSurface::constructPoint(vec3 p) {
 	vec3 normal = normalise(F.df(p));
 	vec3 t1;
-	if (normal.x > .5 || normal.y>.5)
+	if (std::abs(normal.x) > .5 || std::abs(normal.y) > .5)
 		t1 = normalise(vec3(normal.y, -normal.x, 0));
 	else
 		t1 = normalise(vec3(-normal.z, 0, normal.x));
 	vec3 t2 = cross(normal, t1);
-	return ImplicitSurfacePoint(p, mat3(normal, t1, t2), age, borderCheck(p));
+	return ImplicitSurfacePoint(p, mat3(t1, t2, normal), age, borderCheck(p));
 }
 
 
-void TriangulatedImplicitSurface::initialiseHexagon(vec3 p0, float len) {
-	points = {projectOnSurface(p0)};
-	for (int i = 0; i < 6; i++) {
-		vec3 p = p0 + len*cos(i*TAU / 6)*vec3(1, 0, 0) + len*sin(i*TAU / 6)*vec3(0, 1, 0);
-		points.push_back(projectOnSurface(p));
-	}
-	polygons = {{1, 2, 3, 4, 5, 6}};
+int TriangulatedImplicitSurface::addNode(int point, int polygon) {
+	front.push_back(FrontNode{point, -1, -1, polygon});
+	frontHash.insert(front.size() - 1, points[point].getPosition());
+	polygonSize[polygon]++;
+	return front.size() - 1;
 }
 
-
-void TriangulatedImplicitSurface::expandFrontPolygon() { throw std::logic_error("Not implemented"); }
-
-
-void TriangulatedImplicitSurface::calculateMissingAngles() {
+void TriangulatedImplicitSurface::removeNode(int node) {
+	front[node].alive = false;
+	frontHash.remove(node, position(node));
+	polygonSize[front[node].polygon]--;
 }
 
+void TriangulatedImplicitSurface::relabelPolygon(int node, int polygon) {
+	int n = node;
+	do {
+		polygonSize[front[n].polygon]--;
+		polygonSize[polygon]++;
+		front[n].polygon = polygon;
+		n = front[n].next;
+	} while (n != node);
+}
 
-void TriangulatedImplicitSurface::calculateAngle(int i) {
-	int ind_p = polygons[0][i];
-	vec3 p = points[ind_p].getPosition();
-	vec3 r = points[polygons[0][(i + 1) % 6]].getPosition();
-	vec3 q = points[polygons[0][(i - 1 + polygons[0].size()) % 6]].getPosition();
-	vec3 v1 = q-p;
-	vec3 v2 = r-p;
-	float angle = acos(dot(v1, v2) / (norm(v1)*norm(v2)));
-	if (dot(cross(v1, v2), points[ind_p].getNormal()) < 0)
-		angle = TAU - angle;
-	points[ind_p].setAngle(angle);
+// polygons of at most three nodes are filled with their triangle and dropped from the front
+void TriangulatedImplicitSurface::closeSmallPolygon(int node) {
+	int polygon = front[node].polygon;
+	if (polygonSize[polygon] > 3)
+		return;
+	if (polygonSize[polygon] == 3)
+		triangles.emplace_back(front[node].point, front[front[node].prev].point, front[front[node].next].point);
+	int n = node;
+	vector<int> nodes = {};
+	do {
+		nodes.push_back(n);
+		n = front[n].next;
+	} while (n != node);
+	for (int m: nodes)
+		removeNode(m);
 }
 
+
+void TriangulatedImplicitSurface::initialiseHexagon(vec3 p0, float len) {
+	this->len = len;
+	points = {projectOnSurface(p0)};
+	triangles = {};
+	front = {};
+	polygonSize = {0};
+	frontHash = SpatialHash(len);
+	angleQueue = {};
+	vec3 center = points[0].getPosition();
+	for (int i = 0; i < 6; i++) {
+		vec3 p = center + len*cos(i*TAU / 6)*points[0].getTangent1() + len*sin(i*TAU / 6)*points[0].getTangent2();
+		points.push_back(projectOnSurface(p));
+		triangles.emplace_back(0, i + 1, (i + 1) % 6 + 1);
+		addNode(i + 1, 0);
+	}
+	for (int i = 0; i < 6; i++)
+		link(i, (i + 1) % 6);
+	for (int i = 0; i < 6; i++)
+		calculateAngle(i);
+}
+
+
+// exterior angle at the node, counterclockwise around the normal from prev to next; queued unless the point is on the border
+void TriangulatedImplicitSurface::calculateAngle(int node) {
+	FrontNode &n = front[node];
+	vec3 p = position(node);
+	vec3 normal = points[n.point].getNormal();
+	vec3 v1 = position(n.prev) - p;
+	vec3 v2 = position(n.next) - p;
+	v1 -= normal*dot(v1, normal);
+	v2 -= normal*dot(v2, normal);
+	float angle = atan2(dot(cross(v1, v2), normal), dot(v1, v2));
+	n.angle = angle < 0 ? angle + TAU : angle;
+	n.stamp++;
+	if (!points[n.point].border)
+		angleQueue.emplace(n.angle, node, n.stamp);
+}
+
+// node with the smallest exterior angle, outdated queue entries are skipped; -1 when nothing is left to expand
 int TriangulatedImplicitSurface::minAngleIndex() {
-	int minInd = 0;
-	float minAngle = TAU;
-	for (int i = 0; i < polygons[0].size(); i++) {
-			int ind = polygons[0][i];
-			if (points[ind].getAngle() < minAngle && !points[ind].border) {
-				minAngle = points[ind].getAngle();
-				minInd = ind;
-			}
+	while (!angleQueue.empty()) {
+		auto [angle, node, stamp] = angleQueue.top();
+		angleQueue.pop();
+		if (front[node].alive && front[node].stamp == stamp)
+			return node;
+	}
+	return -1;
+}
+
+
+// closest front node within len lying inside the exterior angle of node, excluding its neighbours
+int TriangulatedImplicitSurface::nearbyFrontNode(int node) {
+	const FrontNode &n = front[node];
+	vec3 p = position(node);
+	vec3 normal = points[n.point].getNormal();
+	vec3 d0 = position(n.prev) - p;
+	d0 = normalise(d0 - normal*dot(d0, normal));
+	vec3 bisector = d0*cos(n.angle/2) + cross(normal, d0)*sin(n.angle/2);
+
+	int best = -1;
+	float bestDist = len;
+	frontHash.forEachNear(p, len, [&](int m) {
+		const FrontNode &o = front[m];
+		if (m == node || m == n.prev || m == n.next || o.point == n.point || o.point == front[n.prev].point || o.point == front[n.next].point)
+			return;
+		vec3 q = position(m);
+		float d = norm(q - p);
+		if (d < bestDist && dot(q - p, bisector) > 0) {
+			best = m;
+			bestDist = d;
+		}
+	});
+	return best;
+}
+
+// node -> ... -> other -> node and copies other' -> ... -> node' -> other', the bridge is a front edge of both
+void TriangulatedImplicitSurface::splitFrontPolygon(int node, int other) {
+	int nodePrev = front[node].prev, otherNext = front[other].next;
+	polygonSize.push_back(0);
+	int nodeCopy = addNode(front[node].point, front[node].polygon);
+	int otherCopy = addNode(front[other].point, front[node].polygon);
+	link(other, node);
+	link(nodePrev, nodeCopy);
+	link(nodeCopy, otherCopy);
+	link(otherCopy, otherNext);
+	relabelPolygon(nodeCopy, polygonSize.size() - 1);
+
+	for (int m: {node, other, nodeCopy, otherCopy})
+		calculateAngle(m);
+	closeSmallPolygon(node);
+	closeSmallPolygon(nodeCopy);
+}
+
+// node -> other -> ... -> other' -> node' -> ..., the other polygon joins the polygon of node
+void TriangulatedImplicitSurface::mergeFrontPolygons(int node, int other) {
+	int nodeNext = front[node].next, otherPrev = front[other].prev;
+	int polygon = front[node].polygon;
+	relabelPolygon(other, polygon);
+	int nodeCopy = addNode(front[node].point, polygon);
+	int otherCopy = addNode(front[other].point, polygon);
+	link(node, other);
+	link(otherPrev, otherCopy);
+	link(otherCopy, nodeCopy);
+	link(nodeCopy, nodeNext);
+
+	for (int m: {node, other, nodeCopy, otherCopy})
+		calculateAngle(m);
+}
+
+// fills the exterior angle with triangles of edge ~len, new points are projected from the tangent plane onto the surface
+void TriangulatedImplicitSurface::expandFrontPolygon(int node) {
+	FrontNode n = front[node];
+	vec3 p = position(node);
+	vec3 normal = points[n.point].getNormal();
+	float omega = n.angle;
+	int nt = static_cast<int>(3*omega/PI) + 1;
+	if (omega/nt < .8f && nt > 1)
+		nt--;
+	if (omega < 3 && (norm(position(n.prev) - p) <= .5f*len || norm(position(n.next) - p) <= .5f*len))
+		nt = 1;
+
+	age++;
+	removeNode(node);
+	if (nt == 1) {
+		triangles.emplace_back(n.point, front[n.prev].point, front[n.next].point);
+		link(n.prev, n.next);
+	} else {
+		vec3 d0 = position(n.prev) - p;
+		d0 = normalise(d0 - normal*dot(d0, normal));
+		vec3 d1 = cross(normal, d0);
+		int last = n.prev;
+		for (int k = 1; k < nt; k++) {
+			float a = k*omega/nt;
+			points.push_back(projectOnSurface(p + len*(d0*cos(a) + d1*sin(a))));
+			int m = addNode(points.size() - 1, n.polygon);
+			triangles.emplace_back(n.point, front[last].point, front[m].point);
+			link(last, m);
+			last = m;
 		}
-	return minInd;
+		triangles.emplace_back(n.point, front[last].point, front[n.next].point);
+		link(last, n.next);
+		for (int m = front[n.prev].next; m != n.next; m = front[m].next)
+			calculateAngle(m);
+	}
+	calculateAngle(n.prev);
+	calculateAngle(n.next);
+	closeSmallPolygon(n.prev);
+}
+
+bool TriangulatedImplicitSurface::step() {
+	int node = minAngleIndex();
+	if (node < 0)
+		return false;
+	int other = nearbyFrontNode(node);
+	if (other < 0)
+		expandFrontPolygon(node);
+	else if (front[other].polygon == front[node].polygon)
+		splitFrontPolygon(node, other);
+	else
+		mergeFrontPolygons(node, other);
+	return true;
 }
 
+void TriangulatedImplicitSurface::generate() {
+	for (int i = 0; i < max_iter && step(); i++) {}
+}
 
+IsosurfaceMesh TriangulatedImplicitSurface::mesh() const {
+	IsosurfaceMesh res;
+	res.positions.reserve(points.size());
+	res.normals.reserve(points.size());
+	for (const auto &p: points) {
+		res.positions.push_back(p.getPosition());
+		res.normals.push_back(p.getNormal());
+	}
+	res.faces = triangles;
+	return res;
+}
 
-void TriangulatedImplicitSurface::checkFrontPolygonSelfIntersections() { throw std::logic_error("Not implemented"); }
-void TriangulatedImplicitSurface::checkFrontPolygonIntersectionWithPolygon(int i) { throw std::logic_error("Not implemented"); }
-
-
-void TriangulatedImplicitSurface::expandFrontPolygon(int i) { throw std::logic_error("Not implemented"); }
+IsosurfaceMesh TriangulatedImplicitSurface::compute(vec3 p0, float len) {
+	initialiseHexagon(p0, len);
+	generate();
+	return mesh();
+}
 
 
 AffinePlane SmoothParametricCurve::osculatingPlane(float t) const {
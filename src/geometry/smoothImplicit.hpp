@@ -1,7 +1,11 @@
 #pragma once
 #include <array>
 
+#include <cstdint>
 #include <iosfwd>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -12,14 +16,84 @@
 class AffineLine;
 class TriangulatedImplicitSurface;
 class WeakSuperMesh;
+// summary of a batched Newton projection
+struct ProjectionStats {
+    int points = 0;
+    int converged = 0;
+    int stalled = 0; // vanishing gradient
+    long totalIterations = 0;
+    int maxIterations = 0;
+    float maxResidual = 0; // |F - level| at the last evaluation of each point
+
+    float meanIterations() const { return points > 0 ? 1.f*totalIterations/points : 0; }
+    ProjectionStats& operator+=(const ProjectionStats &other);
+};
+
 // R3 -> R
 class SmoothImplicitSurface {
     RealFunctionR3 _F;
 public:
     explicit SmoothImplicitSurface(const RealFunctionR3 &F);
     float operator()(vec3 p) const;
+    vec3 gradient(vec3 p) const { return _F.df(p); }
+    vec3 normal(vec3 p) const { return normalise(_F.df(p)); }
+    const RealFunctionR3& function() const { return _F; }
+    SmoothImplicitSurface cached(vec3 boxMin, vec3 boxMax, float h, float band, float lipschitz=-1) const;
+
+    // Newton steps x -= (F(x) - level) grad F / |grad F|^2 in place, in parallel chunks of lanes advanced in lockstep
+    // with per-point convergence masks; converged (if given) gets 1 for points whose last step was shorter than eps
+    ProjectionStats project(std::vector<vec3> &points, float level=0, int maxSteps=20, float eps=1e-6f, std::vector<char> *converged=nullptr) const;
+    vec3 project(vec3 p, float level=0, int maxSteps=20, float eps=1e-6f) const;
 };
 
+
+// F and its gradient sampled on a grid of spacing h in the box, stored only in bricks of brickSize^3 cells that can meet
+// the band {|F| <= band}, decided from the value at the brick centre and a Lipschitz bound (estimated from the centre gradients
+// if not given). Lookups in stored bricks interpolate trilinearly, in pruned bricks return the centre value (of the right sign,
+// at least band in absolute value) and outside of the box fall back to F.
+class SparseFieldCache {
+    RealFunctionR3 F;
+    vec3 boxMin;
+    float h;
+    float band;
+    int brickSize;
+    ivec3 bricks;
+    std::vector<int> brickSlot = {};
+    std::vector<float> centreValues = {};
+    std::vector<float> values = {};
+    std::vector<vec3> gradients = {};
+
+    int samplesPerBrick() const { return (brickSize + 1)*(brickSize + 1)*(brickSize + 1); }
+    int brickIndex(ivec3 b) const { return (b.x*bricks.y + b.y)*bricks.z + b.z; }
+    bool locate(vec3 p, int &brick, vec3 &local) const;
+
+public:
+    SparseFieldCache(const RealFunctionR3 &F, vec3 boxMin, vec3 boxMax, float h, float band, float lipschitz=-1, int brickSize=8);
+
+    float operator()(vec3 p) const;
+    vec3 df(vec3 p) const;
+    bool cached(vec3 p) const;
+    int storedBricks() const { return values.size()/samplesPerBrick(); }
+    int totalBricks() const { return brickSlot.size(); }
+    size_t memory() const { return values.size()*sizeof(float) + gradients.size()*sizeof(vec3) + brickSlot.size()*(sizeof(int) + sizeof(float)); }
+    // the function shares the cache; called on a temporary it takes the samples over instead of copying them
+    RealFunctionR3 function() const &;
+    RealFunctionR3 function() &&;
+};
+
+
+// indexed triangles with normals along the gradient, i.e. towards {F > level}
+struct IsosurfaceMesh {
+    std::vector<vec3> positions;
+    std::vector<vec3> normals;
+    std::vector<ivec3> faces;
+};
+
+// both work on resolution.x * resolution.y * resolution.z cells of the box, in parallel slabs along x;
+// vertices on cell edges (marching cubes) or in cells (dual contouring) are shared between all triangles using them
+IsosurfaceMesh marchingCubes(const SmoothImplicitSurface &surf, vec3 boxMin, vec3 boxMax, ivec3 resolution, float level=0);
+IsosurfaceMesh dualContouring(const SmoothImplicitSurface &surf, vec3 boxMin, vec3 boxMax, ivec3 resolution, float level=0);
+
 class AffinePlane : public SmoothImplicitSurface {
     vec3 n;
     float d; // (n, x) - d = 0
@@ -81,6 +155,51 @@ public:
 };
 
 
+// uniform grid over indexed points, cells of side cellSize; queries within radius ~ cellSize are O(1) expected
+class SpatialHash {
+	float cellSize;
+	std::unordered_map<int64_t, std::vector<int>> cells = {};
+
+	static int64_t key(ivec3 c) { return (static_cast<int64_t>(c.x & 0x1FFFFF) << 42) | (static_cast<int64_t>(c.y & 0x1FFFFF) << 21) | (c.z & 0x1FFFFF); }
+
+public:
+	explicit SpatialHash(float cellSize) : cellSize(cellSize) {}
+
+	ivec3 cell(vec3 p) const { return ivec3(floor(p/cellSize)); }
+	void insert(int i, vec3 p) { cells[key(cell(p))].push_back(i); }
+	void remove(int i, vec3 p);
+	void clear() { cells.clear(); }
+	void reserve(int n) { cells.reserve(n); }
+
+	// calls f(i) for every point in the cells meeting the cube of side 2*radius around p, caller filters by distance
+	template<typename F>
+	void forEachNear(vec3 p, float radius, F &&f) const {
+		ivec3 lo = cell(p - vec3(radius)), hi = cell(p + vec3(radius));
+		for (int x = lo.x; x <= hi.x; x++)
+			for (int y = lo.y; y <= hi.y; y++)
+				for (int z = lo.z; z <= hi.z; z++) {
+					auto it = cells.find(key(ivec3(x, y, z)));
+					if (it != cells.end())
+						for (int i: it->second)
+							f(i);
+				}
+	}
+};
+
+
+// node of a front polygon; a point can sit on several fronts (or twice on one) after splits and merges
+struct FrontNode {
+	int point;
+	int prev, next;
+	int polygon;
+	float angle = 0;
+	int stamp = 0;
+	bool alive = true;
+};
+
+
+// advancing front (marching triangles) with target edge length len: repeatedly expands the front node with
+// the smallest exterior angle, splitting or merging front polygons when a node gets closer than len to another part of the front
 class TriangulatedImplicitSurface {
 	RealFunctionR3 F;
 	HOM(vec3, bool) borderCheck;
@@ -88,29 +207,38 @@ class TriangulatedImplicitSurface {
 	int NewtonMaxSteps;
 	float NewtonEps;
 	int age = 0;
+	float len = 1;
 	std::vector<ImplicitSurfacePoint> points = {};
 	vector<ivec3> triangles = {};
-	vector<vector<int>> polygons = {};
-
-	float angle(int i);
+	vector<FrontNode> front = {};
+	vector<int> polygonSize = {};
+	SpatialHash frontHash = SpatialHash(1);
+	std::priority_queue<std::tuple<float, int, int>, vector<std::tuple<float, int, int>>, std::greater<>> angleQueue = {};
+
+	vec3 position(int node) const { return points[front[node].point].getPosition(); }
+	int addNode(int point, int polygon);
+	void removeNode(int node);
+	void link(int a, int b) { front[a].next = b; front[b].prev = a; }
+	void relabelPolygon(int node, int polygon);
+	void closeSmallPolygon(int node);
 
 public:
-	TriangulatedImplicitSurface(const RealFunctionR3 &F, int max_iter, HOM(vec3, bool) borderCheck, int NewtonMaxSteps, float NewtonEps);
+	TriangulatedImplicitSurface(const RealFunctionR3 &F, int max_iter=1000000, HOM(vec3, bool) borderCheck=[](vec3) { return false; }, int NewtonMaxSteps=10, float NewtonEps=1e-6f);
 
 	ImplicitSurfacePoint projectOnSurface(vec3 p);
 	ImplicitSurfacePoint constructPoint(vec3 p);
 
 	void initialiseHexagon(vec3 p0, float len);
-	void expandFrontPolygon();
-	void calculateMissingAngles();
-	void calculateAngle(int i);
+	void calculateAngle(int node);
 	int minAngleIndex();
 
-	void checkFrontPolygonSelfIntersections();
-	void checkFrontPolygonIntersectionWithPolygon(int i);
-	void expandFrontPolygon(int i);
-	void step();
+	int nearbyFrontNode(int node);
+	void splitFrontPolygon(int node, int other);
+	void mergeFrontPolygons(int node, int other);
+	void expandFrontPolygon(int node);
+	bool step();
 
 	void generate();
-
+	IsosurfaceMesh mesh() const;
+	IsosurfaceMesh compute(vec3 p0, float len);
 };
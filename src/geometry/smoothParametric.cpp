@@ -1,4 +1,5 @@
 #include "smoothParametric.hpp"
+#include "src/fundamentals/quadrature.hpp"
 #include <map>
 #include <glm/gtc/constants.hpp>
 #include <utility>
@@ -67,10 +68,145 @@ mat3 SmoothParametricSurface::DarbouxFrame(float t, float s) const { throw std::
 mat2 SmoothParametricSurface::changeOfTangentBasisToPrincipal(float t, float s) const { throw std::logic_error("Not implemented"); }
 mat2 SmoothParametricSurface::changeOfPrincipalBasisToStandard(float t, float s) const { throw std::logic_error("Not implemented"); }
 mat2x3 SmoothParametricSurface::tangentSpacePrincipalBasis(float t, float s) const { throw std::logic_error("Not implemented"); }
-float SmoothParametricSurface::globalAreaIntegral(const RealFunctionPS &f) const { throw std::logic_error("Not implemented"); }
-float SmoothParametricSurface::DirichletFunctional() const { throw std::logic_error("Not implemented"); }
+float SmoothParametricSurface::globalAreaIntegral(const RealFunctionPS &f, float tolerance, ExecutionMode mode) const {
+	return integrateRectangle([this, &f](float t, float s) { return f(t, s)*std::sqrt(std::abs(determinant(metricTensor(t, s)))); }, boundsT(), boundsU(), tolerance, 6, 8, 5, mode);
+}
+
+float SmoothParametricSurface::area(float tolerance, ExecutionMode mode) const {
+	return integrateRectangle([this](float t, float s) { return std::sqrt(std::abs(determinant(metricTensor(t, s)))); }, boundsT(), boundsU(), tolerance, 6, 8, 5, mode);
+}
+
+// Dirichlet energy of the parametrisation, 1/2 int |f_t|^2 + |f_u|^2 dt du
+float SmoothParametricSurface::DirichletFunctional(float tolerance, ExecutionMode mode) const {
+	return integrateRectangle([this](float t, float s) { return (norm2(_df_t(t, s)) + norm2(_df_u(t, s)))/2; }, boundsT(), boundsU(), tolerance, 6, 8, 5, mode);
+}
 float SmoothParametricSurface::biharmonicFunctional() const { throw std::logic_error("Not implemented"); }
 
+float RealFunctionPS::operator()(float t, float s) const { return _f(t, s); }
+
+
+SurfaceProjector::SurfaceProjector(const SmoothParametricSurface &surface, int tRes, int uRes)
+: surface(surface), tRes(tRes), uRes(uRes) {
+	samples.reserve(tRes*uRes);
+	params.reserve(tRes*uRes);
+	vec3 lo = vec3(INFINITY), hi = vec3(-INFINITY);
+	for (float t: linspace(surface.tMin(), surface.tMax(), tRes))
+		for (float u: linspace(surface.uMin(), surface.uMax(), uRes)) {
+			samples.push_back(surface(t, u));
+			params.emplace_back(t, u);
+			lo = min(lo, samples.back());
+			hi = max(hi, samples.back());
+		}
+
+	// roughly one sample per cell
+	vec3 extent = max(hi - lo, vec3(1e-6f));
+	cellSize = max(std::cbrt(extent.x*extent.y*extent.z/samples.size()), max(max(extent.x, extent.y), extent.z)/256);
+	gridOrigin = lo;
+	gridSize = ivec3(extent/cellSize) + ivec3(1);
+
+	cellStart = vector<int>(gridSize.x*gridSize.y*gridSize.z + 1, 0);
+	for (vec3 p: samples)
+		cellStart[cellIndex(cellOf(p)) + 1]++;
+	for (int i = 1; i < cellStart.size(); i++)
+		cellStart[i] += cellStart[i-1];
+	cellItems = vector<int>(samples.size());
+	vector<int> fill = cellStart;
+	for (int i = 0; i < samples.size(); i++)
+		cellItems[fill[cellIndex(cellOf(samples[i]))]++] = i;
+}
+
+ivec3 SurfaceProjector::cellOf(vec3 p) const {
+	return clamp(ivec3(floor((p - gridOrigin)/cellSize)), ivec3(0), gridSize - ivec3(1));
+}
+
+vec2 SurfaceProjector::wrapOrClamp(vec2 tu) const {
+	if (surface.isPeriodicT())
+		tu.x = surface.tMin() + mod(tu.x - surface.tMin(), surface.periodT());
+	else
+		tu.x = clamp(tu.x, surface.tMin(), surface.tMax());
+	if (surface.isPeriodicU())
+		tu.y = surface.uMin() + mod(tu.y - surface.uMin(), surface.periodU());
+	else
+		tu.y = clamp(tu.y, surface.uMin(), surface.uMax());
+	return tu;
+}
+
+// cells are visited in growing cubic shells until the shell is further than the best sample found;
+// p - q is orthogonal to the box at the projection q of p, so an unvisited sample s has |s - p|^2 >= |s - q|^2 + |p - q|^2
+vec2 SurfaceProjector::initialGuess(vec3 p) const {
+	ivec3 c = cellOf(p);
+	float outside = norm(p - clamp(p, gridOrigin, gridOrigin + vec3(gridSize)*cellSize));
+	int best = -1;
+	float bestDist = INFINITY;
+	int maxRadius = max(max(gridSize.x, gridSize.y), gridSize.z);
+	for (int r = 0; r <= maxRadius; r++) {
+		float shell = (r - 1)*cellSize;
+		if (best >= 0 && r > 0 && shell*shell + outside*outside > bestDist*bestDist)
+			break;
+		for (int i = c.x - r; i <= c.x + r; i++)
+			for (int j = c.y - r; j <= c.y + r; j++)
+				for (int k = c.z - r; k <= c.z + r; k++) {
+					if (max(max(abs(i - c.x), abs(j - c.y)), abs(k - c.z)) != r)
+						continue;
+					if (i < 0 || j < 0 || k < 0 || i >= gridSize.x || j >= gridSize.y || k >= gridSize.z)
+						continue;
+					int cell = cellIndex(ivec3(i, j, k));
+					for (int s = cellStart[cell]; s < cellStart[cell + 1]; s++) {
+						float d = norm(samples[cellItems[s]] - p);
+						if (d < bestDist) {
+							bestDist = d;
+							best = cellItems[s];
+						}
+					}
+				}
+	}
+	return params[best];
+}
+
+vec2 SurfaceProjector::refine(vec3 p, vec2 tu, int maxIter, float eps) const {
+	for (int i = 0; i < maxIter; i++) {
+		vec3 r = surface(tu) - p;
+		mat2x3 J = surface.tangentStandardBasis(tu.x, tu.y);
+		vec2 grad = vec2(dot(J[0], r), dot(J[1], r));
+		mat2 H = mat2(dot(J[0], J[0]), dot(J[0], J[1]), dot(J[0], J[1]), dot(J[1], J[1]));
+		mat2 Hfull = H + mat2(dot(surface.d2f_tt(tu.x, tu.y), r), dot(surface.d2f_tu(tu.x, tu.y), r),
+							  dot(surface.d2f_tu(tu.x, tu.y), r), dot(surface.d2f_uu(tu.x, tu.y), r));
+		// fall back to Gauss-Newton where the full Hessian is not positive definite
+		if (Hfull[0][0] > 0 && determinant(Hfull) > 1e-12f)
+			H = Hfull;
+		if (abs(determinant(H)) < 1e-12f)
+			break;
+		vec2 step = inverse(H)*grad;
+		tu = wrapOrClamp(tu - step);
+		if (norm(step) < eps)
+			break;
+	}
+	return tu;
+}
+
+vec2 SurfaceProjector::project(vec3 p, int maxIter, float eps) const {
+	return refine(p, initialGuess(p), maxIter, eps);
+}
+
+vector<vec2> SurfaceProjector::project(const vector<vec3> &points, int maxIter, float eps) const {
+	vector<vec2> res = vector<vec2>(points.size());
+	parallelFor(points.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			res[i] = project(points[i], maxIter, eps);
+	}, 64);
+	return res;
+}
+
+vector<vec3> SurfaceProjector::closestPoints(const vector<vec3> &points, int maxIter, float eps) const {
+	vector<vec2> tu = project(points, maxIter, eps);
+	vector<vec3> res = vector<vec3>(points.size());
+	parallelFor(points.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			res[i] = surface(tu[i]);
+	}, 256);
+	return res;
+}
+
 mat2 SmoothParametricSurface::metricTensor(float t, float s) const {
 	vec3 p = _df_t(t, s);
 	vec3 q = _df_u(t, s);
@@ -243,6 +379,167 @@ SmoothParametricCurve::SmoothParametricCurve(const RealFunctionR1& fx, const Rea
 	[fx, fy, fz](float t) {return vec3(fx.ddf(t), fy.ddf(t), fz.ddf(t)); }, std::move(id), t0, t1, periodic, epsilon) {}
 
 
+namespace {
+	float hermite(float y0, float y1, float m0, float m1, float h, float u) {
+		float u2 = u*u, u3 = u2*u;
+		return (2*u3 - 3*u2 + 1)*y0 + (u3 - 2*u2 + u)*h*m0 + (-2*u3 + 3*u2)*y1 + (u3 - u2)*h*m1;
+	}
+
+	// Fritsch-Carlson limiter, keeps the interpolant monotone on every interval
+	void limitSlopes(const vector<float> &x, const vector<float> &y, vector<float> &m) {
+		for (int i = 0; i + 1 < x.size(); i++) {
+			float secant = (y[i+1] - y[i])/(x[i+1] - x[i]);
+			if (secant <= 0 || !std::isfinite(secant)) {
+				m[i] = 0;
+				m[i+1] = 0;
+				continue;
+			}
+			float a = m[i]/secant, b = m[i+1]/secant;
+			if (!std::isfinite(a) || !std::isfinite(b)) {
+				m[i] = secant;
+				m[i+1] = secant;
+				continue;
+			}
+			if (a*a + b*b > 9) {
+				float tau = 3/std::sqrt(a*a + b*b);
+				m[i] = tau*a*secant;
+				m[i+1] = tau*b*secant;
+			}
+		}
+	}
+}
+
+ArcLengthTable::ArcLengthTable(const Foo13 &df, float t0, float t1, bool periodic, int n, float tolerance)
+: t0(t0), dt((t1 - t0)/n), periodic(periodic) {
+	Fooo speed = [df](float t) { return norm(df(t)); };
+	vector<float> speeds = {};
+	s.reserve(n+1);
+	speeds.reserve(n+1);
+	s.push_back(0);
+	speeds.push_back(speed(t0));
+	for (int i = 0; i < n; i++) {
+		s.push_back(s.back() + integrateGaussKronrod(speed, t0 + dt*i, t0 + dt*(i+1), tolerance, 4));
+		speeds.push_back(speed(t0 + dt*(i+1)));
+	}
+	vector<float> t = linspace(t0, t1, n+1);
+	ds_dt = speeds;
+	limitSlopes(t, s, ds_dt);
+	dt_ds = vector<float>(n+1);
+	for (int i = 0; i <= n; i++)
+		dt_ds[i] = speeds[i] > 1e-9f ? 1/speeds[i] : INFINITY;
+	limitSlopes(s, t, dt_ds);
+}
+
+float ArcLengthTable::arcLength(float t) const {
+	float period = t1() - t0;
+	float turns = 0;
+	if (periodic) {
+		turns = std::floor((t - t0)/period);
+		t -= turns*period;
+	}
+	int n = s.size() - 1;
+	int i = std::clamp(static_cast<int>(std::floor((t - t0)/dt)), 0, n-1);
+	return turns*totalLength() + hermite(s[i], s[i+1], ds_dt[i], ds_dt[i+1], dt, (t - t0)/dt - i);
+}
+
+float ArcLengthTable::parameter(float len) const {
+	float period = t1() - t0;
+	float turns = 0;
+	if (periodic) {
+		turns = std::floor(len/totalLength());
+		len -= turns*totalLength();
+	}
+	int n = s.size() - 1;
+	int i = std::clamp(static_cast<int>(std::upper_bound(s.begin(), s.end(), len) - s.begin()) - 1, 0, n-1);
+	float h = s[i+1] - s[i];
+	if (h <= 0)
+		return turns*period + t0 + dt*i;
+	return turns*period + hermite(t0 + dt*i, t0 + dt*(i+1), dt_ds[i], dt_ds[i+1], h, (len - s[i])/h);
+}
+
+vector<mat3> rotationMinimisingFrames(const vector<vec3> &points, const vector<vec3> &tangents, vec3 initialNormal, bool closed) {
+	vector<mat3> frames = {};
+	if (points.empty())
+		return frames;
+	frames.reserve(points.size());
+	vec3 t = normalise(tangents[0]);
+	vec3 r = normalise(initialNormal - dot(initialNormal, t)*t);
+	if (norm(r) < 1e-6)
+		r = orthogonalComplementBasis(t).first;
+	frames.emplace_back(t, r, cross(t, r));
+
+	for (int i = 0; i + 1 < points.size(); i++) {
+		vec3 v1 = points[i+1] - points[i];
+		float c1 = dot(v1, v1);
+		vec3 rL = r, tL = t;
+		if (c1 > 1e-12) {
+			rL = r - (2/c1)*dot(v1, r)*v1;
+			tL = t - (2/c1)*dot(v1, t)*v1;
+		}
+		vec3 t1 = normalise(tangents[i+1]);
+		vec3 v2 = t1 - tL;
+		float c2 = dot(v2, v2);
+		r = c2 > 1e-12 ? rL - (2/c2)*dot(v2, rL)*v2 : rL;
+		r = normalise(r - dot(r, t1)*t1);
+		t = t1;
+		frames.emplace_back(t, r, cross(t, r));
+	}
+
+	if (closed && frames.size() > 1) {
+		mat3 first = frames.front(), last = frames.back();
+		float holonomy = atan2(dot(cross(last[1], first[1]), last[0]), dot(last[1], first[1]));
+		for (int i = 1; i < frames.size(); i++) {
+			float phi = holonomy*i/(frames.size() - 1);
+			vec3 n = frames[i][1]*cos(phi) + frames[i][2]*sin(phi);
+			frames[i] = mat3(frames[i][0], n, cross(frames[i][0], n));
+		}
+	}
+	return frames;
+}
+
+vector<mat3> SmoothParametricCurve::rotationMinimisingFrames(const vector<float> &params, bool closed) const {
+	vector<vec3> points = {}, tangents = {};
+	points.reserve(params.size());
+	tangents.reserve(params.size());
+	for (float t: params) {
+		points.push_back(_f(t));
+		tangents.push_back(_df(t));
+	}
+	vec3 n0 = cross(tangents.front(), binormal(params.front()));
+	if (!std::isfinite(n0.x) || norm(n0) < 1e-6)
+		n0 = orthogonalComplementBasis(tangents.front()).first;
+	return ::rotationMinimisingFrames(points, tangents, n0, closed);
+}
+
+vector<mat3> SmoothParametricCurve::rotationMinimisingFrames(const vector<float> &params) const {
+	if (!periodic || params.size() < 2)
+		return rotationMinimisingFrames(params, false);
+	float eps = 1e-4f*std::abs(t1 - t0);
+	bool fullPeriod = std::abs(params.front() - t0) < eps && std::abs(params.back() - t1) < eps;
+	vec3 a = _f(params.front()), b = _f(params.back());
+	return rotationMinimisingFrames(params, fullPeriod && norm(a - b) < 1e-4f*(1 + norm(a)));
+}
+
+std::shared_ptr<ArcLengthTable> SmoothParametricCurve::arcLengthTable() const {
+	std::lock_guard lock(arcLengthMutex);
+	if (_arcLength == nullptr)
+		_arcLength = make_shared<ArcLengthTable>(_df, t0, t1, periodic);
+	return _arcLength;
+}
+
+void SmoothParametricCurve::invalidateArcLengthTable() {
+	std::lock_guard lock(arcLengthMutex);
+	_arcLength = nullptr;
+}
+
+SmoothParametricCurve SmoothParametricCurve::arcLengthParametrization() const {
+	auto table = arcLengthTable();
+	return SmoothParametricCurve([f=_f, table](float s) { return f(table->parameter(s)); },
+								 [df=_df, table](float s) { return normalise(df(table->parameter(s))); },
+								 id, 0, table->totalLength(), periodic, eps);
+}
+
+
 SmoothParametricSurface SmoothParametricCurve::surfaceOfRevolution(const AffineLine& axis) const
 {
 	Foo113 param = [f = _f, axis](float t, float s) {
@@ -2,11 +2,13 @@
 
 // #include <utility>
 
+#include <mutex>
 #include <utility>
 
 //#include <src/common/indexedRendering.hpp>
 
 #include "hyperbolic.hpp"
+#include "src/fundamentals/parallel.hpp"
 //#include "glm/glm.hpp"
 // #include "planarGeometry.hpp"
 
@@ -18,6 +20,23 @@ class RealFunctionPS;
 class Differential1FormPS;
 class Differential2FormPS;
 
+// cumulative arc length s(t) sampled on a uniform grid in t, node values integrated by adaptive Gauss-Kronrod;
+// both s(t) and its inverse t(s) are evaluated by monotone cubic Hermite interpolation with slopes |c'(t)|
+class ArcLengthTable {
+	float t0, dt;
+	bool periodic;
+	std::vector<float> s;
+	std::vector<float> ds_dt, dt_ds;
+public:
+	ArcLengthTable(const Foo13 &df, float t0, float t1, bool periodic, int n=256, float tolerance=1e-6f);
+
+	float totalLength() const { return s.back(); }
+	float arcLength(float t) const;
+	float parameter(float len) const;
+	float t1() const { return t0 + dt*(s.size() - 1); }
+};
+
+
 class SmoothParametricCurve {
 protected:
     Foo13 _f;
@@ -30,6 +49,8 @@ protected:
     float t1;
     bool periodic;
     PolyGroupID id;
+	mutable std::shared_ptr<ArcLengthTable> _arcLength = nullptr; // built lazily under arcLengthMutex
+	mutable std::mutex arcLengthMutex;
 public:
     SmoothParametricCurve(Foo13 f, Foo13 df, Foo13 ddf, PolyGroupID id=DFLT_CURV, float t0=0, float t1=TAU, bool periodic=true, float epsilon=0.01);
 	SmoothParametricCurve(Foo13 f, Foo13 df,PolyGroupID id=DFLT_CURV,  float t0=0, float t1=TAU, bool periodic=true, float epsilon=0.01);
@@ -65,11 +86,22 @@ public:
 	vec3 normal(float t) const { return normalise(cross(tangent(t), binormal(t))); }
 	vec3 binormal(float t) const { return normalise(cross(_df(t), _ddf(t))); }
 	float length(float t0, float t1, int n) const;
+	float length(float t0, float t1) const { return arcLength(t1) - arcLength(t0); }
+	float length() const { return arcLengthTable()->totalLength(); }
+	float arcLength(float t) const { return arcLengthTable()->arcLength(t); }
+	float parameterAtLength(float s) const { return arcLengthTable()->parameter(s); }
+	std::shared_ptr<ArcLengthTable> arcLengthTable() const;
+	void invalidateArcLengthTable();
+	SmoothParametricCurve arcLengthParametrization() const;
 
 	SmoothParametricCurve precompose(SpaceEndomorphism g_) const;
 	void precomposeInPlace(SpaceEndomorphism g);
 
 	mat3 FrenetFrame(float t) const;
+	std::vector<mat3> rotationMinimisingFrames(const std::vector<float> &params, bool closed) const;
+	// closes the loop only for periodic curves sampled over the whole period with coinciding endpoints
+	std::vector<mat3> rotationMinimisingFrames(const std::vector<float> &params) const;
+	std::vector<mat3> rotationMinimisingFrames(int n) const { return rotationMinimisingFrames(linspace(t0, t1, n)); }
 	float curvature(float t) const;
     float curvature_radius(float t) const { return 1/curvature(t); }
 	float torsion(float t) const;
@@ -95,6 +127,11 @@ public:
 
 
 
+// double reflection method (Wang, Juttler, Zheng, Liu 2008), frames are mat3(tangent, normal, binormal) as in FrenetFrame;
+// for closed curves the holonomy is spread uniformly along the samples so that the last frame matches the first
+std::vector<mat3> rotationMinimisingFrames(const std::vector<vec3> &points, const std::vector<vec3> &tangents, vec3 initialNormal, bool closed=false);
+
+
 class AffineLine : public SmoothParametricCurve {
 	vec3 p0, v; // p0 + tv
 public:
@@ -203,15 +240,44 @@ public:
 	void normaliseDomainToI2();
 	vec3 Laplacian(float t, float s) const;
 
-	float globalAreaIntegral(const RealFunctionPS &f) const;
+	float globalAreaIntegral(const RealFunctionPS &f, float tolerance=1e-5f, ExecutionMode mode=SEQUENTIAL) const;
+	float area(float tolerance=1e-5f, ExecutionMode mode=SEQUENTIAL) const;
 
-	float DirichletFunctional() const;
+	float DirichletFunctional(float tolerance=1e-5f, ExecutionMode mode=SEQUENTIAL) const;
 	float biharmonicFunctional() const;
 
 
 	SmoothParametricSurface meanCurvatureFlow(float dt) const;
 };
 
+// closest point queries on a parametric surface: nearest of tRes x uRes samples (bucketed in a uniform grid) is the
+// initial guess for Newton iterations minimising |S(t, u) - p|^2 with the second order jet of S
+class SurfaceProjector {
+	SmoothParametricSurface surface;
+	int tRes, uRes;
+	std::vector<vec3> samples;
+	std::vector<vec2> params;
+	vec3 gridOrigin;
+	float cellSize;
+	ivec3 gridSize;
+	std::vector<int> cellStart;
+	std::vector<int> cellItems;
+
+	ivec3 cellOf(vec3 p) const;
+	int cellIndex(ivec3 c) const { return (c.x*gridSize.y + c.y)*gridSize.z + c.z; }
+	vec2 wrapOrClamp(vec2 tu) const;
+public:
+	explicit SurfaceProjector(const SmoothParametricSurface &surface, int tRes=64, int uRes=64);
+
+	vec2 initialGuess(vec3 p) const;
+	vec2 project(vec3 p, int maxIter=16, float eps=1e-6f) const;
+	vec2 refine(vec3 p, vec2 tu, int maxIter=16, float eps=1e-6f) const;
+	vec3 closestPoint(vec3 p) const { return surface(project(p)); }
+	std::vector<vec2> project(const std::vector<vec3> &points, int maxIter=16, float eps=1e-6f) const;
+	std::vector<vec3> closestPoints(const std::vector<vec3> &points, int maxIter=16, float eps=1e-6f) const;
+};
+
+
 SmoothParametricSurface ruledSurfaceJoinT(const SmoothParametricCurve &c1, const SmoothParametricCurve &c2, float u0=0, float u1=1);
 SmoothParametricSurface ruledSurfaceJoinU(const SmoothParametricCurve &c1, const SmoothParametricCurve &c2, float t0=0, float t1=1);
 inline SmoothParametricSurface ruledSurfaceJoinT(const SmoothParametricCurve &c1, const SmoothParametricCurve &c2, vec2 bounds) { return ruledSurfaceJoinT(c1, c2, bounds.x, bounds.y); }
@@ -0,0 +1,55 @@
+#include "common/specific.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+using namespace glm;
+using std::vector, std::string, std::shared_ptr, std::unique_ptr, std::pair, std::make_unique, std::make_shared;
+
+// Throughput of per-vertex deformations and normal recomputation under each vertex layout of BufferManager.
+// Prints millions of vertices processed per second, best of a few repetitions.
+
+double bestRate(int vertexCount, int iterations, const std::function<void()> &step) {
+	double best = 0;
+	for (int rep = 0; rep < 5; rep++) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+			step();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::max(best, vertexCount * static_cast<double>(iterations) / elapsed.count() * 1e-6);
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	int levels = argc > 1 ? std::atoi(argv[1]) : 7;
+	int iterations = argc > 2 ? std::atoi(argv[2]) : 20;
+	PolyGroupID id = PolyGroupID(0);
+	int n = 0;
+
+	const char *names[] = {"SoA", "AoS", "hybrid", "packed"};
+	SpaceEndomorphism twist = SpaceEndomorphism::affine(rotationMatrix3(vec3(0, 0, 1), .001f), vec3(0));
+	VectorFieldR3 swirl = VectorFieldR3(Foo33([](vec3 p) { return vec3(-p.y, p.x, 0); }), .01f);
+
+	for (VertexLayout layout: {SOA_LAYOUT, AOS_LAYOUT, HYBRID_LAYOUT, QUANTIZED_LAYOUT}) {
+		WeakSuperMesh mesh = icosphere(1, levels, vec3(0), id);
+		mesh.setVertexLayout(layout);
+		if (n == 0) {
+			n = mesh.getBufferLength(POSITION);
+			std::printf("%d vertices, %d triangles, %d iterations\n", n, mesh.bufferIndexLength(), iterations);
+			std::printf("%-8s %14s %14s %14s %14s %14s\n", "layout", "ambient map", "per vertex", "vector field", "normals", "parallel map");
+		}
+		double ambient = bestRate(n, iterations, [&]() { mesh.deformWithAmbientMap(id, twist); });
+		double perVertex = bestRate(n, iterations, [&]() { mesh.deformPerVertex(id, [](BufferedVertex &v) {
+			v.setPosition(v.getPosition()*1.0001f);
+			v.setNormal(-v.getNormal());
+		}); });
+		double field = bestRate(n, iterations, [&]() { mesh.moveAlongVectorField(id, swirl, .001f); });
+		double normals = bestRate(n, iterations, [&]() { mesh.recomputeNormals(id); });
+		double parallel = bestRate(n, iterations, [&]() { mesh.deformWithAmbientMap(id, twist, PARALLEL); });
+		std::printf("%-8s %14.2f %14.2f %14.2f %14.2f %14.2f\n", names[layout], ambient, perVertex, field, normals, parallel);
+	}
+	return 0;
+}
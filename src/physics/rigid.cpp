@@ -62,7 +62,7 @@ boundaryID(randomID()), floorID(randomID()), centerID(randomID()){
 }
 
 float RollingBody::rollingPathLen(float phi) {
-	return boundary.length(polarParam, polarParam + phi, 10);
+	return boundary.length(polarParam, polarParam + phi);
 }
 
 void RollingBody::roll(float dt) {
@@ -0,0 +1,99 @@
+#include "src/common/indexedRendering.hpp"
+#include <cassert>
+#include <iostream>
+
+using namespace glm;
+using std::vector, std::pair;
+
+bool sameRanges(const DirtyRanges &d, const vector<pair<int, int>> &expected) {
+  return d.ranges() == expected;
+}
+
+void dirtyRangesTest()
+  {
+    DirtyRanges d;
+    d.mark(3);
+    d.mark(4);
+    d.mark(5, 8);
+    assert(sameRanges(d, {{3, 8}}));
+
+    d.mark(10, 12);
+    d.mark(0, 1);
+    assert(sameRanges(d, {{0, 1}, {3, 8}, {10, 12}}));
+
+    // touching intervals merge, a mark in a gap is inserted in order
+    d.mark(1, 2);
+    assert(sameRanges(d, {{0, 2}, {3, 8}, {10, 12}}));
+    d.mark(2, 3);
+    assert(sameRanges(d, {{0, 8}, {10, 12}}));
+
+    d.mark(9);
+    assert(sameRanges(d, {{0, 8}, {9, 12}}));
+    d.mark(5, 20);
+    assert(sameRanges(d, {{0, 20}}));
+    assert(d.elementCount() == 20);
+    assert(d.contains(19) && !d.contains(20));
+
+    d.mark(7, 7);
+    assert(sameRanges(d, {{0, 20}}));
+    d.clear();
+    assert(d.empty());
+    std::cout << "Dirty ranges merge and insert tests passed" << std::endl;
+  }
+
+void setterMarkingTest()
+  {
+    BufferManager boss;
+    boss.addFullVertexData(vec3(0), vec3(0, 0, 1), vec2(0), vec4(1));
+    int first = boss.addDirtyConsumer();
+    for (int i = 1; i < 10; i++)
+      boss.addFullVertexData(vec3(i), vec3(0, 0, 1), vec2(0), vec4(1));
+    assert(sameRanges(boss.dirtyRanges(POSITION, first), {{0, 10}}));
+    boss.clearDirty(first);
+    assert(!boss.isDirty(POSITION, first) && !boss.isDirty(COLOR, first));
+
+    boss.setPosition(4, vec3(1));
+    boss.setPosition(5, vec3(1));
+    boss.setColor(8, vec4(0));
+    assert(sameRanges(boss.dirtyRanges(POSITION, first), {{4, 6}}));
+    assert(sameRanges(boss.dirtyRanges(COLOR, first), {{8, 9}}));
+    assert(!boss.isDirty(NORMAL, first));
+
+    boss.clearDirty(first);
+    boss.trackWrites(false);
+    boss.setNormal(2, vec3(1, 0, 0));
+    boss.trackWrites(true);
+    assert(!boss.isDirty(NORMAL, first));
+
+    // every consumer sees a write until it clears its own ranges
+    int second = boss.addDirtyConsumer();
+    assert(sameRanges(boss.dirtyRanges(POSITION, second), {{0, 10}}));
+    boss.clearDirty(second);
+    boss.setUV(3, vec2(1));
+    boss.clearDirty(UV, first);
+    assert(!boss.isDirty(UV, first) && sameRanges(boss.dirtyRanges(UV, second), {{3, 4}}));
+
+    // writes made under a ThreadWrites are collected there until merged
+    boss.clearDirty(second);
+    {
+      BufferManager::ThreadWrites writes(boss);
+      boss.setPosition(7, vec3(2));
+      assert(!boss.isDirty(POSITION, second) && sameRanges(writes.ranges[POSITION], {{7, 8}}));
+      boss.markDirty(writes.ranges);
+    }
+    assert(sameRanges(boss.dirtyRanges(POSITION, second), {{7, 8}}));
+
+    // a released slot is reused and starts dirty again
+    boss.removeDirtyConsumer(first);
+    assert(boss.addDirtyConsumer() == first);
+    assert(sameRanges(boss.dirtyRanges(NORMAL, first), {{0, 10}}));
+    std::cout << "Buffer setter marking tests passed" << std::endl;
+  }
+
+
+  int main(void)
+  {
+    dirtyRangesTest();
+    setterMarkingTest();
+    return 0;
+  }
@@ -0,0 +1,54 @@
+#include "src/geometry/hyperbolic.hpp"
+#include <cassert>
+#include <iostream>
+
+using namespace glm;
+using std::vector;
+
+// rotation of the disk by angle around center
+Mob rotationD(Complex center, float angle) {
+  Mob t = Mob(ONE, center, center.conj(), ONE);
+  Mob r = Mob(Complex(cos(angle/2), sin(angle/2)), ZERO, ZERO, Complex(cos(angle/2), -sin(angle/2)));
+  return t*r*t.inv();
+}
+
+// The orientation preserving (2, 3, 7) triangle group, generated by the rotation of order 7 around the vertex of angle
+// pi/7 of its triangle, placed at 0, and the half turn around the vertex of angle pi/2. Its spheres grow slowly, so the
+// enumeration reaches hyperbolic distance ~9 while staying small; a missed duplicate would make them grow exponentially.
+void triangleGroupTest()
+  {
+    float side = acosh(.5f/sin(PI/7));
+    FuchsianGroup group = FuchsianGroup({rotationD(0, TAU/7), rotationD(tanh(side/2), PI)});
+    assert(group.getGeneratorsAndInverses().size() == 3);
+
+    vector<GroupElement> elements = group.enumerate(28);
+    vector<int> sphere = vector<int>(29, 0);
+    float farthest = 0;
+    for (const GroupElement &e: elements) {
+      sphere[e.length]++;
+      farthest = std::max(farthest, displacementD(e.m));
+    }
+    assert(sphere[1] == 3 && sphere[2] == 6 && sphere[3] == 10 && sphere[10] == 79);
+    assert(sphere[20] == 1138 && sphere[28] == 9564);
+    assert(elements.size() == 41070);
+    assert(farthest > 8);
+
+    // every element is found again, and a product equal to a known element is not inserted twice
+    MobiusSet set = MobiusSet();
+    for (const GroupElement &e: elements)
+      assert(set.insert(e.m) >= 0);
+    for (int i = 0; i < elements.size(); i += 97)
+      assert(set.find(elements[i].m) == i);
+    Mob a = group.getGeneratorsD()[0];
+    Mob b = group.getGeneratorsD()[1];
+    assert(set.insert(a*b*a*b*a*b) < 0);
+    assert(set.insert(elements.back().m*a*a*a*a*a*a*a) < 0);
+    std::cout << "Fuchsian group enumeration tests passed" << std::endl;
+  }
+
+
+  int main(void)
+  {
+    triangleGroupTest();
+    return 0;
+  }
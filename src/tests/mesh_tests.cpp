@@ -0,0 +1,158 @@
+#include "src/common/indexedRendering.hpp"
+#include <cassert>
+#include <iostream>
+
+using namespace glm;
+using std::vector, std::array;
+
+// regular icosahedron inscribed in the unit sphere, consistently oriented outwards, normals radial
+WeakSuperMesh icosahedron(const PolyGroupID &id) {
+  float t = (1 + std::sqrt(5.f))/2;
+  vector<vec3> corners = {vec3(-1, t, 0), vec3(1, t, 0), vec3(-1, -t, 0), vec3(1, -t, 0), vec3(0, -1, t), vec3(0, 1, t),
+                          vec3(0, -1, -t), vec3(0, 1, -t), vec3(t, 0, -1), vec3(t, 0, 1), vec3(-t, 0, -1), vec3(-t, 0, 1)};
+  vector<ivec3> faces = {ivec3(0, 11, 5), ivec3(0, 5, 1), ivec3(0, 1, 7), ivec3(0, 7, 10), ivec3(0, 10, 11),
+                         ivec3(1, 5, 9), ivec3(5, 11, 4), ivec3(11, 10, 2), ivec3(10, 7, 6), ivec3(7, 1, 8),
+                         ivec3(3, 9, 4), ivec3(3, 4, 2), ivec3(3, 2, 6), ivec3(3, 6, 8), ivec3(3, 8, 9),
+                         ivec3(4, 9, 5), ivec3(2, 4, 11), ivec3(6, 2, 10), ivec3(8, 6, 7), ivec3(9, 8, 1)};
+  vector<Vertex> vertices = {};
+  for (vec3 p: corners)
+    vertices.emplace_back(normalize(p), vec2(0), normalize(p), vec4(1));
+  return WeakSuperMesh(vertices, faces, id);
+}
+
+float enclosedVolume(const WeakSuperMesh &mesh, const PolyGroupID &id) {
+  vector<Vertex> vertices = mesh.getVertices(id);
+  float volume = 0;
+  for (ivec3 f: mesh.getIndices(id))
+    volume += dot(vertices[f.x].getPosition(), cross(vertices[f.y].getPosition(), vertices[f.z].getPosition()))/6;
+  return volume;
+}
+
+// A sphere under mean curvature flow stays round and shrinks as r^2 = 1 - 4t; the backward Euler steps on a 162 vertex
+// icosphere land within a percent of it after five steps.
+void meanCurvatureFlowSphereTest()
+  {
+    PolyGroupID id = 0;
+    WeakSuperMesh mesh = icosahedron(id).subdivideMidpoint(id, 2);
+    mesh.deformPerVertex(id, [](BufferedVertex &v) {
+      v.setPosition(normalize(v.getPosition()));
+      v.setNormal(v.getPosition());
+    });
+    float volume = enclosedVolume(mesh, id);
+
+    float dt = .01f;
+    int steps = 5;
+    for (int s = 0; s < steps; s++)
+      mesh.meanCurvatureFlowDeform(dt, id);
+
+    vector<Vertex> vertices = mesh.getVertices(id);
+    float meanRadius = 0, minRadius = INFINITY, maxRadius = 0;
+    vec3 centre = vec3(0);
+    for (const Vertex &v: vertices) {
+      float r = length(v.getPosition());
+      meanRadius += r/vertices.size();
+      minRadius = std::min(minRadius, r);
+      maxRadius = std::max(maxRadius, r);
+      centre += v.getPosition()/(1.f*vertices.size());
+      assert(dot(v.getNormal(), v.getPosition()/r) > .99f);
+    }
+    assert(std::abs(meanRadius - std::sqrt(1 - 4*dt*steps)) < .01f);
+    assert((maxRadius - minRadius)/meanRadius < .01f);
+    assert(length(centre) < 1e-4f);
+    // the shape is kept, so the volume scales with the cube of the radius
+    assert(std::abs(enclosedVolume(mesh, id)/volume - meanRadius*meanRadius*meanRadius) < 5e-3f);
+    std::cout << "Mean curvature flow on a sphere tests passed" << std::endl;
+  }
+
+// every level adds a vertex per edge and splits every face in four, on closed and open meshes alike; midpoint
+// subdivision keeps the old vertices and Loop subdivision pulls a convex mesh inside its hull
+void subdivisionCountTest()
+  {
+    PolyGroupID id = 0;
+    WeakSuperMesh ico = icosahedron(id);
+    for (bool loop: {false, true}) {
+      WeakSuperMesh once = loop ? ico.subdivideLoop(id) : ico.subdivideMidpoint(id);
+      WeakSuperMesh twice = loop ? ico.subdivideLoop(id, 2) : ico.subdivideMidpoint(id, 2);
+      assert(once.getVertices(id).size() == 42 && once.getIndices(id).size() == 80);
+      assert(twice.getVertices(id).size() == 162 && twice.getIndices(id).size() == 320);
+      vector<Vertex> vertices = twice.getVertices(id);
+      for (int i = 0; i < vertices.size(); i++) {
+        float r = length(vertices[i].getPosition());
+        assert(loop ? r < 1 - 1e-3f : i >= 12 || std::abs(r - 1) < 1e-5f);
+        assert(r > .7f);
+      }
+    }
+
+    WeakSuperMesh triangle = WeakSuperMesh({Vertex(vec3(0, 0, 0), vec2(0, 0)), Vertex(vec3(1, 0, 0), vec2(1, 0)), Vertex(vec3(0, 1, 0), vec2(0, 1))},
+                                           {ivec3(0, 1, 2)}, id);
+    for (bool loop: {false, true}) {
+      WeakSuperMesh twice = loop ? triangle.subdivideLoop(id, 2) : triangle.subdivideMidpoint(id, 2);
+      assert(twice.getVertices(id).size() == 15 && twice.getIndices(id).size() == 16);
+      for (const Vertex &v: twice.getVertices(id))
+        assert(v.getPosition().z == 0 && v.getPosition().x >= 0 && v.getPosition().y >= 0);
+    }
+    std::cout << "Midpoint and Loop subdivision count tests passed" << std::endl;
+  }
+
+// cube [-1, 1]^3 with separate vertices for each of its 12 triangles, normals and uvs per face
+WeakSuperMesh splitCube(const PolyGroupID &id) {
+  vector<Vertex> vertices = {};
+  vector<ivec3> faces = {};
+  for (int a = 0; a < 3; a++)
+    for (float side: {-1.f, 1.f}) {
+      int b = (a + 1) % 3, c = (a + 2) % 3;
+      vec3 n = vec3(0);
+      n[a] = side;
+      array<vec3, 4> quad = {};
+      array<vec2, 4> uvs = {vec2(0, 0), vec2(1, 0), vec2(1, 1), vec2(0, 1)};
+      for (int k = 0; k < 4; k++) {
+        quad[k] = n;
+        quad[k][b] = 2*uvs[k].x - 1;
+        quad[k][c] = 2*uvs[k].y - 1;
+      }
+      for (ivec3 tr: {ivec3(0, 1, 2), ivec3(0, 2, 3)}) {
+        for (int k = 0; k < 3; k++)
+          vertices.emplace_back(quad[tr[k]], uvs[tr[k]], n, vec4(1));
+        faces.emplace_back(vertices.size() - 3, vertices.size() - 2, vertices.size() - 1);
+      }
+    }
+  return WeakSuperMesh(vertices, faces, id);
+}
+
+// welding merges the two triangles of every cube face, and all corners once normals and uvs are allowed to differ;
+// no face collapses and a polygroup added later keeps its geometry while its buffer indices shift down
+void weldSplitCubeTest()
+  {
+    PolyGroupID cube = 0, other = 1;
+    WeakSuperMesh mesh = splitCube(cube);
+    mesh.addNewPolygroup({Vertex(vec3(3, 0, 0), vec2(0)), Vertex(vec3(4, 0, 0), vec2(0)), Vertex(vec3(3, 1, 0), vec2(0))}, {ivec3(0, 1, 2)}, other);
+    assert(mesh.getVertices(cube).size() == 36 && mesh.getIndices(cube).size() == 12);
+
+    assert(mesh.weld(cube) == 12);
+    assert(mesh.getVertices(cube).size() == 24 && mesh.getIndices(cube).size() == 12);
+    assert(mesh.weld(cube) == 0);
+
+    assert(mesh.weld(cube, 1e-5f, 2.f) == 16);
+    assert(mesh.getVertices(cube).size() == 8 && mesh.getIndices(cube).size() == 12);
+    const BufferManager &boss = mesh.getBufferBoss();
+    for (ivec3 f: mesh.getIndices(cube))
+      for (int k = 0; k < 3; k++) {
+        vec3 p = boss.getPosition(f[k]);
+        assert(f[k] < 8 && std::abs(p.x) == 1 && std::abs(p.y) == 1 && std::abs(p.z) == 1);
+      }
+
+    assert(mesh.getBufferLength(POSITION) == 11);
+    ivec3 f = mesh.getIndices(other).front();
+    assert(f == ivec3(8, 9, 10));
+    assert(boss.getPosition(f.x) == vec3(3, 0, 0) && boss.getPosition(f.y) == vec3(4, 0, 0) && boss.getPosition(f.z) == vec3(3, 1, 0));
+    std::cout << "Weld of a split cube tests passed" << std::endl;
+  }
+
+
+  int main(void)
+  {
+    meanCurvatureFlowSphereTest();
+    subdivisionCountTest();
+    weldSplitCubeTest();
+    return 0;
+  }
@@ -0,0 +1,74 @@
+#include "src/common/meshIO.hpp"
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using namespace glm;
+using std::vector, std::string;
+
+string writeTemporary(const string &name, const string &contents) {
+  string path = (std::filesystem::temp_directory_path() / name).string();
+  std::ofstream(path, std::ios::binary) << contents;
+  return path;
+}
+
+// the corners of face f, as (position, uv, normal) of the loaded vertices
+bool sameFace(const LoadedMesh &mesh, int f, const vector<vec3> &positions, const vector<vec2> &uvs) {
+  for (int k = 0; k < 3; k++)
+    if (mesh.positions[mesh.faces[f][k]] != positions[k] || mesh.uvs[mesh.faces[f][k]] != uvs[k] || mesh.normals[mesh.faces[f][k]] != vec3(0, 0, 1))
+      return false;
+  return true;
+}
+
+void objFaceFormatsTest()
+  {
+    string path = writeTemporary("meshio_tests.obj",
+      "# unit square\n"
+      "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n"
+      "vt 0 0\nvt 1 0\nvt 0 1\nvt 1 1\n"
+      "vn 0 0 1\n"
+      "f 1/1/1 2/2/1 3/3/1\n"
+      "f -3//-1 -1//-1 -2//-1\n"
+      "f -4/-4/-1 -3/-3/-1 -1/-1/-1 -2/-2/-1 # quad\n");
+    LoadedMesh mesh = loadOBJ(path.c_str());
+    std::remove(path.c_str());
+
+    vec3 p0 = vec3(0, 0, 0), p1 = vec3(1, 0, 0), p2 = vec3(0, 1, 0), p3 = vec3(1, 1, 0);
+    vec2 t0 = vec2(0, 0), t1 = vec2(1, 0), t2 = vec2(0, 1), t3 = vec2(1, 1);
+    assert(mesh.hasUVs && mesh.hasNormals && !mesh.hasColors);
+    assert(mesh.faces.size() == 4);
+    assert(sameFace(mesh, 0, {p0, p1, p2}, {t0, t1, t2}));
+    // v//vn corners have no uv, so they are other vertices than the v/vt/vn corners at the same positions
+    assert(sameFace(mesh, 1, {p1, p3, p2}, {vec2(0), vec2(0), vec2(0)}));
+    // the quad is fanned from its first corner and reuses the vertices of the first face
+    assert(sameFace(mesh, 2, {p0, p1, p3}, {t0, t1, t3}));
+    assert(sameFace(mesh, 3, {p0, p3, p2}, {t0, t3, t2}));
+    assert(mesh.faces[2].x == mesh.faces[0].x && mesh.faces[2].y == mesh.faces[0].y && mesh.faces[3].z == mesh.faces[0].z);
+    assert(mesh.positions.size() == 7);
+    std::cout << "OBJ face format and relative index tests passed" << std::endl;
+  }
+
+void objMissingElementTest()
+  {
+    string path = writeTemporary("meshio_tests_broken.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 -4\n");
+    bool thrown = false;
+    try {
+      loadOBJ(path.c_str());
+    }
+    catch (const std::runtime_error &) {
+      thrown = true;
+    }
+    std::remove(path.c_str());
+    assert(thrown);
+    std::cout << "OBJ missing element tests passed" << std::endl;
+  }
+
+
+  int main(void)
+  {
+    objFaceFormatsTest();
+    objMissingElementTest();
+    return 0;
+  }